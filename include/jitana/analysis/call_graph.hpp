@@ -21,7 +21,6 @@
 
 #include <algorithm>
 
-#include <boost/type_erasure/any_cast.hpp>
 #include <boost/range/iterator_range.hpp>
 
 namespace jitana {
@@ -38,23 +37,32 @@ namespace jitana {
         os << ", taillabel=" << prop.caller_insn_vertex;
     }
 
+    /// Adds the call graph edges from the method.
+    ///
+    /// InsnGraph selects the representation of the instruction graphs to read
+    /// the invoke instructions from: insn_graph or compact_insn_graph.
+    template <typename InsnGraph = insn_graph>
     inline void add_call_graph_edges(virtual_machine& vm,
                                      const method_vertex_descriptor& v)
     {
-        using boost::type_erasure::any_cast;
 
         auto& mg = vm.methods();
 
+        // Read through a const reference so that the properties of a base
+        // shared with other virtual machines are not copied.
+        const auto& cmg = mg;
+
         // Abort if we already have an outgoing call graph edge to avoid
         // creating duplicates. For performacnce, we should have flags
         // indicating if we have already computed the call graph for this edge.
-        for (const auto& me : boost::make_iterator_range(out_edges(v, mg))) {
-            if (any_cast<method_call_edge_property*>(&mg[me]) != nullptr) {
+        for (const auto& me : boost::make_iterator_range(out_edges(v, cmg))) {
+            if (edge_cast<method_call_edge_property>(&cmg[me]) != nullptr) {
                 return;
             }
         }
 
-        auto ig = mg[v].insns;
+        auto ig_ptr = share_insn_graph<InsnGraph>(cmg[v].insns);
+        const auto& ig = *ig_ptr;
 
         // Iterate over the instruction graph vertices.
         for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
@@ -91,7 +99,7 @@ namespace jitana {
                 continue;
             }
             else {
-                method_hdl = *const_val<dex_method_hdl>(prop.insn);
+                method_hdl = *const_val<dex_method_hdl>(get_insn(ig, iv));
             }
 
             // Add an edge to the methood graph.
@@ -102,12 +110,13 @@ namespace jitana {
         }
     }
 
+    template <typename InsnGraph = insn_graph>
     inline void add_call_graph_edges(virtual_machine& vm)
     {
         auto& mg = vm.methods();
         std::for_each(vertices(mg).first, vertices(mg).second,
                       [&](const method_vertex_descriptor& v) {
-                          add_call_graph_edges(vm, v);
+                          add_call_graph_edges<InsnGraph>(vm, v);
                       });
     }
 }
@@ -47,7 +47,8 @@ namespace jitana {
                                std::vector<loader_vertex_descriptor>>
                     handlers;
 
-            const auto& lg = vm.loaders();
+            const auto& cvm = vm;
+            const auto& lg = cvm.loaders();
             for (const auto& lv : boost::make_iterator_range(vertices(lg))) {
                 const auto* info = get<apk_info>(&lg[lv].info);
                 if (!info) {
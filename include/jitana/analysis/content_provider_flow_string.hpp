@@ -30,13 +30,14 @@ namespace jitana {
                 = detail::compute_content_provider_handlers(vm);
 
         std::regex rgx("(content://)?([^/]*).*");
-        std::smatch match;
+        std::cmatch match;
 
         auto& lg = vm.loaders();
         const auto& mg = vm.methods();
 
         for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
-            const auto& ig = mg[mv].insns;
+            const auto ig_ptr = mg[mv].insns.share();
+            const auto& ig = *ig_ptr;
 
             for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
                 const auto* cs_insn = get<insn_const_string>(&ig[iv].insn);
@@ -44,8 +45,8 @@ namespace jitana {
                     continue;
                 }
 
-                const auto& s = cs_insn->const_val;
-                if (std::regex_match(begin(s), end(s), match, rgx)) {
+                auto s = cs_insn->const_val.view();
+                if (std::regex_match(s.begin(), s.end(), match, rgx)) {
                     auto it = content_provider_handlers.find(match[2]);
                     if (it != end(content_provider_handlers)) {
                         content_provider_flow_edge_property prop;
@@ -27,21 +27,9 @@
 
 #include <boost/graph/filtered_graph.hpp>
 #include <boost/graph/properties.hpp>
-#include <boost/type_erasure/any_cast.hpp>
 #include <boost/range/iterator_range.hpp>
 
 namespace jitana {
-    struct insn_def_use_edge_property {
-        register_idx reg;
-    };
-
-    inline void print_graphviz_attr(std::ostream& os,
-                                    const insn_def_use_edge_property& prop)
-    {
-        os << "color=red, fontcolor=red";
-        os << ", label=\"" << prop.reg << "\"";
-    }
-
     template <typename CFG, typename SetMap, typename DefsMap>
     inline void reaching_definitions(const CFG& cfg, SetMap& inset_map,
                                      SetMap& outset_map,
@@ -80,7 +68,8 @@ namespace jitana {
         monotonic_dataflow(cfg, inset_map, outset_map, comb_op, flow_func);
     }
 
-    inline void add_def_use_edges(insn_graph& g)
+    template <typename InsnGraph>
+    inline void add_def_use_edges(InsnGraph& g)
     {
         if (num_vertices(g) == 0) {
             return;
@@ -102,9 +91,10 @@ namespace jitana {
         std::vector<set> outset_map(num_vertices(g));
         reaching_definitions(cfg, inset_map, outset_map, defs_map);
 
-        // Add def-use edges using the use_map and the result from the reaching
-        // definitions.
-        remove_edge_if(make_edge_type_pred<insn_def_use_edge_property>(g), g);
+        // Replace the def-use edges using the use_map and the result from the
+        // reaching definitions.
+        using edge_array = insn_edge_array<insn_def_use_edge_property>;
+        std::vector<typename edge_array::edge_type> du_edges;
         for (const auto& v : boost::make_iterator_range(vertices(g))) {
             for (const auto& e : inset_map[v]) {
                 if (e.first != v
@@ -112,10 +102,12 @@ namespace jitana {
                                           e.second)) {
                     insn_def_use_edge_property edge_prop;
                     edge_prop.reg = e.second;
-                    add_edge(e.first, v, edge_prop, g);
+                    du_edges.push_back({e.first, v, edge_prop});
                 }
             }
         }
+        g[boost::graph_bundle].def_use_edges.assign(std::move(du_edges),
+                                                    num_vertices(g));
     }
 }
 
@@ -20,34 +20,23 @@
 #include "jitana/jitana.hpp"
 
 namespace jitana {
-    struct insn_exception_flow_edge_property {
-    };
-
-    inline void
-    print_graphviz_attr(std::ostream& os,
-                        const insn_exception_flow_edge_property& /*prop*/)
-    {
-        os << "color=darkgreen, fontcolor=darkgreen, weight=1";
-    }
-
     inline void add_exception_flow_edges(virtual_machine& /*vm*/, insn_graph& g)
     {
         if (num_vertices(g) == 0) {
             return;
         }
 
-        remove_edge_if(
-                make_edge_type_pred<insn_exception_flow_edge_property>(g), g);
+        auto& gprop = g[boost::graph_bundle];
 
-        auto gprop = g[boost::graph_bundle];
+        using edge_array = insn_edge_array<insn_exception_flow_edge_property>;
+        std::vector<edge_array::edge_type> ex_edges;
 
         for (const auto& tc : gprop.try_catches) {
             auto scan_try_block_insns = [&](auto handler_v) {
                 for (auto v = tc.first; v <= tc.last; ++v) {
                     const auto& insn = g[v].insn;
                     if (info(op(insn)).can_throw()) {
-                        insn_exception_flow_edge_property edge_prop;
-                        add_edge(v, handler_v, edge_prop, g);
+                        ex_edges.push_back({v, handler_v, {}});
                     }
                 }
             };
@@ -65,10 +54,11 @@ namespace jitana {
         for (const auto& v : boost::make_iterator_range(vertices(g))) {
             const auto& insn = g[v].insn;
             if (info(op(insn)).can_throw()) {
-                insn_exception_flow_edge_property edge_prop;
-                add_edge(v, exit_v, edge_prop, g);
+                ex_edges.push_back({v, exit_v, {}});
             }
         }
+
+        gprop.exception_edges.assign(std::move(ex_edges), num_vertices(g));
     }
 }
 
@@ -59,7 +59,8 @@ namespace jitana {
         for (const auto& ccg_v : boost::make_iterator_range(vertices(ccg))) {
             const auto& mh = ccg[ccg_v].hdl;
             const auto& mv = *vm.find_method(mh, true);
-            const auto& ig = mg[mv].insns;
+            const auto ig_ptr = mg[mv].insns.share();
+            const auto& ig = *ig_ptr;
 
             if (num_vertices(ig) == 0) {
                 // TODO: handle method without vertices.
@@ -167,8 +168,11 @@ namespace jitana {
             const auto& callee_mh = ccg[target(ccg_e, ccg)].hdl;
             const auto& caller_mv = *vm.find_method(caller_mh, true);
             const auto& callee_mv = *vm.find_method(callee_mh, true);
-            const auto& caller_ig = mg[caller_mv].insns;
-            const auto& callee_ig = mg[callee_mv].insns;
+            // Keep both graphs alive while they are referenced.
+            auto caller_ig_ptr = mg[caller_mv].insns.share();
+            auto callee_ig_ptr = mg[callee_mv].insns.share();
+            const auto& caller_ig = *caller_ig_ptr;
+            const auto& callee_ig = *callee_ig_ptr;
             auto caller_iv = ccg[ccg_e].caller_insn_vertex;
 
             const auto* invoke_insn
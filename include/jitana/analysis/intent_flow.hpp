@@ -48,13 +48,31 @@ namespace jitana {
 
 namespace jitana {
     namespace detail {
+        /// The loaders handling the intents keyed by the names.
+        using intent_handler_map
+                = std::unordered_map<symbol,
+                                     std::vector<loader_vertex_descriptor>>;
+
+        /// Returns the loaders handling the intent, or nullptr if none.
+        inline const std::vector<loader_vertex_descriptor>*
+        find_intent_handlers(const intent_handler_map& handlers,
+                             boost::string_view name)
+        {
+            // The name cannot be a key unless it is interned.
+            auto key = symbol::find(name);
+            if (!key) {
+                return nullptr;
+            }
+            auto it = handlers.find(*key);
+            return it != end(handlers) ? &it->second : nullptr;
+        }
+
         inline auto compute_explicit_intent_handlers(virtual_machine& vm)
         {
-            std::unordered_map<std::string,
-                               std::vector<loader_vertex_descriptor>>
-                    handlers;
+            intent_handler_map handlers;
 
-            const auto& lg = vm.loaders();
+            const auto& cvm = vm;
+            const auto& lg = cvm.loaders();
             for (const auto& lv : boost::make_iterator_range(vertices(lg))) {
                 const auto* info = get<apk_info>(&lg[lv].info);
                 if (!info) {
@@ -105,11 +123,10 @@ namespace jitana {
 
         inline auto compute_implicit_intent_handlers(virtual_machine& vm)
         {
-            std::unordered_map<std::string,
-                               std::vector<loader_vertex_descriptor>>
-                    handlers;
+            intent_handler_map handlers;
 
-            const auto& lg = vm.loaders();
+            const auto& cvm = vm;
+            const auto& lg = cvm.loaders();
             for (const auto& lv : boost::make_iterator_range(vertices(lg))) {
                 const auto* info = get<apk_info>(&lg[lv].info);
                 if (!info) {
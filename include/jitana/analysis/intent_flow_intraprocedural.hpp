@@ -65,7 +65,8 @@ namespace jitana {
         auto& lg = vm.loaders();
 
         for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
-            const auto& ig = mg[mv].insns;
+            const auto ig_ptr = mg[mv].insns.share();
+            const auto& ig = *ig_ptr;
             for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
                 const auto* invoke_insn = get<insn_invoke>(&ig[iv].insn);
                 if (!invoke_insn) {
@@ -78,29 +79,27 @@ namespace jitana {
                 }
                 auto class_name_reg = invoke_insn->regs[2];
 
-                for (const auto& e :
-                     boost::make_iterator_range(in_edges(iv, ig))) {
-                    using boost::type_erasure::any_cast;
-                    using df_edge_prop_t = insn_def_use_edge_property;
-                    const auto* de = any_cast<const df_edge_prop_t*>(&ig[e]);
-                    if (!de || de->reg != class_name_reg) {
+                const auto& du_edges = ig[boost::graph_bundle].def_use_edges;
+                for (const auto& e : du_edges.in_edges(iv)) {
+                    if (e.prop.reg != class_name_reg) {
                         continue;
                     }
 
-                    const auto& source_insn = ig[source(e, ig)].insn;
+                    const auto& source_insn = ig[e.source].insn;
                     const auto* cs_insn = get<insn_const_string>(&source_insn);
                     if (!cs_insn) {
                         continue;
                     }
 
-                    auto it = intent_handlers.find(cs_insn->const_val);
-                    if (it != end(intent_handlers)) {
+                    const auto* handlers = detail::find_intent_handlers(
+                            intent_handlers, cs_insn->const_val.view());
+                    if (handlers) {
                         intent_flow_edge_property prop;
                         prop.kind = intent_flow_edge_property::explicit_intent;
-                        prop.description = cs_insn->const_val;
+                        prop.description = cs_insn->const_val.str();
                         auto lv = *find_loader_vertex(
                                 mg[mv].hdl.file_hdl.loader_hdl, lg);
-                        for (const auto& target_lv : it->second) {
+                        for (const auto& target_lv : *handlers) {
                             add_edge(lv, target_lv, prop, lg);
                         }
                     }
@@ -128,7 +127,8 @@ namespace jitana {
         auto intent_mv = vm.find_method(intent_mh, true);
 
         for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
-            const auto& ig = mg[mv].insns;
+            const auto ig_ptr = mg[mv].insns.share();
+            const auto& ig = *ig_ptr;
 
             for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
                 const auto* invoke_insn = get<insn_invoke>(&ig[iv].insn);
@@ -142,29 +142,27 @@ namespace jitana {
                 }
                 auto action_string_reg = invoke_insn->regs[1];
 
-                for (const auto& e :
-                     boost::make_iterator_range(in_edges(iv, ig))) {
-                    using boost::type_erasure::any_cast;
-                    using df_edge_prop_t = insn_def_use_edge_property;
-                    const auto* de = any_cast<const df_edge_prop_t*>(&ig[e]);
-                    if (!de || de->reg != action_string_reg) {
+                const auto& du_edges = ig[boost::graph_bundle].def_use_edges;
+                for (const auto& e : du_edges.in_edges(iv)) {
+                    if (e.prop.reg != action_string_reg) {
                         continue;
                     }
 
-                    const auto& source_insn = ig[source(e, ig)].insn;
+                    const auto& source_insn = ig[e.source].insn;
                     const auto* cs_insn = get<insn_const_string>(&source_insn);
                     if (!cs_insn) {
                         continue;
                     }
 
-                    auto it = intent_handlers.find(cs_insn->const_val);
-                    if (it != end(intent_handlers)) {
+                    const auto* handlers = detail::find_intent_handlers(
+                            intent_handlers, cs_insn->const_val.view());
+                    if (handlers) {
                         intent_flow_edge_property prop;
                         prop.kind = intent_flow_edge_property::implicit_intent;
-                        prop.description = cs_insn->const_val;
+                        prop.description = cs_insn->const_val.str();
                         auto lv = *find_loader_vertex(
                                 mg[mv].hdl.file_hdl.loader_hdl, lg);
-                        for (const auto& target_lv : it->second) {
+                        for (const auto& target_lv : *handlers) {
                             add_edge(lv, target_lv, prop, lg);
                         }
                     }
@@ -41,7 +41,8 @@ namespace jitana {
         const auto& mg = vm.methods();
 
         for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
-            const auto& ig = mg[mv].insns;
+            const auto ig_ptr = mg[mv].insns.share();
+            const auto& ig = *ig_ptr;
 
             for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
                 const auto* cs_insn = get<insn_const_string>(&ig[iv].insn);
@@ -49,14 +50,15 @@ namespace jitana {
                     continue;
                 }
 
-                auto it = intent_handlers.find(cs_insn->const_val);
-                if (it != end(intent_handlers)) {
+                const auto* handlers = detail::find_intent_handlers(
+                        intent_handlers, cs_insn->const_val.view());
+                if (handlers) {
                     intent_flow_edge_property prop;
                     prop.kind = intent_flow_edge_property::explicit_intent;
-                    prop.description = cs_insn->const_val;
+                    prop.description = cs_insn->const_val.str();
                     auto lv = *find_loader_vertex(
                             mg[mv].hdl.file_hdl.loader_hdl, lg);
-                    for (const auto& target_lv : it->second) {
+                    for (const auto& target_lv : *handlers) {
                         add_edge(lv, target_lv, prop, lg);
                     }
                 }
@@ -72,7 +74,8 @@ namespace jitana {
         const auto& mg = vm.methods();
 
         for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
-            const auto& ig = mg[mv].insns;
+            const auto ig_ptr = mg[mv].insns.share();
+            const auto& ig = *ig_ptr;
 
             for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
                 const auto* cs_insn = get<insn_const_string>(&ig[iv].insn);
@@ -80,14 +83,15 @@ namespace jitana {
                     continue;
                 }
 
-                auto it = intent_handlers.find(cs_insn->const_val);
-                if (it != end(intent_handlers)) {
+                const auto* handlers = detail::find_intent_handlers(
+                        intent_handlers, cs_insn->const_val.view());
+                if (handlers) {
                     intent_flow_edge_property prop;
                     prop.kind = intent_flow_edge_property::implicit_intent;
-                    prop.description = cs_insn->const_val;
+                    prop.description = cs_insn->const_val.str();
                     auto lv = *find_loader_vertex(
                             mg[mv].hdl.file_hdl.loader_hdl, lg);
-                    for (const auto& target_lv : it->second) {
+                    for (const auto& target_lv : *handlers) {
                         add_edge(lv, target_lv, prop, lg);
                     }
                 }
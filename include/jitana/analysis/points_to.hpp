@@ -21,6 +21,13 @@
 #include "jitana/analysis_graph/contextual_call_graph.hpp"
 
 namespace jitana {
+    /// Updates the pointer assignment graph and the contextual call graph from
+    /// the method.
+    ///
+    /// InsnGraph selects the representation of the instruction graphs to read
+    /// the instructions from: insn_graph or compact_insn_graph. The def-use
+    /// edges of the insn_graph instances must be added beforehand.
+    template <typename InsnGraph = insn_graph>
     bool update_points_to_graphs(pointer_assignment_graph& pag,
                                  contextual_call_graph& cg, virtual_machine& vm,
                                  const method_vertex_descriptor& mv,
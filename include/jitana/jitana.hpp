@@ -21,5 +21,7 @@
 #include "jitana/vm_core/dex_file.hpp"
 #include "jitana/vm_graph/graphviz.hpp"
 #include "jitana/vm_graph/edge_filtered_graph.hpp"
+#include "jitana/vm_graph/class_hierarchy.hpp"
+#include "jitana/vm_graph/method_dispatch.hpp"
 
 #endif
@@ -34,6 +34,9 @@ namespace jitana {
 
     void read_axml(const std::string& filename,
                    boost::property_tree::ptree& pt);
+
+    void read_axml(const void* first, const void* last,
+                   boost::property_tree::ptree& pt);
 }
 
 #endif
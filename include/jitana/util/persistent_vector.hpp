@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_PERSISTENT_VECTOR_HPP
+#define JITANA_PERSISTENT_VECTOR_HPP
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+namespace jitana {
+    /// A vector whose copies share the elements.
+    ///
+    /// The elements are stored in a trie of 32-element leaves (a
+    /// bit-partitioned vector trie), and the last leaf is kept separately as
+    /// the tail. Copying the vector copies the root pointer and the tail only,
+    /// and modifying a copy creates the new path without modifying the
+    /// original. Indexing takes at most log32(size) steps.
+    template <typename T>
+    class persistent_vector {
+    private:
+        static constexpr unsigned bits = 5;
+        static constexpr size_t width = size_t(1) << bits;
+        static constexpr size_t mask = width - 1;
+
+        struct node {
+            std::vector<std::shared_ptr<const node>> children;
+            std::vector<T> values;
+        };
+
+    public:
+        using value_type = T;
+
+        class const_iterator
+                : public boost::iterator_facade<const_iterator, const T,
+                                                std::random_access_iterator_tag> {
+        public:
+            const_iterator() = default;
+
+            const_iterator(const persistent_vector* v, size_t i) : v_(v), i_(i)
+            {
+            }
+
+        private:
+            friend class boost::iterator_core_access;
+
+            const T& dereference() const
+            {
+                return (*v_)[i_];
+            }
+
+            bool equal(const const_iterator& x) const
+            {
+                return i_ == x.i_;
+            }
+
+            void increment()
+            {
+                ++i_;
+            }
+
+            void decrement()
+            {
+                --i_;
+            }
+
+            void advance(std::ptrdiff_t n)
+            {
+                i_ += n;
+            }
+
+            std::ptrdiff_t distance_to(const const_iterator& x) const
+            {
+                return std::ptrdiff_t(x.i_) - std::ptrdiff_t(i_);
+            }
+
+            const persistent_vector* v_ = nullptr;
+            size_t i_ = 0;
+        };
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        const T& operator[](size_t i) const
+        {
+            const auto off = tail_offset();
+            if (i >= off) {
+                return tail_[i - off];
+            }
+
+            const node* n = root_.get();
+            for (auto level = shift_; level > 0; level -= bits) {
+                n = n->children[(i >> level) & mask].get();
+            }
+            return n->values[i & mask];
+        }
+
+        const_iterator begin() const
+        {
+            return {this, 0};
+        }
+
+        const_iterator end() const
+        {
+            return {this, size_};
+        }
+
+        void push_back(T x)
+        {
+            if (size_ - tail_offset() < width) {
+                tail_.push_back(std::move(x));
+                ++size_;
+                return;
+            }
+
+            // Move the full tail into the trie.
+            auto leaf = std::make_shared<node>();
+            leaf->values = std::move(tail_);
+            if ((size_ >> bits) > (size_t(1) << shift_)) {
+                // The trie is full: add a level.
+                auto root = std::make_shared<node>();
+                root->children.push_back(std::move(root_));
+                root->children.push_back(new_path(shift_, std::move(leaf)));
+                root_ = std::move(root);
+                shift_ += bits;
+            }
+            else {
+                root_ = push_tail(shift_, root_.get(), std::move(leaf));
+            }
+
+            tail_ = std::vector<T>();
+            tail_.reserve(width);
+            tail_.push_back(std::move(x));
+            ++size_;
+        }
+
+        /// Replaces the element at the index.
+        void set(size_t i, T x)
+        {
+            const auto off = tail_offset();
+            if (i >= off) {
+                tail_[i - off] = std::move(x);
+            }
+            else {
+                root_ = set_path(shift_, root_.get(), i, std::move(x));
+            }
+        }
+
+    private:
+        size_t tail_offset() const
+        {
+            return size_ < width ? 0 : ((size_ - 1) >> bits) << bits;
+        }
+
+        static std::shared_ptr<const node>
+        new_path(unsigned level, std::shared_ptr<const node> leaf)
+        {
+            if (level == 0) {
+                return leaf;
+            }
+            auto n = std::make_shared<node>();
+            n->children.push_back(new_path(level - bits, std::move(leaf)));
+            return n;
+        }
+
+        std::shared_ptr<const node> push_tail(unsigned level,
+                                              const node* parent,
+                                              std::shared_ptr<const node> leaf)
+        {
+            // Copy the path to the new leaf. The other children are shared.
+            auto n = parent ? std::make_shared<node>(*parent)
+                            : std::make_shared<node>();
+            const auto idx = ((size_ - 1) >> level) & mask;
+            std::shared_ptr<const node> child;
+            if (level == bits) {
+                child = std::move(leaf);
+            }
+            else if (idx < n->children.size()) {
+                child = push_tail(level - bits, n->children[idx].get(),
+                                  std::move(leaf));
+            }
+            else {
+                child = new_path(level - bits, std::move(leaf));
+            }
+
+            if (idx < n->children.size()) {
+                n->children[idx] = std::move(child);
+            }
+            else {
+                n->children.push_back(std::move(child));
+            }
+            return n;
+        }
+
+        static std::shared_ptr<const node>
+        set_path(unsigned level, const node* parent, size_t i, T x)
+        {
+            auto n = std::make_shared<node>(*parent);
+            if (level == 0) {
+                n->values[i & mask] = std::move(x);
+            }
+            else {
+                auto& child = n->children[(i >> level) & mask];
+                child = set_path(level - bits, child.get(), i, std::move(x));
+            }
+            return n;
+        }
+
+        std::shared_ptr<const node> root_;
+        unsigned shift_ = bits;
+        size_t size_ = 0;
+        std::vector<T> tail_;
+    };
+}
+
+#endif
@@ -17,9 +17,311 @@
 #ifndef JITANA_STREAM_READER_HPP
 #define JITANA_STREAM_READER_HPP
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
 
+// The LEB128 values are decoded in blocks only if BMI2 is available. Without
+// it, the bytes cannot be gathered without branches, and the scalar decoder is
+// faster.
+#if defined(__BMI2__) && (defined(__AVX2__) || defined(__SSE2__))
+#define JITANA_SIMD_LEB128
+#include <immintrin.h>
+#endif
+
 namespace jitana {
+    namespace detail {
+        /// Decodes the uleb128 value without checking the range.
+        ///
+        /// The loop is unrolled since most of the values are short.
+        inline uint32_t decode_uleb128(const uint8_t*& p)
+        {
+            uint32_t decoded = p[0];
+            if (decoded < 0x80) {
+                p += 1;
+                return decoded;
+            }
+            decoded = (decoded & 0x7f) | uint32_t(p[1] & 0x7f) << 7;
+            if (p[1] < 0x80) {
+                p += 2;
+                return decoded;
+            }
+            decoded |= uint32_t(p[2] & 0x7f) << 14;
+            if (p[2] < 0x80) {
+                p += 3;
+                return decoded;
+            }
+            decoded |= uint32_t(p[3] & 0x7f) << 21;
+            if (p[3] < 0x80) {
+                p += 4;
+                return decoded;
+            }
+            decoded |= uint32_t(p[4]) << 28;
+            p += 5;
+            return decoded;
+        }
+
+        /// Decodes the sleb128 value without checking the range.
+        inline int32_t decode_sleb128(const uint8_t*& p)
+        {
+            const auto* first = p;
+            uint32_t decoded = decode_uleb128(p);
+            const auto size = p - first;
+            if (size < 5 && (p[-1] & 0x40)) {
+                // Sign extend.
+                decoded |= ~uint32_t(0) << (7 * size);
+            }
+            return int32_t(decoded);
+        }
+
+#if defined(JITANA_SIMD_LEB128) && defined(__AVX2__)
+        constexpr ptrdiff_t leb128_block_size = 32;
+
+        /// Returns the mask of the bytes in the block with the top bit set.
+        inline uint32_t leb128_continuation_mask(const uint8_t* p)
+        {
+            const auto v = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(p));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+        }
+
+        /// Zero extends the bytes in the block.
+        inline void widen_leb128_block(const uint8_t* p, uint32_t* out)
+        {
+            for (int i = 0; i < leb128_block_size; i += 8) {
+                const auto v = _mm_loadl_epi64(
+                        reinterpret_cast<const __m128i*>(p + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                                    _mm256_cvtepu8_epi32(v));
+            }
+        }
+#elif defined(JITANA_SIMD_LEB128)
+        constexpr ptrdiff_t leb128_block_size = 16;
+
+        /// Returns the mask of the bytes in the block with the top bit set.
+        inline uint32_t leb128_continuation_mask(const uint8_t* p)
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            return static_cast<uint32_t>(_mm_movemask_epi8(v));
+        }
+
+        /// Zero extends the bytes in the block.
+        inline void widen_leb128_block(const uint8_t* p, uint32_t* out)
+        {
+            const auto zero = _mm_setzero_si128();
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const auto lo = _mm_unpacklo_epi8(v, zero);
+            const auto hi = _mm_unpackhi_epi8(v, zero);
+            auto* q = reinterpret_cast<__m128i*>(out);
+            _mm_storeu_si128(q + 0, _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(q + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(q + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(q + 3, _mm_unpackhi_epi16(hi, zero));
+        }
+#endif
+
+#ifdef JITANA_SIMD_LEB128
+        /// Decodes the uleb128 value of the length without branches.
+        ///
+        /// The 8 bytes from the pointer must be readable.
+        inline uint32_t decode_uleb128(const uint8_t* p, size_t length)
+        {
+            uint64_t x;
+            std::memcpy(&x, p, sizeof(x));
+            x &= ~uint64_t(0) >> (64 - 8 * length);
+            return static_cast<uint32_t>(_pext_u64(x, 0x0f7f7f7f7full));
+        }
+#endif
+
+        /// Decodes the uleb128 values ending in the blocks of bytes before
+        /// the end, and returns the number of the values left.
+        ///
+        /// The ends of the values in a block are found at once with SIMD
+        /// instructions, so the values are decoded without branching on each
+        /// byte. Nothing is decoded if JITANA_SIMD_LEB128 is not defined.
+        /// Since only the bytes before the end are read, it is safe for the
+        /// unvalidated memory.
+        inline size_t decode_uleb128_blocks(const uint8_t*& p,
+                                            const uint8_t* end,
+                                            uint32_t*& out, size_t n)
+        {
+#ifdef JITANA_SIMD_LEB128
+            constexpr auto block_bits
+                    = (uint64_t(1) << leb128_block_size) - 1;
+
+            // The last value in the block is read as 8 bytes.
+            while (n != 0 && end - p >= leb128_block_size + 8) {
+                const auto mask = uint64_t(leb128_continuation_mask(p));
+                if (mask == 0 && n >= size_t(leb128_block_size)) {
+                    // All the values have a single byte.
+                    widen_leb128_block(p, out);
+                    p += leb128_block_size;
+                    out += leb128_block_size;
+                    n -= leb128_block_size;
+                    continue;
+                }
+
+                auto ends = ~mask & block_bits;
+                if (ends == 0) {
+                    break;
+                }
+
+                // Decode the values ending in the block.
+                const auto* block = p;
+                do {
+                    const auto* last = block + __builtin_ctzll(ends);
+                    const size_t length = last - p + 1;
+                    if (length > 5) {
+                        // Leave the malformed value to the caller.
+                        return n;
+                    }
+                    *out++ = decode_uleb128(p, length);
+                    p = last + 1;
+                    --n;
+                    ends &= ends - 1;
+                } while (ends != 0 && n != 0);
+            }
+#else
+            (void)p;
+            (void)end;
+            (void)out;
+#endif
+            return n;
+        }
+
+        /// Decodes the n uleb128 values without checking the range.
+        inline void decode_uleb128_batch(const uint8_t*& p,
+                                         const uint8_t* limit, uint32_t* out,
+                                         size_t n)
+        {
+            n = decode_uleb128_blocks(p, limit, out, n);
+            for (; n != 0; --n) {
+                *out++ = decode_uleb128(p);
+            }
+        }
+
+        /// Skips the blocks of bytes before the limit that only have the
+        /// first n uleb128 values, and returns the number of the values left.
+        ///
+        /// Since only the bytes before the limit are read, it is safe for the
+        /// unvalidated memory.
+        inline size_t skip_uleb128_blocks(const uint8_t*& p,
+                                          const uint8_t* limit, size_t n)
+        {
+#ifdef JITANA_SIMD_LEB128
+            constexpr auto last_bit = uint32_t(1) << (leb128_block_size - 1);
+            while (n != 0 && limit - p >= leb128_block_size) {
+                const auto ends = uint32_t(~leb128_continuation_mask(p))
+                        & (last_bit | (last_bit - 1));
+                const size_t n_ends = __builtin_popcount(ends);
+                if (n_ends > n || (n_ends == n && !(ends & last_bit))) {
+                    break;
+                }
+                p += leb128_block_size;
+                n -= n_ends;
+            }
+#else
+            (void)p;
+            (void)limit;
+#endif
+            return n;
+        }
+
+        /// Skips the n uleb128 values without checking the range.
+        inline void skip_uleb128_batch(const uint8_t*& p, const uint8_t* limit,
+                                       size_t n)
+        {
+            n = skip_uleb128_blocks(p, limit, n);
+            for (; n != 0; --n) {
+                decode_uleb128(p);
+            }
+        }
+    }
+
+    /// An utility class for extracting values from a memory space that has
+    /// been validated.
+    ///
+    /// Unlike stream_reader, it never checks the range. Use it only for the
+    /// regions that have been read through stream_reader once with the range
+    /// checks (e.g., the debug_info_item).
+    class trusted_stream_reader {
+    public:
+        /// Creates a trusted_stream_reader instance.
+        ///
+        /// The memory before the limit may be read in blocks, but only the
+        /// validated values are decoded.
+        trusted_stream_reader(const void* head, const void* limit)
+                : head_ptr_(reinterpret_cast<const uint8_t*>(head)),
+                  limit_ptr_(reinterpret_cast<const uint8_t*>(limit))
+        {
+        }
+
+        /// Returns the head pointer.
+        const void* head() const
+        {
+            return head_ptr_;
+        }
+
+        /// Returns the reference to the value of specified type from the head.
+        ///
+        /// The head moves forward to point the next value as a result.
+        template <typename T>
+        const T& get()
+        {
+            const T& temp = *reinterpret_cast<const T*>(head_ptr_);
+            head_ptr_ += sizeof(T);
+            return temp;
+        }
+
+        /// Returns the uleb128 value from the current head.
+        ///
+        /// The head moves forward to point the next value as a result.
+        uint32_t get_uleb128()
+        {
+            return detail::decode_uleb128(head_ptr_);
+        }
+
+        /// Returns the sleb128 value from the current head.
+        ///
+        /// The head moves forward to point the next value as a result.
+        int32_t get_sleb128()
+        {
+            return detail::decode_sleb128(head_ptr_);
+        }
+
+        /// Returns the uleb128p1 value from the current head.
+        ///
+        /// The head moves forward to point the next value as a result.
+        uint32_t get_uleb128p1()
+        {
+            return get_uleb128() - 1;
+        }
+
+        /// Decodes the n uleb128 values from the current head.
+        ///
+        /// The head moves forward to point the next value as a result.
+        void get_uleb128_batch(uint32_t* out, size_t n)
+        {
+            detail::decode_uleb128_batch(head_ptr_, limit_ptr_, out, n);
+        }
+
+        /// Moves the head over the n uleb128 values.
+        void skip_uleb128(size_t n)
+        {
+            detail::skip_uleb128_batch(head_ptr_, limit_ptr_, n);
+        }
+
+    private:
+        /// The head pointer.
+        const uint8_t* head_ptr_;
+
+        /// The limit pointer.
+        const uint8_t* limit_ptr_;
+    };
+
     /// An utility class for extracting values with variable length types from a
     /// memory space.
     class stream_reader {
@@ -101,6 +403,11 @@ namespace jitana {
         /// The head moves forward to point the next value as a result.
         uint32_t get_uleb128() const
         {
+            // Check the range only once if the longest value fits.
+            if (head_ptr_ >= begin_ptr_ && end_ptr_ - head_ptr_ >= 5) {
+                return detail::decode_uleb128(head_ptr_);
+            }
+
             uint32_t decoded = 0;
 
             for (int i = 0; i < 5; ++i) {
@@ -123,6 +430,11 @@ namespace jitana {
         /// The head moves forward to point the next value as a result.
         int32_t get_sleb128() const
         {
+            // Check the range only once if the longest value fits.
+            if (head_ptr_ >= begin_ptr_ && end_ptr_ - head_ptr_ >= 5) {
+                return detail::decode_sleb128(head_ptr_);
+            }
+
             uint32_t decoded = 0;
 
             for (int i = 0; i < 5; ++i) {
@@ -155,6 +467,37 @@ namespace jitana {
             return get_uleb128() - 1;
         }
 
+        /// Moves the head over the n uleb128 values.
+        ///
+        /// Unlike get_uleb128(), it never reads beyond the end.
+        void skip_uleb128(uint64_t n) const
+        {
+            if (head_ptr_ >= begin_ptr_ && n <= SIZE_MAX) {
+                n = detail::skip_uleb128_blocks(head_ptr_, end_ptr_, n);
+            }
+            for (; n != 0; --n) {
+                for (int i = 0; i < 5; ++i) {
+                    validate_head(1);
+                    if (!(*head_ptr_++ & 0x80)) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        /// Decodes the n uleb128 values from the current head.
+        ///
+        /// The head moves forward to point the next value as a result.
+        void get_uleb128_batch(uint32_t* out, size_t n) const
+        {
+            if (head_ptr_ >= begin_ptr_) {
+                n = detail::decode_uleb128_blocks(head_ptr_, end_ptr_, out, n);
+            }
+            for (; n != 0; --n) {
+                *out++ = get_uleb128();
+            }
+        }
+
         /// Reads the array of bytes from the current head.
         ///
         /// The head moves forward to point the next value as a result.
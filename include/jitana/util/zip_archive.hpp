@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_ZIP_ARCHIVE_HPP
+#define JITANA_ZIP_ARCHIVE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+namespace boost {
+    namespace iostreams {
+        class mapped_file_source;
+    }
+}
+
+namespace jitana {
+    struct zip_archive_error : std::runtime_error {
+        using runtime_error::runtime_error;
+    };
+
+    /// An entry in the central directory of a ZIP archive.
+    struct zip_entry {
+        enum : uint16_t { stored = 0, deflated = 8 };
+
+        std::string name;
+        uint16_t flags;
+        uint16_t method;
+        uint32_t crc32;
+        uint32_t compressed_size;
+        uint32_t uncompressed_size;
+        uint32_t local_header_off;
+    };
+
+    /// The contents of a ZIP archive entry.
+    ///
+    /// The memory is valid as long as the owner is alive.
+    struct zip_entry_data {
+        const uint8_t* begin;
+        const uint8_t* end;
+        std::shared_ptr<const void> owner;
+    };
+
+    /// A read-only ZIP archive, such as an APK file.
+    ///
+    /// The archive is mapped into memory. The stored entries are read from the
+    /// mapping without copying, and the deflated entries are inflated into
+    /// memory buffers.
+    class zip_archive {
+    public:
+        /// Opens the archive and reads its central directory.
+        explicit zip_archive(std::string filename);
+
+        /// Returns true if the file starts with the ZIP signature.
+        static bool is_zip_file(const std::string& filename);
+
+        const std::string& filename() const
+        {
+            return filename_;
+        }
+
+        const std::vector<zip_entry>& entries() const
+        {
+            return entries_;
+        }
+
+        /// Returns the entry with the name, or nullptr if not found.
+        const zip_entry* find(boost::string_view name) const;
+
+        /// Reads the contents of the entry.
+        zip_entry_data read(const zip_entry& entry) const;
+
+    private:
+        void read_central_directory();
+
+        std::string filename_;
+        std::shared_ptr<boost::iostreams::mapped_file_source> file_;
+        const uint8_t* begin_;
+        const uint8_t* end_;
+        std::vector<zip_entry> entries_;
+    };
+}
+
+#endif
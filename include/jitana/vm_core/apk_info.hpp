@@ -17,10 +17,14 @@
 #ifndef JITANA_APK_INFO_HPP
 #define JITANA_APK_INFO_HPP
 
+#include <sstream>
+#include <string>
+
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
 #include "jitana/util/axml_parser.hpp"
+#include "jitana/util/zip_archive.hpp"
 
 namespace jitana {
     class apk_info {
@@ -33,23 +37,8 @@ namespace jitana {
 
             // Load the manifest file into a property tree.
             bpt::ptree pt;
-            try {
-                try {
-                    // First, try to read as a binary XML file.
-                    jitana::read_axml(xml_filename, pt);
-                }
-                catch (const jitana::axml_parser_magic_mismatched& e) {
-                    // Binary parser has faied: try to read it as a normal XML
-                    // file.
-                    bpt::read_xml(xml_filename, pt);
-                }
-            }
-            catch (const jitana::axml_parser_error& e) {
-                std::cerr << "binary parser failed: " << e.what() << "\n";
-            }
-            catch (const bpt::xml_parser::xml_parser_error& e) {
-                std::cerr << "XML parser failed: " << e.what() << "\n";
-            }
+            read_manifest([&] { jitana::read_axml(xml_filename, pt); },
+                          [&] { bpt::read_xml(xml_filename, pt); });
             manifest_pt_ = pt.get_child("manifest");
 
             // Write the property tree to a XML file.
@@ -58,6 +47,29 @@ namespace jitana {
                       std::locale(), settings);
         }
 
+        /// Reads the manifest file in the APK archive.
+        explicit apk_info(const zip_archive& apk)
+        {
+            namespace bpt = boost::property_tree;
+
+            const auto* entry = apk.find("AndroidManifest.xml");
+            if (!entry) {
+                throw zip_archive_error(apk.filename()
+                                        + ": AndroidManifest.xml is not found");
+            }
+            const auto data = apk.read(*entry);
+
+            // Load the manifest file into a property tree.
+            bpt::ptree pt;
+            read_manifest([&] { jitana::read_axml(data.begin, data.end, pt); },
+                          [&] {
+                              std::istringstream is(
+                                      std::string(data.begin, data.end));
+                              bpt::read_xml(is, pt);
+                          });
+            manifest_pt_ = pt.get_child("manifest");
+        }
+
         std::string package_name() const
         {
             return manifest_pt_.get<std::string>("<xmlattr>.package");
@@ -69,6 +81,30 @@ namespace jitana {
         }
 
     private:
+        template <typename ReadBinary, typename ReadText>
+        static void read_manifest(ReadBinary read_binary, ReadText read_text)
+        {
+            namespace bpt = boost::property_tree;
+
+            try {
+                try {
+                    // First, try to read as a binary XML file.
+                    read_binary();
+                }
+                catch (const jitana::axml_parser_magic_mismatched& e) {
+                    // Binary parser has faied: try to read it as a normal XML
+                    // file.
+                    read_text();
+                }
+            }
+            catch (const jitana::axml_parser_error& e) {
+                std::cerr << "binary parser failed: " << e.what() << "\n";
+            }
+            catch (const bpt::xml_parser::xml_parser_error& e) {
+                std::cerr << "XML parser failed: " << e.what() << "\n";
+            }
+        }
+
         std::string apk_dir_;
         boost::property_tree::ptree manifest_pt_;
     };
@@ -33,6 +33,18 @@ namespace jitana {
 }
 
 namespace jitana {
+    /// The level of details loaded from the DEX files.
+    enum class load_level : uint8_t {
+        /// The class hierarchy, the fields, and the method signatures. The
+        /// methods have empty instruction graphs.
+        signatures,
+        /// The instructions without the debug information (the line numbers
+        /// and the parameter names).
+        code,
+        /// Everything.
+        full
+    };
+
     class class_loader {
     public:
         class_loader()
@@ -41,16 +53,24 @@ namespace jitana {
 
         template <typename I>
         class_loader(const class_loader_hdl& hdl, std::string name,
-                     I filenames_first, I filenames_last)
+                     I filenames_first, I filenames_last,
+                     load_level level = load_level::full)
                 : hdl_(hdl),
                   name_(std::move(name)),
                   impl_(std::make_shared<impl>(hdl, filenames_first,
-                                               filenames_last))
+                                               filenames_last, level))
         {
         }
 
         dex_file_hdl add_file(const std::string& filename);
 
+        /// Adds the DEX file in the memory. The memory is kept alive by the
+        /// owner.
+        dex_file_hdl add_file(const std::string& filename,
+                              const uint8_t* file_begin,
+                              const uint8_t* file_end,
+                              std::shared_ptr<const void> owner);
+
         const class_loader_hdl& hdl() const
         {
             return hdl_;
@@ -61,6 +81,12 @@ namespace jitana {
             return name_;
         }
 
+        /// Returns the level of details loaded from the DEX files.
+        load_level level() const
+        {
+            return impl_->level;
+        }
+
         const std::vector<dex_file>& dex_files() const
         {
             return impl_->dex_files;
@@ -68,21 +94,27 @@ namespace jitana {
 
         /// Loads a class with the specified descriptor.
         boost::optional<class_vertex_descriptor>
-        load_class(virtual_machine& vm, const std::string& descriptor) const;
+        load_class(virtual_machine& vm, boost::string_view descriptor) const;
 
         boost::optional<class_vertex_descriptor>
-        lookup_class(virtual_machine& vm, const std::string& descriptor) const;
+        lookup_class(const virtual_machine& vm,
+                     boost::string_view descriptor) const;
 
         boost::optional<method_vertex_descriptor>
-        lookup_method(virtual_machine& vm, const std::string& descriptor,
-                      const std::string& unique_name) const;
+        lookup_method(const virtual_machine& vm,
+                      boost::string_view descriptor,
+                      boost::string_view unique_name) const;
 
         boost::optional<field_vertex_descriptor>
-        lookup_field(virtual_machine& vm, const std::string& descriptor,
-                     const std::string& name) const;
+        lookup_field(const virtual_machine& vm, boost::string_view descriptor,
+                     boost::string_view name) const;
 
         bool load_all_classes(virtual_machine& vm) const;
 
+        /// Loads all the classes decoding their bodies with num_threads
+        /// threads (0 for the hardware concurrency).
+        bool load_all_classes(virtual_machine& vm, unsigned num_threads) const;
+
         std::string descriptor(const dex_type_hdl& hdl) const;
 
         std::string class_descriptor(const dex_method_hdl& hdl) const;
@@ -98,18 +130,22 @@ namespace jitana {
         std::string name_;
         struct impl {
             std::vector<dex_file> dex_files;
+            load_level level;
 
             template <typename I>
-            impl(class_loader_hdl hdl, I filenames_first, I filenames_last)
+            impl(class_loader_hdl hdl, I filenames_first, I filenames_last,
+                 load_level level)
+                    : level(level)
             {
-                dex_file_hdl file_hdl;
-                file_hdl.loader_hdl = hdl;
                 std::for_each(filenames_first, filenames_last,
                               [&](const auto& s) {
-                                  file_hdl.idx = uint8_t(dex_files.size());
-                                  dex_files.emplace_back(file_hdl, s);
+                                  dex_files.emplace_back(next_file_hdl(hdl),
+                                                         s, level);
                               });
             }
+
+            /// Returns the handle for the DEX file to be added.
+            dex_file_hdl next_file_hdl(const class_loader_hdl& hdl) const;
         };
         std::shared_ptr<impl> impl_;
     };
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_COMPACT_INSN_HPP
+#define JITANA_COMPACT_INSN_HPP
+
+#include "jitana/vm_core/insn.hpp"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/mpl/at.hpp>
+#include <boost/mpl/distance.hpp>
+#include <boost/mpl/find.hpp>
+#include <boost/mpl/begin_end.hpp>
+#include <boost/mpl/size.hpp>
+
+namespace jitana {
+    /// A fixed-size encoding of an instruction.
+    ///
+    /// Unlike jitana::insn, it never owns memory on the heap. Each register is
+    /// packed into 16 bits, and the constant value is packed into the 32-bit
+    /// operand: a handle into the DEX file or a literal. The 64-bit literals,
+    /// the strings and the array data do not fit, so they are kept in
+    /// compact_insn_operands and the operand is the index to them. The DEX
+    /// file handles are kept there as well.
+    ///
+    /// Use decode_insn() to get the rich representation.
+    struct compact_insn {
+        opcode op;
+        /// The index of the alternative of jitana::insn.
+        uint8_t kind;
+        std::array<uint16_t, 5> regs;
+        uint32_t operand;
+    };
+    static_assert(sizeof(compact_insn) == 16, "");
+
+    /// The constant values that do not fit in compact instructions.
+    struct compact_insn_operands {
+        std::vector<int64_t> wide_consts;
+        std::vector<dex_string_ref> strings;
+        std::vector<array_payload> array_payloads;
+        std::vector<dex_file_hdl> file_hdls;
+    };
+
+    namespace detail {
+        template <typename T>
+        struct type_tag {
+        };
+
+        constexpr size_t insn_kinds_size = boost::mpl::size<insn::types>::value;
+
+        template <size_t Kind>
+        using insn_kind_type =
+                typename boost::mpl::at_c<insn::types, Kind>::type;
+
+        template <typename T>
+        constexpr uint8_t insn_kind()
+        {
+            using types = insn::types;
+            return boost::mpl::distance<
+                    typename boost::mpl::begin<types>::type,
+                    typename boost::mpl::find<types, T>::type>::value;
+        }
+
+        inline uint16_t pack_register(register_idx r)
+        {
+            // The special registers (negative) are packed into the top of
+            // the range.
+            if (r.value < register_idx::idx_exception || r.value >= 0xfffd) {
+                std::stringstream ss;
+                ss << "register cannot be packed: " << r.value;
+                throw std::runtime_error(ss.str());
+            }
+            return static_cast<uint16_t>(r.value);
+        }
+
+        inline register_idx unpack_register(uint16_t x)
+        {
+            return x >= 0xfffd ? int32_t(x) - 0x10000 : int32_t(x);
+        }
+
+        /// Makes the constant values of the compact instructions.
+        class compact_insn_encoder : public boost::static_visitor<uint32_t> {
+        public:
+            explicit compact_insn_encoder(compact_insn_operands& operands)
+                    : operands_(operands)
+            {
+            }
+
+            template <typename T>
+            uint32_t operator()(const T& x) const
+            {
+                return encode(x.const_val);
+            }
+
+        private:
+            uint32_t encode(const boost::blank&) const
+            {
+                return 0;
+            }
+
+            uint32_t encode(int32_t x) const
+            {
+                return static_cast<uint32_t>(x);
+            }
+
+            uint32_t encode(int64_t x) const
+            {
+                operands_.wide_consts.push_back(x);
+                return operands_.wide_consts.size() - 1;
+            }
+
+            uint32_t encode(const dex_string_ref& x) const
+            {
+                operands_.strings.push_back(x);
+                return operands_.strings.size() - 1;
+            }
+
+            uint32_t encode(const dex_type_hdl& x) const
+            {
+                return encode_hdl(x.file_hdl, x.idx);
+            }
+
+            uint32_t encode(const dex_field_hdl& x) const
+            {
+                return encode_hdl(x.file_hdl, x.idx);
+            }
+
+            uint32_t encode(const dex_method_hdl& x) const
+            {
+                return encode_hdl(x.file_hdl, x.idx);
+            }
+
+            uint32_t encode(const array_payload& x) const
+            {
+                operands_.array_payloads.push_back(x);
+                return operands_.array_payloads.size() - 1;
+            }
+
+            uint32_t encode(uint16_t x) const
+            {
+                return x;
+            }
+
+            uint32_t encode(int16_t x) const
+            {
+                return static_cast<uint16_t>(x);
+            }
+
+            /// Packs the index into the lower 16 bits, which is enough for
+            /// the instruction formats, and the position of the DEX file
+            /// handle in the operands into the upper 16 bits.
+            uint32_t encode_hdl(const dex_file_hdl& file_hdl,
+                                uint32_t idx) const
+            {
+                auto& fhs = operands_.file_hdls;
+                auto it = std::find(begin(fhs), end(fhs), file_hdl);
+                auto pos = it - begin(fhs);
+                if (idx > 0xffff || pos > 0xffff) {
+                    std::stringstream ss;
+                    ss << "handle cannot be packed: " << file_hdl << "_"
+                       << idx;
+                    throw std::runtime_error(ss.str());
+                }
+                if (it == end(fhs)) {
+                    fhs.push_back(file_hdl);
+                }
+                return static_cast<uint32_t>(pos) << 16 | idx;
+            }
+
+            compact_insn_operands& operands_;
+        };
+
+        /// Makes the constant values of the rich instructions.
+        class compact_insn_decoder {
+        public:
+            explicit compact_insn_decoder(
+                    const compact_insn_operands& operands)
+                    : operands_(operands)
+            {
+            }
+
+            boost::blank operator()(uint32_t, type_tag<boost::blank>) const
+            {
+                return {};
+            }
+
+            int32_t operator()(uint32_t x, type_tag<int32_t>) const
+            {
+                return static_cast<int32_t>(x);
+            }
+
+            int64_t operator()(uint32_t x, type_tag<int64_t>) const
+            {
+                return operands_.wide_consts.at(x);
+            }
+
+            dex_string_ref operator()(uint32_t x,
+                                      type_tag<dex_string_ref>) const
+            {
+                return operands_.strings.at(x);
+            }
+
+            dex_type_hdl operator()(uint32_t x, type_tag<dex_type_hdl>) const
+            {
+                return {unpack_file_hdl(x), x & 0xffff};
+            }
+
+            dex_field_hdl operator()(uint32_t x, type_tag<dex_field_hdl>) const
+            {
+                return {unpack_file_hdl(x), x & 0xffff};
+            }
+
+            dex_method_hdl operator()(uint32_t x,
+                                      type_tag<dex_method_hdl>) const
+            {
+                return {unpack_file_hdl(x), x & 0xffff};
+            }
+
+            array_payload operator()(uint32_t x, type_tag<array_payload>) const
+            {
+                return operands_.array_payloads.at(x);
+            }
+
+            uint16_t operator()(uint32_t x, type_tag<uint16_t>) const
+            {
+                return static_cast<uint16_t>(x);
+            }
+
+            int16_t operator()(uint32_t x, type_tag<int16_t>) const
+            {
+                return static_cast<int16_t>(x);
+            }
+
+        private:
+            dex_file_hdl unpack_file_hdl(uint32_t x) const
+            {
+                return operands_.file_hdls.at(x >> 16);
+            }
+
+            const compact_insn_operands& operands_;
+        };
+
+        /// Leaves the constant values default constructed, which is enough
+        /// for looking at the registers.
+        struct compact_insn_regs_decoder {
+            template <typename T>
+            T operator()(uint32_t, type_tag<T>) const
+            {
+                return T();
+            }
+        };
+
+        template <typename R, typename T, typename Decoder, typename F>
+        R apply_compact_insn_kind(const compact_insn& x, const Decoder& dec,
+                                  F& f)
+        {
+            using const_val_type = decltype(std::declval<T>().const_val);
+
+            typename T::reg_array_type regs;
+            for (size_t i = 0; i < regs.size(); ++i) {
+                regs[i] = unpack_register(x.regs[i]);
+            }
+            return f(T(x.op, regs,
+                       dec(x.operand, type_tag<const_val_type>())));
+        }
+
+        template <typename R, typename Decoder, typename F, size_t... Kinds>
+        R apply_compact_insn(const compact_insn& x, const Decoder& dec, F& f,
+                             std::index_sequence<Kinds...>)
+        {
+            using func_type
+                    = R (*)(const compact_insn&, const Decoder&, F&);
+            static constexpr func_type funcs[] = {
+                    &apply_compact_insn_kind<R, insn_kind_type<Kinds>, Decoder,
+                                             F>...};
+            return funcs[x.kind](x, dec, f);
+        }
+
+        /// Calls f with the rich instruction of the compact instruction.
+        template <typename R, typename Decoder, typename F>
+        R apply_compact_insn(const compact_insn& x, const Decoder& dec, F f)
+        {
+            return apply_compact_insn<R>(
+                    x, dec, f, std::make_index_sequence<insn_kinds_size>());
+        }
+    }
+
+    /// Makes the compact instruction of the instruction.
+    ///
+    /// The constant values that do not fit are appended to the operands.
+    inline compact_insn make_compact_insn(const insn& x,
+                                          compact_insn_operands& operands)
+    {
+        compact_insn result;
+        result.op = op(x);
+        result.kind = static_cast<uint8_t>(x.which());
+        result.regs.fill(detail::pack_register(register_idx::idx_unknown));
+        const auto& rs = regs(x);
+        std::transform(rs.begin(), rs.end(), result.regs.begin(),
+                       detail::pack_register);
+        result.operand = boost::apply_visitor(
+                detail::compact_insn_encoder(operands), x);
+        return result;
+    }
+
+    /// Decodes the compact instruction.
+    inline insn decode_insn(const compact_insn& x,
+                            const compact_insn_operands& operands)
+    {
+        return detail::apply_compact_insn<insn>(
+                x, detail::compact_insn_decoder(operands),
+                [](const auto& y) { return insn(y); });
+    }
+
+    inline opcode op(const compact_insn& x)
+    {
+        return x.op;
+    }
+
+    inline std::vector<register_idx> regs_vec(const compact_insn& x)
+    {
+        return detail::apply_compact_insn<std::vector<register_idx>>(
+                x, detail::compact_insn_regs_decoder(),
+                [](const auto& y) { return regs_vec(y); });
+    }
+
+    inline std::vector<register_idx> defs(const compact_insn& x)
+    {
+        return detail::apply_compact_insn<std::vector<register_idx>>(
+                x, detail::compact_insn_regs_decoder(),
+                [](const auto& y) { return defs(y); });
+    }
+
+    inline std::vector<register_idx> uses(const compact_insn& x)
+    {
+        return detail::apply_compact_insn<std::vector<register_idx>>(
+                x, detail::compact_insn_regs_decoder(),
+                [](const auto& y) { return uses(y); });
+    }
+
+    inline bool is_pseudo(const compact_insn& x)
+    {
+        return x.kind == detail::insn_kind<insn_entry>()
+                || x.kind == detail::insn_kind<insn_exit>();
+    }
+}
+
+#endif
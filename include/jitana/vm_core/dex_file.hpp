@@ -19,9 +19,11 @@
 
 #include "jitana/vm_core/virtual_machine.hpp"
 #include "jitana/vm_core/dex_raw_types.hpp"
+#include "jitana/vm_core/dex_index.hpp"
 #include "jitana/util/stream_reader.hpp"
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <cassert>
 #include <unordered_map>
@@ -67,9 +69,17 @@ namespace jitana {
 
         const char* c_str(const dex_string_idx& idx) const
         {
-            reader_.move_head((*this)[idx].string_data_off());
-            reader_.get_uleb128p1();
-            return reader_.get_c_str();
+            // Use a local copy of the reader so that the string can be looked
+            // up from multiple threads.
+            if (string_data_offs_) {
+                const auto* begin = static_cast<const char*>(reader_.begin());
+                return begin + string_data_offs_[idx.value];
+            }
+
+            auto r = reader_;
+            r.move_head((*this)[idx].string_data_off());
+            r.get_uleb128p1();
+            return r.get_c_str();
         }
 
         const char* descriptor(const dex_type_idx& idx) const
@@ -174,16 +184,22 @@ namespace jitana {
         boost::iterator_range<const dex_field_id*> field_ids_;
         boost::iterator_range<const dex_method_id*> method_ids_;
         stream_reader reader_;
+        const uint32_t* string_data_offs_ = nullptr;
     };
 
     class dex_file {
     public:
         /// Creates a DexFile instance from a memory-mapped file.
+        ///
+        /// The memory is kept alive by the owner if specified.
         explicit dex_file(dex_file_hdl hdl, std::string filename,
-                          const uint8_t* file_begin, const uint8_t* file_end);
+                          const uint8_t* file_begin, const uint8_t* file_end,
+                          std::shared_ptr<const void> owner = nullptr,
+                          load_level level = load_level::full);
 
         /// Creates a DexFile instance by opening a file.
-        explicit dex_file(dex_file_hdl hdl, std::string filename);
+        explicit dex_file(dex_file_hdl hdl, std::string filename,
+                          load_level level = load_level::full);
 
         dex_file(dex_file&& x) = default;
 
@@ -204,42 +220,105 @@ namespace jitana {
             return ids_;
         }
 
+        /// Returns the level of details loaded from the DEX file.
+        load_level level() const
+        {
+            return level_;
+        }
+
+        const detail::dex_header& header() const
+        {
+            return *header_;
+        }
+
         boost::optional<class_vertex_descriptor>
-        load_class(virtual_machine& vm, const std::string& descriptor) const;
+        load_class(virtual_machine& vm, boost::string_view descriptor) const;
 
         boost::optional<std::pair<dex_method_hdl, uint32_t>>
         find_method_hdl(uint32_t dex_off) const;
 
+        /// Returns the instruction graph of the method built from the code
+        /// item when it is accessed first.
+        lazy_insn_graph make_lazy_insn_graph(uint32_t code_off,
+                                             const dex_method_hdl& hdl) const
+        {
+            return lazy_insn_graph(insn_source_, code_off, hdl);
+        }
+
         bool load_all_classes(virtual_machine& vm) const;
 
+        /// Saves the lookup index to the sidecar file so that opening the DEX
+        /// file next time does not need to scan it.
+        void save_index() const;
+
+        /// Saves the lookup index to the file.
+        void save_index(const std::string& filename) const;
+
+        /// Loads all the classes in the DEX files.
+        ///
+        /// The class bodies are decoded concurrently using num_threads
+        /// threads (0 for the hardware concurrency), and then linked into the
+        /// virtual machine in the same order as load_all_classes(vm) so that
+        /// the vertex numbering does not depend on the number of threads.
+        static bool load_all_classes(virtual_machine& vm,
+                                     const std::vector<const dex_file*>& files,
+                                     unsigned num_threads);
+
     private:
+        struct class_body;
+        class insn_source;
+
         void load_dex_file();
+        dex_index build_index() const;
+        const detail::dex_class_def*
+        find_class_def(boost::string_view descriptor) const;
 
-        insn_graph make_insn_graph(method_vertex_property& mvprop,
-                                   uint32_t code_off,
-                                   const dex_method_hdl& dex_m_hdl,
-                                   const jvm_method_hdl& jvm_m_hdl) const;
-        void parse_debug_info(insn_graph& g, method_vertex_property& mvprop,
-                              uint32_t debug_info_off) const;
+        class_body decode_class_body(const detail::dex_class_def& def,
+                                     bool materialize_insns) const;
+
+        insn_graph make_insn_graph(uint32_t code_off,
+                                   const dex_method_hdl& dex_m_hdl) const;
+        void parse_param_names(method_vertex_property& mvprop,
+                               uint32_t code_off) const;
+        void parse_debug_info(insn_graph& g, uint32_t debug_info_off) const;
 
         struct mapped_file {
             boost::iostreams::mapped_file_source file;
+            std::shared_ptr<const void> owner;
             const uint8_t* begin;
             const uint8_t* end;
             std::string name;
         };
 
         const dex_file_hdl hdl_;
+        load_level level_;
         std::shared_ptr<mapped_file> file_;
         const uint8_t* dex_begin_;
         const detail::dex_opt_header* opt_header_;
         const detail::dex_header* header_;
         dex_ids ids_;
         boost::iterator_range<const detail::dex_class_def*> class_defs_;
-        std::unordered_map<std::string, const detail::dex_class_def*>
-                class_def_lut_;
-        std::vector<std::pair<uint32_t, dex_method_idx>> code_off_lut_;
+        dex_index index_;
+        std::shared_ptr<std::vector<std::unique_ptr<class_body>>>
+                decoded_bodies_;
+        std::shared_ptr<const insn_graph_source> insn_source_;
     };
+
+    namespace detail {
+        /// Decodes the members of the class_data_item after the sizes.
+        ///
+        /// Throws if the item is too short for the sizes before allocating
+        /// the buffer of the values.
+        void get_class_data_values(const stream_reader& reader,
+                                   uint64_t fields_size, uint64_t methods_size,
+                                   std::vector<uint32_t>& values);
+
+        /// Validates the debug_info_item from the head, and returns the
+        /// reader of it that skips the range checks.
+        ///
+        /// Throws if the item runs past the end of the reader.
+        trusted_stream_reader validate_debug_info(const stream_reader& reader);
+    }
 }
 
 #endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_DEX_INDEX_HPP
+#define JITANA_DEX_INDEX_HPP
+
+#include "jitana/vm_core/dex_raw_types.hpp"
+#include "jitana/vm_core/idx.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <boost/optional.hpp>
+#include <boost/range/iterator_range.hpp>
+
+namespace jitana {
+    namespace detail {
+        struct dex_index_header {
+            uint8_t magic[8];
+            uint8_t signature[20];
+            uint32_t dex_file_size;
+            uint32_t class_defs_size;
+            uint32_t string_ids_size;
+            uint32_t buckets_size;
+            uint32_t buckets_off;
+            uint32_t code_offs_size;
+            uint32_t code_offs_off;
+            uint32_t string_data_offs_size;
+            uint32_t string_data_offs_off;
+        };
+        static_assert(std::is_pod<dex_index_header>::value, "");
+        static_assert(sizeof(dex_index_header) == 64, "");
+
+        /// A bucket of the class descriptor hash table.
+        struct dex_index_bucket {
+            uint32_t hash;
+            /// The index of the class definition, or empty_bucket.
+            uint32_t class_def_idx;
+
+            enum : uint32_t { empty_bucket = 0xffffffff };
+        };
+        static_assert(std::is_pod<dex_index_bucket>::value, "");
+
+        /// An entry of the code offset table.
+        struct dex_code_off_entry {
+            uint32_t code_off;
+            /// The size of the instructions in 16-bit code units.
+            uint32_t insns_size;
+            dex_method_idx method_idx;
+        };
+        static_assert(std::is_pod<dex_code_off_entry>::value, "");
+    }
+
+    /// A lookup index of a DEX file.
+    ///
+    /// The index consists of the hash table of the class descriptors, the
+    /// table of the code items sorted by the offset, and optionally the
+    /// offsets of the string characters. It can be saved to a sidecar file
+    /// and mapped into memory instead of scanning the DEX file again. The
+    /// sidecar file is only used if it was made from a DEX file with the same
+    /// signature.
+    class dex_index {
+    public:
+        /// Creates an empty index.
+        dex_index();
+
+        /// Creates an index from the tables.
+        dex_index(std::vector<detail::dex_index_bucket> buckets,
+                  std::vector<detail::dex_code_off_entry> code_offs,
+                  std::vector<uint32_t> string_data_offs);
+
+        /// Opens the sidecar index file of the DEX file mapped at
+        /// [dex_begin, dex_end).
+        ///
+        /// Returns boost::none if the file does not exist, if it does not
+        /// match the DEX file, or if any of its entries is out of range.
+        static boost::optional<dex_index> open(const std::string& filename,
+                                               const uint8_t* dex_begin,
+                                               const uint8_t* dex_end);
+
+        /// Saves the index to the file.
+        void save(const std::string& filename,
+                  const detail::dex_header& header) const;
+
+        /// Returns the name of the sidecar index file of the DEX file.
+        static std::string sidecar_filename(const std::string& dex_filename)
+        {
+            return dex_filename + ".jidx";
+        }
+
+        /// Returns the hash value of the class descriptor.
+        static uint32_t hash(const char* first, const char* last)
+        {
+            // FNV-1a. It must not change since the value is stored in the
+            // index files.
+            uint32_t h = 2166136261u;
+            for (; first != last; ++first) {
+                h ^= static_cast<uint8_t>(*first);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        /// Returns the number of the buckets for the number of the classes.
+        static size_t buckets_size_for(size_t n)
+        {
+            // Keep the load factor at or below 0.5.
+            size_t size = 1;
+            while (size < 2 * n) {
+                size *= 2;
+            }
+            return size;
+        }
+
+        /// Returns the hash table of the class descriptors.
+        ///
+        /// The size is a power of two, and the collisions are resolved by
+        /// linear probing.
+        boost::iterator_range<const detail::dex_index_bucket*> buckets() const
+        {
+            return buckets_;
+        }
+
+        /// Returns the code items sorted by the offset.
+        boost::iterator_range<const detail::dex_code_off_entry*>
+        code_offs() const
+        {
+            return code_offs_;
+        }
+
+        /// Returns the offsets of the characters of the strings, or an empty
+        /// range if the index does not have them.
+        boost::iterator_range<const uint32_t*> string_data_offs() const
+        {
+            return string_data_offs_;
+        }
+
+    private:
+        struct storage;
+
+        std::shared_ptr<const storage> storage_;
+        boost::iterator_range<const detail::dex_index_bucket*> buckets_;
+        boost::iterator_range<const detail::dex_code_off_entry*> code_offs_;
+        boost::iterator_range<const uint32_t*> string_data_offs_;
+    };
+}
+
+#endif
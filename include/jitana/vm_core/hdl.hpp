@@ -18,29 +18,36 @@
 #define JITANA_HANDLE_HPP
 
 #include "jitana/vm_core/idx.hpp"
+#include "jitana/vm_core/symbol.hpp"
 
 #include <iostream>
 #include <cstdint>
 #include <boost/variant.hpp>
 
 namespace jitana {
+    // The DEX handles are packed into 64-bit integers for hashing and
+    // ordering: 20 bits for the class loader, 12 bits for the DEX file, and
+    // 32 bits for the index in the DEX file.
+
+    /// The number of bits of the class loader handle in the packed handles.
+    constexpr unsigned class_loader_hdl_bits = 20;
+
+    /// The number of bits of the DEX file index in the packed handles.
+    constexpr unsigned dex_file_idx_bits = 12;
+
+    /// A handle to a class loader.
     struct class_loader_hdl {
-        uint8_t idx;
+        uint32_t idx;
 
         class_loader_hdl()
         {
         }
 
-        class_loader_hdl(uint8_t idx) : idx(idx)
-        {
-        }
-
-        explicit operator uint8_t() const
+        class_loader_hdl(uint32_t idx) : idx(idx)
         {
-            return idx;
         }
 
-        explicit operator unsigned() const
+        explicit operator uint32_t() const
         {
             return idx;
         }
@@ -71,19 +78,19 @@ namespace jitana {
 
         friend size_t hash_value(const class_loader_hdl& hdl)
         {
-            return static_cast<uint8_t>(hdl);
+            return static_cast<uint32_t>(hdl);
         }
     };
 
     /// A handle to a DEX file.
     struct dex_file_hdl {
         class_loader_hdl loader_hdl;
-        uint8_t idx;
+        uint16_t idx;
 
-        explicit operator uint16_t() const
+        explicit operator uint32_t() const
         {
-            auto lh = static_cast<uint8_t>(loader_hdl);
-            return static_cast<uint16_t>(lh) << 8 | idx;
+            auto lh = static_cast<uint32_t>(loader_hdl);
+            return lh << dex_file_idx_bits | idx;
         }
 
         friend bool operator==(const dex_file_hdl& x, const dex_file_hdl& y)
@@ -98,7 +105,7 @@ namespace jitana {
 
         friend bool operator<(const dex_file_hdl& x, const dex_file_hdl& y)
         {
-            return x.loader_hdl < y.loader_hdl && x.idx < y.idx;
+            return static_cast<uint32_t>(x) < static_cast<uint32_t>(y);
         }
 
         friend bool operator>(const dex_file_hdl& x, const dex_file_hdl& y)
@@ -123,27 +130,27 @@ namespace jitana {
 
         friend size_t hash_value(const dex_file_hdl& hdl)
         {
-            return static_cast<uint16_t>(hdl);
+            return static_cast<uint32_t>(hdl);
         }
     };
 
     struct dex_type_hdl {
         dex_file_hdl file_hdl;
-        uint16_t idx;
+        uint32_t idx;
 
         dex_type_hdl()
         {
         }
 
-        dex_type_hdl(const dex_file_hdl& file_hdl, uint16_t idx)
+        dex_type_hdl(const dex_file_hdl& file_hdl, uint32_t idx)
                 : file_hdl(file_hdl), idx(idx)
         {
         }
 
-        explicit operator uint32_t() const
+        explicit operator uint64_t() const
         {
-            auto fh = static_cast<uint16_t>(file_hdl);
-            return static_cast<uint32_t>(fh) << 16 | idx;
+            auto fh = static_cast<uint32_t>(file_hdl);
+            return static_cast<uint64_t>(fh) << 32 | idx;
         }
 
         friend bool operator==(const dex_type_hdl& x, const dex_type_hdl& y)
@@ -158,7 +165,7 @@ namespace jitana {
 
         friend bool operator<(const dex_type_hdl& x, const dex_type_hdl& y)
         {
-            return x.file_hdl < y.file_hdl && x.idx < y.idx;
+            return static_cast<uint64_t>(x) < static_cast<uint64_t>(y);
         }
 
         friend bool operator>(const dex_type_hdl& x, const dex_type_hdl& y)
@@ -183,27 +190,27 @@ namespace jitana {
 
         friend size_t hash_value(const dex_type_hdl& hdl)
         {
-            return static_cast<uint32_t>(hdl);
+            return static_cast<uint64_t>(hdl);
         }
     };
 
     struct dex_method_hdl {
         dex_file_hdl file_hdl;
-        uint16_t idx;
+        uint32_t idx;
 
         dex_method_hdl()
         {
         }
 
-        dex_method_hdl(const dex_file_hdl& file_hdl, uint16_t idx)
+        dex_method_hdl(const dex_file_hdl& file_hdl, uint32_t idx)
                 : file_hdl(file_hdl), idx(idx)
         {
         }
 
-        explicit operator uint32_t() const
+        explicit operator uint64_t() const
         {
-            auto fh = static_cast<uint16_t>(file_hdl);
-            return static_cast<uint32_t>(fh) << 16 | idx;
+            auto fh = static_cast<uint32_t>(file_hdl);
+            return static_cast<uint64_t>(fh) << 32 | idx;
         }
 
         friend bool operator==(const dex_method_hdl& x, const dex_method_hdl& y)
@@ -218,7 +225,7 @@ namespace jitana {
 
         friend bool operator<(const dex_method_hdl& x, const dex_method_hdl& y)
         {
-            return x.file_hdl < y.file_hdl && x.idx < y.idx;
+            return static_cast<uint64_t>(x) < static_cast<uint64_t>(y);
         }
 
         friend bool operator>(const dex_method_hdl& x, const dex_method_hdl& y)
@@ -244,27 +251,27 @@ namespace jitana {
 
         friend size_t hash_value(const dex_method_hdl& hdl)
         {
-            return static_cast<uint32_t>(hdl);
+            return static_cast<uint64_t>(hdl);
         }
     };
 
     struct dex_field_hdl {
         dex_file_hdl file_hdl;
-        uint16_t idx;
+        uint32_t idx;
 
         dex_field_hdl()
         {
         }
 
-        dex_field_hdl(const dex_file_hdl& file_hdl, uint16_t idx)
+        dex_field_hdl(const dex_file_hdl& file_hdl, uint32_t idx)
                 : file_hdl(file_hdl), idx(idx)
         {
         }
 
-        explicit operator uint32_t() const
+        explicit operator uint64_t() const
         {
-            auto fh = static_cast<uint16_t>(file_hdl);
-            return static_cast<uint32_t>(fh) << 16 | idx;
+            auto fh = static_cast<uint32_t>(file_hdl);
+            return static_cast<uint64_t>(fh) << 32 | idx;
         }
 
         friend bool operator==(const dex_field_hdl& x, const dex_field_hdl& y)
@@ -279,7 +286,7 @@ namespace jitana {
 
         friend bool operator<(const dex_field_hdl& x, const dex_field_hdl& y)
         {
-            return x.file_hdl < y.file_hdl && x.idx < y.idx;
+            return static_cast<uint64_t>(x) < static_cast<uint64_t>(y);
         }
 
         friend bool operator>(const dex_field_hdl& x, const dex_field_hdl& y)
@@ -305,7 +312,7 @@ namespace jitana {
 
         friend size_t hash_value(const dex_field_hdl& hdl)
         {
-            return static_cast<uint32_t>(hdl);
+            return static_cast<uint64_t>(hdl);
         }
     };
 
@@ -322,12 +329,6 @@ namespace jitana {
         {
         }
 
-        explicit operator uint64_t() const
-        {
-            auto mh = static_cast<uint32_t>(method_hdl);
-            return static_cast<uint64_t>(mh) << 16 | idx;
-        }
-
         friend bool operator==(const dex_insn_hdl& x, const dex_insn_hdl& y)
         {
             return x.method_hdl == y.method_hdl && x.idx == y.idx;
@@ -340,7 +341,8 @@ namespace jitana {
 
         friend bool operator<(const dex_insn_hdl& x, const dex_insn_hdl& y)
         {
-            return x.method_hdl < y.method_hdl && x.idx < y.idx;
+            return (x.method_hdl != y.method_hdl) ? x.method_hdl < y.method_hdl
+                                                  : x.idx < y.idx;
         }
 
         friend bool operator>(const dex_insn_hdl& x, const dex_insn_hdl& y)
@@ -365,7 +367,9 @@ namespace jitana {
 
         friend size_t hash_value(const dex_insn_hdl& hdl)
         {
-            return static_cast<uint64_t>(hdl);
+            size_t seed = hash_value(hdl.method_hdl);
+            boost::hash_combine(seed, hdl.idx);
+            return seed;
         }
     };
 
@@ -382,11 +386,6 @@ namespace jitana {
         {
         }
 
-        explicit operator uint64_t() const
-        {
-            return static_cast<uint64_t>(insn_hdl) << 32 | idx;
-        }
-
         friend bool operator==(const dex_reg_hdl& x, const dex_reg_hdl& y)
         {
             return x.insn_hdl == y.insn_hdl && x.idx == y.idx;
@@ -399,7 +398,8 @@ namespace jitana {
 
         friend bool operator<(const dex_reg_hdl& x, const dex_reg_hdl& y)
         {
-            return x.insn_hdl < y.insn_hdl && x.idx < y.idx;
+            return (x.insn_hdl != y.insn_hdl) ? x.insn_hdl < y.insn_hdl
+                                              : x.idx < y.idx;
         }
 
         friend bool operator>(const dex_reg_hdl& x, const dex_reg_hdl& y)
@@ -424,20 +424,22 @@ namespace jitana {
 
         friend size_t hash_value(const dex_reg_hdl& hdl)
         {
-            return static_cast<uint64_t>(hdl);
+            size_t seed = hash_value(hdl.insn_hdl);
+            boost::hash_combine(seed, hdl.idx);
+            return seed;
         }
     };
 
     struct jvm_type_hdl {
         class_loader_hdl loader_hdl;
-        std::string descriptor;
+        symbol descriptor;
 
         jvm_type_hdl()
         {
         }
 
-        jvm_type_hdl(const class_loader_hdl& loader_hdl, std::string descriptor)
-                : loader_hdl(loader_hdl), descriptor(std::move(descriptor))
+        jvm_type_hdl(const class_loader_hdl& loader_hdl, symbol descriptor)
+                : loader_hdl(loader_hdl), descriptor(descriptor)
         {
         }
 
@@ -464,28 +466,30 @@ namespace jitana {
 
         friend size_t hash_value(const jvm_type_hdl& hdl)
         {
-            return std::hash<std::string>()(hdl.descriptor)
-                    ^ unsigned(hdl.loader_hdl);
+            size_t seed = hdl.descriptor.hash();
+            boost::hash_combine(seed, unsigned(hdl.loader_hdl));
+            return seed;
         }
     };
 
     struct jvm_method_hdl {
         jvm_type_hdl type_hdl;
-        std::string unique_name;
+        symbol unique_name;
 
         jvm_method_hdl()
         {
         }
 
-        jvm_method_hdl(const jvm_type_hdl& type_hdl, std::string unique_name)
-                : type_hdl(type_hdl), unique_name(std::move(unique_name))
+        jvm_method_hdl(const jvm_type_hdl& type_hdl, symbol unique_name)
+                : type_hdl(type_hdl), unique_name(unique_name)
         {
         }
 
         const char* return_descriptor() const
         {
-            auto last = unique_name.rfind(')');
-            return last != std::string::npos ? &unique_name[last + 1] : "";
+            const auto& name = unique_name.str();
+            auto last = name.rfind(')');
+            return last != std::string::npos ? &name[last + 1] : "";
         }
 
         friend bool operator==(const jvm_method_hdl& x, const jvm_method_hdl& y)
@@ -501,22 +505,22 @@ namespace jitana {
 
         friend size_t hash_value(const jvm_method_hdl& hdl)
         {
-            // TODO: come up with a better hash function.
-            return hash_value(hdl.type_hdl)
-                    ^ std::hash<std::string>()(hdl.unique_name);
+            size_t seed = hash_value(hdl.type_hdl);
+            boost::hash_combine(seed, hdl.unique_name.hash());
+            return seed;
         }
     };
 
     struct jvm_field_hdl {
         jvm_type_hdl type_hdl;
-        std::string unique_name;
+        symbol unique_name;
 
         jvm_field_hdl()
         {
         }
 
-        jvm_field_hdl(const jvm_type_hdl& type_hdl, std::string unique_name)
-                : type_hdl(type_hdl), unique_name(std::move(unique_name))
+        jvm_field_hdl(const jvm_type_hdl& type_hdl, symbol unique_name)
+                : type_hdl(type_hdl), unique_name(unique_name)
         {
         }
 
@@ -533,9 +537,9 @@ namespace jitana {
 
         friend size_t hash_value(const jvm_field_hdl& hdl)
         {
-            // TODO: come up with a better hash function.
-            return hash_value(hdl.type_hdl)
-                    ^ std::hash<std::string>()(hdl.unique_name);
+            size_t seed = hash_value(hdl.type_hdl);
+            boost::hash_combine(seed, hdl.unique_name.hash());
+            return seed;
         }
     };
 }
@@ -70,6 +70,11 @@ namespace jitana {
             return static_cast<uint16_t>(value);
         }
 
+        explicit operator uint32_t() const
+        {
+            return static_cast<uint32_t>(value);
+        }
+
         bool valid() const
         {
             return value != idx_unknown;
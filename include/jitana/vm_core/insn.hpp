@@ -31,6 +31,7 @@
 
 #include <boost/variant.hpp>
 #include <boost/mpl/vector/vector40.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/range/iterator_range.hpp>
 
 namespace jitana {
@@ -208,13 +209,82 @@ namespace jitana {
         }
     };
 
+    /// A string in the string pool of a DEX file.
+    ///
+    /// It refers to the characters in the DEX file instead of owning a copy,
+    /// so it is only valid while the DEX file is loaded. The references to
+    /// the same string in a DEX file share the characters, so they compare
+    /// equal without looking at the characters.
+    struct dex_string_ref {
+        dex_string_idx idx;
+
+        dex_string_ref() : idx(dex_string_idx::idx_unknown)
+        {
+        }
+
+        dex_string_ref(dex_string_idx idx, boost::string_view str)
+                : idx(idx), size_(str.size()), data_(str.data())
+        {
+        }
+
+        boost::string_view view() const
+        {
+            return {data_, size_};
+        }
+
+        std::string str() const
+        {
+            return std::string(data_, size_);
+        }
+
+        friend bool operator==(const dex_string_ref& x, const dex_string_ref& y)
+        {
+            return x.data_ == y.data_ || x.view() == y.view();
+        }
+
+        friend bool operator!=(const dex_string_ref& x, const dex_string_ref& y)
+        {
+            return !(x == y);
+        }
+
+        friend bool operator<(const dex_string_ref& x, const dex_string_ref& y)
+        {
+            return x.data_ != y.data_ && x.view() < y.view();
+        }
+
+        friend bool operator>(const dex_string_ref& x, const dex_string_ref& y)
+        {
+            return y < x;
+        }
+
+        friend bool operator<=(const dex_string_ref& x, const dex_string_ref& y)
+        {
+            return !(y < x);
+        }
+
+        friend bool operator>=(const dex_string_ref& x, const dex_string_ref& y)
+        {
+            return !(x < y);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os,
+                                        const dex_string_ref& x)
+        {
+            return os << x.view();
+        }
+
+    private:
+        uint32_t size_ = 0;
+        const char* data_ = "";
+    };
+
     // clang-format off
     struct insn_nop              : detail::insn_base<0, boost::blank  > { using insn_base::insn_base; };
     struct insn_move             : detail::insn_base<2, boost::blank  > { using insn_base::insn_base; };
     struct insn_return           : detail::insn_base<1, boost::blank  > { using insn_base::insn_base; };
     struct insn_const            : detail::insn_base<1, int32_t       > { using insn_base::insn_base; };
     struct insn_const_wide       : detail::insn_base<1, int64_t       > { using insn_base::insn_base; };
-    struct insn_const_string     : detail::insn_base<1, std::string   > { using insn_base::insn_base; };
+    struct insn_const_string     : detail::insn_base<1, dex_string_ref> { using insn_base::insn_base; };
     struct insn_const_class      : detail::insn_base<1, dex_type_hdl  > { using insn_base::insn_base; };
     struct insn_monitor_enter    : detail::insn_base<1, boost::blank  > { using insn_base::insn_base; };
     struct insn_monitor_exit     : detail::insn_base<1, boost::blank  > { using insn_base::insn_base; };
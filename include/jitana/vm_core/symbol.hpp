@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_SYMBOL_HPP
+#define JITANA_SYMBOL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace jitana {
+    namespace detail {
+        struct symbol_entry {
+            size_t hash;
+            std::string str;
+        };
+
+        inline size_t symbol_hash(boost::string_view s)
+        {
+            return boost::hash_range(s.begin(), s.end());
+        }
+
+        /// The table mapping the symbol IDs to the entries.
+        ///
+        /// It has two levels so that it can grow without moving the entries,
+        /// and the entries can be read without locking.
+        class symbol_entry_table {
+        public:
+            static constexpr unsigned block_bits = 12;
+            static constexpr unsigned block_size = 1u << block_bits;
+            static constexpr unsigned max_blocks = 1u << 14;
+
+            symbol_entry_table()
+            {
+                // The ID 0 is the empty string.
+                auto block = new const symbol_entry* [block_size] {};
+                block[0] = new symbol_entry{symbol_hash(""), ""};
+                blocks_[0].store(block, std::memory_order_release);
+            }
+
+            const symbol_entry& operator[](uint32_t id) const
+            {
+                const auto* block = blocks_[id >> block_bits].load(
+                        std::memory_order_acquire);
+                return *block[id & (block_size - 1)];
+            }
+
+            std::atomic<const symbol_entry**> blocks_[max_blocks] = {};
+        };
+
+        inline symbol_entry_table& symbol_entries()
+        {
+            static symbol_entry_table table;
+            return table;
+        }
+    }
+
+    /// An interned string.
+    ///
+    /// All the symbols with the same string share a single copy of it in the
+    /// process-wide symbol table, so a symbol is a 32-bit ID. Comparing the
+    /// symbols for equality and hashing them are constant time. Ordering is
+    /// still lexicographic.
+    ///
+    /// The symbols are never removed from the table. Interning is thread-safe.
+    class symbol {
+    public:
+        /// Creates an empty symbol.
+        symbol() = default;
+
+        /// Creates a symbol by interning the string.
+        symbol(boost::string_view s);
+
+        symbol(const std::string& s) : symbol(boost::string_view(s))
+        {
+        }
+
+        symbol(const char* s) : symbol(boost::string_view(s))
+        {
+        }
+
+        /// Returns the symbol for the string if it is already interned.
+        static boost::optional<symbol> find(boost::string_view s);
+
+        /// Returns the ID of the symbol.
+        uint32_t id() const
+        {
+            return id_;
+        }
+
+        /// Returns the precomputed hash value of the string.
+        size_t hash() const
+        {
+            return entry().hash;
+        }
+
+        const std::string& str() const
+        {
+            return entry().str;
+        }
+
+        operator const std::string&() const
+        {
+            return str();
+        }
+
+        boost::string_view view() const
+        {
+            return str();
+        }
+
+        operator boost::string_view() const
+        {
+            return view();
+        }
+
+        const char* c_str() const
+        {
+            return str().c_str();
+        }
+
+        size_t size() const
+        {
+            return str().size();
+        }
+
+        bool empty() const
+        {
+            return id_ == 0;
+        }
+
+        char operator[](size_t pos) const
+        {
+            return str()[pos];
+        }
+
+        friend bool operator==(const symbol& x, const symbol& y)
+        {
+            return x.id_ == y.id_;
+        }
+
+        friend bool operator!=(const symbol& x, const symbol& y)
+        {
+            return x.id_ != y.id_;
+        }
+
+        friend bool operator<(const symbol& x, const symbol& y)
+        {
+            return x.id_ != y.id_ && x.str() < y.str();
+        }
+
+        friend bool operator==(const symbol& x, boost::string_view y)
+        {
+            return x.view() == y;
+        }
+
+        friend bool operator==(boost::string_view x, const symbol& y)
+        {
+            return y == x;
+        }
+
+        friend bool operator!=(const symbol& x, boost::string_view y)
+        {
+            return !(x == y);
+        }
+
+        friend bool operator!=(boost::string_view x, const symbol& y)
+        {
+            return !(y == x);
+        }
+
+        friend bool operator==(const symbol& x, const std::string& y)
+        {
+            return x.str() == y;
+        }
+
+        friend bool operator==(const std::string& x, const symbol& y)
+        {
+            return y == x;
+        }
+
+        friend bool operator!=(const symbol& x, const std::string& y)
+        {
+            return !(x == y);
+        }
+
+        friend bool operator!=(const std::string& x, const symbol& y)
+        {
+            return !(y == x);
+        }
+
+        friend bool operator==(const symbol& x, const char* y)
+        {
+            return x.str() == y;
+        }
+
+        friend bool operator==(const char* x, const symbol& y)
+        {
+            return y == x;
+        }
+
+        friend bool operator!=(const symbol& x, const char* y)
+        {
+            return !(x == y);
+        }
+
+        friend bool operator!=(const char* x, const symbol& y)
+        {
+            return !(y == x);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const symbol& x)
+        {
+            return os << x.str();
+        }
+
+        friend size_t hash_value(const symbol& x)
+        {
+            return x.hash();
+        }
+
+    private:
+        /// Returns the symbol with the ID, which must have been returned by
+        /// the lookup table.
+        static symbol from_id(uint32_t id)
+        {
+            symbol s;
+            s.id_ = id;
+            return s;
+        }
+
+        const detail::symbol_entry& entry() const
+        {
+            return detail::symbol_entries()[id_];
+        }
+
+        uint32_t id_ = 0;
+    };
+}
+
+namespace std {
+    template <>
+    struct hash<jitana::symbol> {
+        size_t operator()(const jitana::symbol& x) const
+        {
+            return x.hash();
+        }
+    };
+}
+
+#endif
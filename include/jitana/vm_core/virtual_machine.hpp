@@ -21,9 +21,13 @@
 #include "jitana/vm_graph/class_graph.hpp"
 #include "jitana/vm_graph/method_graph.hpp"
 #include "jitana/vm_graph/field_graph.hpp"
+#include "jitana/vm_graph/method_dispatch.hpp"
 
+#include <memory>
+#include <string>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -32,6 +36,41 @@ namespace jitana {
 }
 
 namespace jitana {
+    namespace detail {
+        /// A graph shared by the copies of a virtual machine until one of
+        /// them modifies it (copy-on-write).
+        template <typename Graph>
+        class shared_graph {
+        public:
+            shared_graph() : g_(std::make_shared<Graph>())
+            {
+            }
+
+            const Graph& operator*() const
+            {
+                return *g_;
+            }
+
+            const Graph* operator->() const
+            {
+                return g_.get();
+            }
+
+            /// Returns the graph for modification after detaching it from
+            /// the other copies.
+            Graph& write()
+            {
+                if (g_.use_count() != 1) {
+                    g_ = std::make_shared<Graph>(*g_);
+                }
+                return *g_;
+            }
+
+        private:
+            std::shared_ptr<Graph> g_;
+        };
+    }
+
     /// A graph-based virtual machine.
     ///
     /// Every non-trivial virtual machine object is represented as a vertex on
@@ -43,8 +82,27 @@ namespace jitana {
     /// The vertices of the graphs are created by jitana::virtual_machine and
     /// its associated classes only. The edges may be created, modified, or
     /// deleted by external analysis classes.
+    ///
+    /// Copying a virtual machine takes constant time: the copy shares the
+    /// graphs with the original until either of them modifies them. The
+    /// instruction graphs are shared even after that until they are
+    /// modified.
     class virtual_machine {
     public:
+        /// Returns a new virtual machine on top of this one.
+        ///
+        /// The fork starts with the class loaders and the classes of this
+        /// virtual machine, and it is not sealed even if this one is. Use it
+        /// to analyze each application on top of a shared base with the
+        /// framework loaded, without reloading or copying the framework.
+        ///
+        /// The class, method and field graphs of this virtual machine become
+        /// the read-only base of the ones of the fork, which add their own
+        /// vertices and edges on top, and keep their own lookup tables and
+        /// resolution caches. Modifying this virtual machine while a fork
+        /// exists copies its graphs once.
+        virtual_machine fork() const;
+
         /// Adds the class loader to the virtual machine.
         loader_vertex_descriptor add_loader(class_loader loader);
 
@@ -53,14 +111,51 @@ namespace jitana {
         loader_vertex_descriptor add_loader(class_loader loader,
                                             const class_loader_hdl& parent_hdl);
 
-        /// Adds the APK directory as a class loader of the virtual machine with
-        /// the specified parent class loader.
+        /// Adds the APK file as a class loader of the virtual machine with the
+        /// specified parent class loader.
+        ///
+        /// All the DEX files (classes.dex, classes2.dex, ...) are read from
+        /// the archive without extracting it. The APK path may also be the
+        /// directory where the APK is extracted.
         loader_vertex_descriptor add_apk(const class_loader_hdl& hdl,
-                                         const std::string& apk_dir,
+                                         const std::string& apk_path,
                                          const class_loader_hdl& parent_hdl);
 
+        /// Adds the DEX file to the class loader.
+        dex_file_hdl add_dex_file(const class_loader_hdl& loader_hdl,
+                                  const std::string& filename);
+
+        /// Seals the virtual machine after loading.
+        ///
+        /// The lookups of a sealed virtual machine read the tables without
+        /// modifying them, so find_class(), find_method(), find_field() and
+        /// make_jvm_hdl() may be called from multiple threads. They ignore
+        /// try_load, and adding class loaders or loading all the classes
+        /// throws.
+        ///
+        /// The graphs of a sealed virtual machine are read-only: the
+        /// non-const accessors throw, and the instruction graphs are built
+        /// through the const accessors, which may be called from multiple
+        /// threads.
+        void seal();
+
+        /// Returns true if the virtual machine is sealed.
+        bool sealed() const
+        {
+            return sealed_;
+        }
+
+        /// Returns the class loaders searched by the class loader in order:
+        /// the class loader itself, and then its ancestors in the depth-first
+        /// order.
+        const std::vector<loader_vertex_descriptor>&
+        delegation_chain(loader_vertex_descriptor v);
+
         /// Finds the class vertex that corresponds to the initializing JVM
         /// type handle.
+        ///
+        /// The handles that fail to load are remembered, so they are not
+        /// searched again until the class loaders change.
         boost::optional<class_vertex_descriptor>
         find_class(const jvm_type_hdl& hdl, bool try_load);
 
@@ -95,20 +190,88 @@ namespace jitana {
                 std::pair<method_vertex_descriptor, insn_vertex_descriptor>>
         find_insn(const dex_file_hdl& file_hdl, uint32_t offset, bool try_load);
 
+        /// Loads the classes, the methods and the fields used by the method
+        /// and the methods it may invoke, and returns the visited methods.
         std::unordered_set<method_vertex_descriptor>
         load_recursive(method_vertex_descriptor v);
 
+        /// Loads the classes, the methods and the fields used by the method
+        /// and the methods it may invoke using num_threads threads (0 for the
+        /// hardware concurrency) for building the instruction graphs.
+        ///
+        /// The classes are resolved by the calling thread in the same order
+        /// as the single-threaded version, so the resulting graphs are
+        /// identical. The graphs are built by a single thread if the
+        /// instruction graph budget is non-zero.
+        std::unordered_set<method_vertex_descriptor>
+        load_recursive(method_vertex_descriptor v, unsigned num_threads);
+
         /// Loads all the classes in the specified class loader.
         bool load_all_classes(const class_loader_hdl& loader_hdl);
 
+        /// Loads all the classes in the specified class loader using
+        /// num_threads threads (0 for the hardware concurrency) for decoding.
+        ///
+        /// The resulting graphs are identical to the ones created by the
+        /// single-threaded version.
+        bool load_all_classes(const class_loader_hdl& loader_hdl,
+                              unsigned num_threads);
+
+        /// Loads all the classes in the specified class loaders using
+        /// num_threads threads (0 for the hardware concurrency) for decoding.
+        ///
+        /// The class bodies in all the DEX files are decoded at once, and then
+        /// linked loader by loader in the specified order.
+        bool load_all_classes(const std::vector<class_loader_hdl>& loader_hdls,
+                              unsigned num_threads);
+
+        /// Saves the classes, the methods and the fields loaded so far to
+        /// the image file.
+        ///
+        /// The image refers to the DEX files of the class loaders: the
+        /// instruction graphs are built from them on demand after loading
+        /// the image, and the edges added by the analyses are not saved.
+        ///
+        /// The image is a serialization of the graphs, not a memory image
+        /// that is used in place: load_image() still adds every vertex and
+        /// edge, and only saves decoding and linking the class definitions.
+        void save_image(const std::string& filename) const;
+
+        /// Loads the image file saved by save_image() into the virtual
+        /// machine that has the same class loaders but no classes yet.
+        ///
+        /// The loading time is linear in the size of the image since the
+        /// graphs are rebuilt from it.
+        ///
+        /// Returns false without loading anything if the file does not
+        /// exist, or if it was made from different class loaders or DEX
+        /// files.
+        bool load_image(const std::string& filename);
+
+        /// Sets the memory budget in bytes for the instruction graphs that
+        /// are built on demand (0 for unlimited).
+        ///
+        /// The least recently used graphs are evicted when the budget is
+        /// exceeded, and rebuilt when they are accessed again.
+        ///
+        /// The copies and the forks of a virtual machine share the cache
+        /// with it, so this throws while any of them exists.
+        void set_insn_graph_budget(size_t budget);
+
         const loader_graph& loaders() const
         {
-            return loaders_;
+            return *loaders_;
         }
 
+        /// Returns the loader graph for adding the edges of the analyses.
+        ///
+        /// The resolution caches are kept: change the class loaders, their
+        /// parents or their DEX files through add_loader(), add_apk() or
+        /// add_dex_file() instead.
         loader_graph& loaders()
         {
-            return loaders_;
+            throw_if_sealed();
+            return loaders_.write();
         }
 
         const class_graph& classes() const
@@ -118,6 +281,7 @@ namespace jitana {
 
         class_graph& classes()
         {
+            throw_if_sealed();
             return classes_;
         }
 
@@ -128,6 +292,7 @@ namespace jitana {
 
         method_graph& methods()
         {
+            throw_if_sealed();
             return methods_;
         }
 
@@ -138,9 +303,16 @@ namespace jitana {
 
         field_graph& fields()
         {
+            throw_if_sealed();
             return fields_;
         }
 
+        /// Returns the virtual method dispatch index of the loaded classes.
+        ///
+        /// The index is updated for the classes loaded since the last call
+        /// unless the virtual machine is sealed.
+        const method_dispatch& dispatch();
+
         /// Returns the JVM type handle from the DEX type handle.
         jvm_type_hdl make_jvm_hdl(const dex_type_hdl& type_hdl) const;
 
@@ -151,10 +323,42 @@ namespace jitana {
         jvm_field_hdl make_jvm_hdl(const dex_field_hdl& field_hdl) const;
 
     private:
-        loader_graph loaders_;
+        /// The caches for resolving the handles through the class loaders.
+        struct resolution_cache {
+            uint64_t loaders_generation = 0;
+            std::vector<std::vector<loader_vertex_descriptor>>
+                    delegation_chains;
+            std::unordered_set<jvm_type_hdl> missing_classes;
+            std::unordered_set<jvm_method_hdl> missing_methods;
+            std::unordered_set<jvm_field_hdl> missing_fields;
+        };
+
+        /// Returns the resolution cache after clearing it if the class
+        /// loaders have changed.
+        resolution_cache& valid_resolution_cache();
+
+        /// Throws if the virtual machine is sealed.
+        void throw_if_sealed() const;
+
+        /// Returns the loader graph for modification, and invalidates the
+        /// resolution cache.
+        loader_graph& write_loaders()
+        {
+            ++loaders_generation_;
+            return loaders_.write();
+        }
+
+        detail::shared_graph<loader_graph> loaders_;
         class_graph classes_;
         method_graph methods_;
         field_graph fields_;
+        detail::shared_graph<method_dispatch> dispatch_;
+        resolution_cache resolution_cache_;
+        uint64_t loaders_generation_ = 1;
+        /// Shared by the copies of the virtual machine, which share the
+        /// instruction graph cache.
+        std::shared_ptr<void> insn_cache_owner_ = std::make_shared<char>();
+        bool sealed_ = false;
     };
 }
 
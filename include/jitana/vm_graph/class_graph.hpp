@@ -19,37 +19,90 @@
 
 #include "jitana/vm_graph/graph_common.hpp"
 #include "jitana/vm_graph/edge_filtered_graph.hpp"
+#include "jitana/vm_graph/layered_graph.hpp"
+#include "jitana/util/persistent_vector.hpp"
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
-#include <boost/graph/depth_first_search.hpp>
-#include <boost/graph/reverse_graph.hpp>
+#include <boost/range/iterator_range.hpp>
 
 namespace jitana {
-    namespace detail {
-        using class_graph_traits
-                = boost::adjacency_list_traits<boost::vecS, boost::vecS,
-                                               boost::bidirectionalS>;
-    }
-
     /// A class vertex descriptor.
-    using class_vertex_descriptor
-            = detail::class_graph_traits::vertex_descriptor;
+    using class_vertex_descriptor = std::size_t;
 
     /// A class edge descriptor.
-    using class_edge_descriptor = detail::class_graph_traits::edge_descriptor;
+    using class_edge_descriptor = layered_edge_descriptor;
+
+    /// An index from the unique names of the virtual methods to the vtable
+    /// slots of a class.
+    ///
+    /// Each index holds the slots added by the class, and refers to the index
+    /// of the superclass for the inherited slots. The chain is flattened when
+    /// it gets deep to bound the number of probes.
+    class vtable_index {
+    public:
+        vtable_index() = default;
+
+        /// Creates an index inheriting the slots of the parent, which may be
+        /// nullptr.
+        explicit vtable_index(std::shared_ptr<const vtable_index> parent)
+        {
+            if (!parent) {
+                return;
+            }
+            if (parent->depth_ < max_depth) {
+                depth_ = parent->depth_ + 1;
+                parent_ = std::move(parent);
+                return;
+            }
+            for (const auto* x = parent.get(); x; x = x->parent_.get()) {
+                slots_.insert(begin(x->slots_), end(x->slots_));
+            }
+        }
+
+        /// Returns the slot of the virtual method with the unique name.
+        boost::optional<uint32_t> find(const symbol& unique_name) const
+        {
+            for (const auto* x = this; x; x = x->parent_.get()) {
+                auto it = x->slots_.find(unique_name);
+                if (it != end(x->slots_)) {
+                    return it->second;
+                }
+            }
+            return boost::none;
+        }
+
+        /// Adds the slot of a new virtual method.
+        void insert(const symbol& unique_name, uint32_t slot)
+        {
+            slots_.emplace(unique_name, slot);
+        }
+
+    private:
+        static constexpr unsigned max_depth = 8;
+
+        std::shared_ptr<const vtable_index> parent_;
+        std::unordered_map<symbol, uint32_t> slots_;
+        unsigned depth_ = 0;
+    };
 
     /// A class graph vertex property.
+    ///
+    /// The field and method tables start with the entries of the superclass,
+    /// which are shared with the superclass rather than copied.
     struct class_vertex_property {
         dex_type_hdl hdl;
         jvm_type_hdl jvm_hdl;
         dex_access_flags access_flags;
-        std::vector<dex_field_hdl> static_fields;
-        std::vector<dex_field_hdl> instance_fields;
-        std::vector<dex_method_hdl> dtable;
-        std::vector<dex_method_hdl> vtable;
+        persistent_vector<dex_field_hdl> static_fields;
+        persistent_vector<dex_field_hdl> instance_fields;
+        persistent_vector<dex_method_hdl> dtable;
+        persistent_vector<dex_method_hdl> vtable;
+        std::shared_ptr<const vtable_index> vtable_slots;
         uint16_t static_size;
         uint16_t instance_size;
     };
@@ -65,32 +118,22 @@ namespace jitana {
     };
 
     /// A class graph.
-    using class_graph = boost::adjacency_list<
-            boost::vecS, boost::vecS, boost::bidirectionalS,
-            class_vertex_property, class_edge_property, class_graph_property>;
+    using class_graph
+            = layered_graph<class_vertex_property, class_edge_property,
+                            class_graph_property>;
 
-    template <typename ClassGraph>
     inline boost::optional<class_vertex_descriptor>
-    lookup_class_vertex(const dex_type_hdl& hdl, const ClassGraph& g)
+    lookup_class_vertex(const dex_type_hdl& hdl, const class_graph& g)
     {
-        const auto& lut = g[boost::graph_bundle].hdl_to_vertex;
-        auto it = lut.find(hdl);
-        if (it != end(lut)) {
-            return it->second;
-        }
-        return boost::none;
+        return lookup_layered_vertex(hdl, g,
+                                     &class_graph_property::hdl_to_vertex);
     }
 
-    template <typename ClassGraph>
     inline boost::optional<class_vertex_descriptor>
-    lookup_class_vertex(const jvm_type_hdl& hdl, const ClassGraph& g)
+    lookup_class_vertex(const jvm_type_hdl& hdl, const class_graph& g)
     {
-        const auto& lut = g[boost::graph_bundle].jvm_hdl_to_vertex;
-        auto it = lut.find(hdl);
-        if (it != end(lut)) {
-            return it->second;
-        }
-        return boost::none;
+        return lookup_layered_vertex(hdl, g,
+                                     &class_graph_property::jvm_hdl_to_vertex);
     }
 
     struct class_super_edge_property {
@@ -109,40 +152,42 @@ namespace jitana {
         }
     }
 
+    /// Returns the direct superclass of the class, excluding the interfaces.
+    template <typename ClassGraph>
+    inline boost::optional<class_vertex_descriptor>
+    superclass_vertex(const class_vertex_descriptor& v, const ClassGraph& g)
+    {
+        for (const auto& e : boost::make_iterator_range(in_edges(v, g))) {
+            auto p = edge_cast<class_super_edge_property>(&g[e]);
+            if (p && !p->interface) {
+                return source(e, g);
+            }
+        }
+        return boost::none;
+    }
+
+    /// Returns true if the superclass is the same as, or a supertype of, the
+    /// subclass. Use class_hierarchy for repeated queries.
     template <typename ClassGraph>
     inline bool is_superclass_of(const class_vertex_descriptor& superclass,
                                  const class_vertex_descriptor& subclass,
                                  const ClassGraph& g)
     {
-        auto cig = make_edge_filtered_graph<class_super_edge_property>(g);
-        auto rcig = boost::make_reverse_graph(cig);
-        using class_inheritance_graph = decltype(rcig);
-
-        struct class_visitor : boost::default_dfs_visitor {
-            const class_vertex_descriptor& superclass;
-
-            class_visitor(const class_vertex_descriptor& superclass)
-                    : superclass(superclass)
-            {
+        std::vector<class_vertex_descriptor> stack = {subclass};
+        std::unordered_set<class_vertex_descriptor> visited = {subclass};
+        while (!stack.empty()) {
+            const auto v = stack.back();
+            stack.pop_back();
+            if (v == superclass) {
+                return true;
             }
-
-            void discover_vertex(const class_vertex_descriptor& v,
-                                 const class_inheritance_graph&)
-            {
-                if (v == superclass) {
-                    throw v;
+            for (const auto& e : boost::make_iterator_range(in_edges(v, g))) {
+                if (edge_cast<class_super_edge_property>(&g[e])
+                    && visited.insert(source(e, g)).second) {
+                    stack.push_back(source(e, g));
                 }
             }
-        } vis(superclass);
-        boost::vector_property_map<int> color_map(
-                static_cast<unsigned>(num_vertices(g)));
-        try {
-            boost::depth_first_visit(rcig, subclass, vis, color_map);
         }
-        catch (const class_vertex_descriptor&) {
-            return true;
-        }
-
         return false;
     }
 }
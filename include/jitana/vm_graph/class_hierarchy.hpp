@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_CLASS_HIERARCHY_HPP
+#define JITANA_CLASS_HIERARCHY_HPP
+
+#include "jitana/vm_graph/class_graph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+
+namespace jitana {
+    /// An index of a class graph for constant-time subtype checks.
+    ///
+    /// The superclass tree is numbered in preorder, so the subclasses of a
+    /// class form an interval. Each class also has a bitset of the interfaces
+    /// it implements directly or indirectly.
+    ///
+    /// The class graph only grows, and a class is always added after its
+    /// superclass and interfaces. update() computes the interface bitsets of
+    /// the added classes only. It renumbers the superclass tree only when
+    /// the classes added since the last renumbering outnumber the numbered
+    /// ones, which takes amortized constant time per class. Until then, the
+    /// checks walk up from an added class to its nearest numbered
+    /// superclass.
+    class class_hierarchy {
+    public:
+        class_hierarchy() = default;
+
+        explicit class_hierarchy(const class_graph& g)
+        {
+            update(g);
+        }
+
+        /// Indexes the classes added since the last update.
+        void update(const class_graph& g);
+
+        /// Returns the number of the indexed classes.
+        size_t size() const
+        {
+            return superclass_.size();
+        }
+
+        /// Returns true if the class is the same as, or a subclass of, the
+        /// superclass.
+        bool is_subclass_of(class_vertex_descriptor subclass,
+                            class_vertex_descriptor superclass) const
+        {
+            while (subclass >= numbered_) {
+                if (subclass == superclass) {
+                    return true;
+                }
+                subclass = superclass_[subclass];
+                if (subclass == class_graph::null_vertex()) {
+                    return false;
+                }
+            }
+            return superclass < numbered_
+                    && pre_[superclass] <= pre_[subclass]
+                    && pre_[subclass] <= last_[superclass];
+        }
+
+        /// Returns true if the type is the same as, a subclass of, or an
+        /// implementation of the supertype.
+        bool is_subtype_of(class_vertex_descriptor subtype,
+                           class_vertex_descriptor supertype) const
+        {
+            if (is_subclass_of(subtype, supertype)) {
+                return true;
+            }
+            const auto id = interface_ids_[supertype];
+            const auto& bits = interfaces_[subtype];
+            return id != no_interface && id < bits.size() && bits[id];
+        }
+
+        /// Returns the class and its subclasses, the class first.
+        std::vector<class_vertex_descriptor>
+        subclasses(class_vertex_descriptor v) const;
+
+        /// Returns the type and all of its subtypes.
+        std::vector<class_vertex_descriptor>
+        subtypes(class_vertex_descriptor v) const;
+
+    private:
+        static constexpr uint32_t no_interface = 0xffffffff;
+
+        void renumber(const class_graph& g);
+
+        std::vector<uint32_t> pre_;
+        std::vector<uint32_t> last_;
+        std::vector<class_vertex_descriptor> order_;
+        /// The number of the classes numbered by the last renumbering.
+        size_t numbered_ = 0;
+        /// The superclass of each class, or null_vertex() for the roots.
+        std::vector<class_vertex_descriptor> superclass_;
+        /// The direct subclasses added since the last renumbering.
+        std::vector<std::vector<class_vertex_descriptor>> added_subclasses_;
+        std::vector<uint32_t> interface_ids_;
+        std::vector<boost::dynamic_bitset<>> interfaces_;
+        std::vector<std::vector<class_vertex_descriptor>> implementors_;
+    };
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_COMPACT_INSN_GRAPH_HPP
+#define JITANA_COMPACT_INSN_GRAPH_HPP
+
+#include "jitana/vm_core/compact_insn.hpp"
+#include "jitana/vm_graph/insn_graph.hpp"
+
+#include <vector>
+
+namespace jitana {
+    /// A compact instruction graph vertex property.
+    struct compact_insn_vertex_property {
+        compact_insn insn;
+        uint32_t off;
+        int line_num = 0;
+    };
+
+    /// A compact instruction graph property.
+    ///
+    /// Unlike insn_graph_property, it has no table from the offsets to the
+    /// vertices. Use lookup_insn_vertex() instead.
+    struct compact_insn_graph_property {
+        dex_method_hdl hdl;
+        jvm_method_hdl jvm_hdl;
+        std::vector<try_catch_block> try_catches;
+        size_t registers_size;
+        size_t ins_size;
+        size_t outs_size;
+        uint32_t insns_off;
+        compact_insn_operands operands;
+        insn_edge_array<insn_def_use_edge_property> def_use_edges;
+        insn_edge_array<insn_exception_flow_edge_property> exception_edges;
+    };
+
+    /// An instruction graph with the compact instructions.
+    ///
+    /// It has the same vertices and edges as the insn_graph it is made from,
+    /// so the vertex descriptors are interchangeable.
+    using compact_insn_graph = boost::adjacency_list<
+            boost::vecS, boost::vecS, boost::bidirectionalS,
+            compact_insn_vertex_property, insn_edge_property,
+            compact_insn_graph_property>;
+
+    /// Makes the compact instruction graph of the instruction graph.
+    compact_insn_graph make_compact_insn_graph(const insn_graph& g);
+
+    /// Returns the decoded instruction of the vertex.
+    inline insn get_insn(const compact_insn_graph& g, insn_vertex_descriptor v)
+    {
+        return decode_insn(g[v].insn, g[boost::graph_bundle].operands);
+    }
+}
+
+#endif
@@ -17,9 +17,10 @@
 #ifndef JITANA_EDGE_FILTERED_GRAPH_HPP
 #define JITANA_EDGE_FILTERED_GRAPH_HPP
 
+#include "jitana/vm_graph/graph_common.hpp"
+
 #include <boost/graph/filtered_graph.hpp>
 #include <boost/graph/copy.hpp>
-#include <boost/type_erasure/any_cast.hpp>
 
 namespace jitana {
     template <typename EdgePropType, typename Graph>
@@ -29,8 +30,7 @@ namespace jitana {
         template <typename Edge>
         bool operator()(const Edge& e) const
         {
-            namespace te = boost::type_erasure;
-            return te::any_cast<const EdgePropType*>(&(*g)[e]) != nullptr;
+            return (*g)[e].template is<EdgePropType>();
         }
     };
 
@@ -19,24 +19,18 @@
 
 #include "jitana/vm_graph/insn_graph.hpp"
 #include "jitana/vm_graph/graph_common.hpp"
+#include "jitana/vm_graph/layered_graph.hpp"
 
 #include <iostream>
 #include <vector>
 #include <unordered_map>
 
 namespace jitana {
-    namespace detail {
-        using field_graph_traits
-                = boost::adjacency_list_traits<boost::vecS, boost::vecS,
-                                               boost::bidirectionalS>;
-    }
-
     /// A field vertex descriptor.
-    using field_vertex_descriptor
-            = detail::field_graph_traits::vertex_descriptor;
+    using field_vertex_descriptor = std::size_t;
 
     /// A field edge descriptor.
-    using field_edge_descriptor = detail::field_graph_traits::edge_descriptor;
+    using field_edge_descriptor = layered_edge_descriptor;
 
     /// A field graph vertex property.
     struct field_vertex_property {
@@ -63,32 +57,22 @@ namespace jitana {
     };
 
     /// A field graph.
-    using field_graph = boost::adjacency_list<
-            boost::vecS, boost::vecS, boost::bidirectionalS,
-            field_vertex_property, field_edge_property, field_graph_property>;
+    using field_graph
+            = layered_graph<field_vertex_property, field_edge_property,
+                            field_graph_property>;
 
-    template <typename FieldGraph>
     inline boost::optional<field_vertex_descriptor>
-    lookup_field_vertex(const dex_field_hdl& hdl, const FieldGraph& g)
+    lookup_field_vertex(const dex_field_hdl& hdl, const field_graph& g)
     {
-        const auto& lut = g[boost::graph_bundle].hdl_to_vertex;
-        auto it = lut.find(hdl);
-        if (it != end(lut)) {
-            return it->second;
-        }
-        return boost::none;
+        return lookup_layered_vertex(hdl, g,
+                                     &field_graph_property::hdl_to_vertex);
     }
 
-    template <typename FieldGraph>
     inline boost::optional<field_vertex_descriptor>
-    lookup_field_vertex(const jvm_field_hdl& hdl, const FieldGraph& g)
+    lookup_field_vertex(const jvm_field_hdl& hdl, const field_graph& g)
     {
-        const auto& lut = g[boost::graph_bundle].jvm_hdl_to_vertex;
-        auto it = lut.find(hdl);
-        if (it != end(lut)) {
-            return it->second;
-        }
-        return boost::none;
+        return lookup_layered_vertex(hdl, g,
+                                     &field_graph_property::jvm_hdl_to_vertex);
     }
 }
 
@@ -20,18 +20,253 @@
 #include "jitana/vm_core/hdl.hpp"
 #include "jitana/vm_core/access_flags.hpp"
 
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/type_erasure/any.hpp>
-#include <boost/type_erasure/free.hpp>
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
 
-BOOST_TYPE_ERASURE_FREE((has_print_graphviz_attr), print_graphviz_attr, 2)
+#include <boost/graph/adjacency_list.hpp>
 
 namespace jitana {
-    using any_edge_property = boost::type_erasure::any<boost::mpl::vector<
-            boost::type_erasure::copy_constructible<>,
-            boost::type_erasure::relaxed,
-            has_print_graphviz_attr<void(std::ostream&,
-                                         const boost::type_erasure::_self&)>>>;
+    namespace detail {
+        /// The operations on one edge property type.
+        ///
+        /// There is exactly one instance per type, so the address of the
+        /// instance is the tag of the edge kind.
+        struct edge_kind {
+            void (*copy)(void* dst, const void* src);
+            void (*move)(void* dst, void* src);
+            void (*destroy)(void* x);
+            const void* (*get)(const void* x);
+            void (*print_graphviz_attr)(std::ostream& os, const void* x);
+        };
+
+        constexpr std::size_t edge_buffer_size = 2 * sizeof(void*);
+
+        template <typename T>
+        struct is_inline_edge_property
+                : std::integral_constant<
+                          bool, sizeof(T) <= edge_buffer_size
+                                  && alignof(T) <= alignof(void*)
+                                  && std::is_nothrow_move_constructible<
+                                             T>::value> {
+        };
+
+        template <typename T, bool = is_inline_edge_property<T>::value>
+        struct edge_kind_of;
+
+        /// Properties that fit in the buffer are stored in place.
+        template <typename T>
+        struct edge_kind_of<T, true> {
+            template <typename U>
+            static void construct(void* buf, U&& x)
+            {
+                new (buf) T(std::forward<U>(x));
+            }
+
+            static void copy(void* dst, const void* src)
+            {
+                new (dst) T(*static_cast<const T*>(src));
+            }
+
+            static void move(void* dst, void* src)
+            {
+                new (dst) T(std::move(*static_cast<T*>(src)));
+                static_cast<T*>(src)->~T();
+            }
+
+            static void destroy(void* x)
+            {
+                static_cast<T*>(x)->~T();
+            }
+
+            static const void* get(const void* x)
+            {
+                return x;
+            }
+
+            static void print(std::ostream& os, const void* x)
+            {
+                print_graphviz_attr(os, *static_cast<const T*>(x));
+            }
+
+            static const edge_kind value;
+        };
+
+        template <typename T>
+        const edge_kind edge_kind_of<T, true>::value
+                = {&copy, &move, &destroy, &get, &print};
+
+        /// Larger properties are stored on the heap.
+        template <typename T>
+        struct edge_kind_of<T, false> {
+            template <typename U>
+            static void construct(void* buf, U&& x)
+            {
+                new (buf) T*(new T(std::forward<U>(x)));
+            }
+
+            static void copy(void* dst, const void* src)
+            {
+                new (dst) T*(new T(**static_cast<T* const*>(src)));
+            }
+
+            static void move(void* dst, void* src)
+            {
+                new (dst) T*(*static_cast<T**>(src));
+            }
+
+            static void destroy(void* x)
+            {
+                delete *static_cast<T**>(x);
+            }
+
+            static const void* get(const void* x)
+            {
+                return *static_cast<T* const*>(x);
+            }
+
+            static void print(std::ostream& os, const void* x)
+            {
+                print_graphviz_attr(os, *static_cast<const T*>(x));
+            }
+
+            static const edge_kind value;
+        };
+
+        template <typename T>
+        const edge_kind edge_kind_of<T, false>::value
+                = {&copy, &move, &destroy, &get, &print};
+    }
+
+    /// An edge property of any kind.
+    ///
+    /// The kind tag is stored inline together with a small buffer, so
+    /// checking the kind of an edge is a pointer comparison and small
+    /// properties need no allocation.
+    class any_edge_property {
+    public:
+        any_edge_property() = default;
+
+        template <typename T,
+                  typename = std::enable_if_t<!std::is_same<
+                          std::decay_t<T>, any_edge_property>::value>>
+        any_edge_property(T&& x)
+                : kind_(&detail::edge_kind_of<std::decay_t<T>>::value)
+        {
+            detail::edge_kind_of<std::decay_t<T>>::construct(
+                    buf_, std::forward<T>(x));
+        }
+
+        any_edge_property(const any_edge_property& x) : kind_(x.kind_)
+        {
+            if (kind_) {
+                kind_->copy(buf_, x.buf_);
+            }
+        }
+
+        any_edge_property(any_edge_property&& x) noexcept : kind_(x.kind_)
+        {
+            if (kind_) {
+                kind_->move(buf_, x.buf_);
+                x.kind_ = nullptr;
+            }
+        }
+
+        ~any_edge_property()
+        {
+            reset();
+        }
+
+        any_edge_property& operator=(const any_edge_property& x)
+        {
+            if (this != &x) {
+                reset();
+                if (x.kind_) {
+                    x.kind_->copy(buf_, x.buf_);
+                    kind_ = x.kind_;
+                }
+            }
+            return *this;
+        }
+
+        any_edge_property& operator=(any_edge_property&& x) noexcept
+        {
+            if (this != &x) {
+                reset();
+                if (x.kind_) {
+                    x.kind_->move(buf_, x.buf_);
+                    kind_ = x.kind_;
+                    x.kind_ = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        bool empty() const
+        {
+            return kind_ == nullptr;
+        }
+
+        /// Returns true if the property is of type T.
+        template <typename T>
+        bool is() const
+        {
+            return kind_ == &detail::edge_kind_of<T>::value;
+        }
+
+        /// Returns the property as T, or nullptr if it is of another type.
+        template <typename T>
+        const T* get_if() const
+        {
+            return is<T>() ? static_cast<const T*>(kind_->get(buf_))
+                           : nullptr;
+        }
+
+        template <typename T>
+        T* get_if()
+        {
+            return is<T>() ? const_cast<T*>(static_cast<const T*>(
+                                     kind_->get(buf_)))
+                           : nullptr;
+        }
+
+        friend void print_graphviz_attr(std::ostream& os,
+                                        const any_edge_property& x)
+        {
+            if (x.kind_) {
+                x.kind_->print_graphviz_attr(os, x.kind_->get(x.buf_));
+            }
+        }
+
+    private:
+        void reset()
+        {
+            if (kind_) {
+                kind_->destroy(buf_);
+                kind_ = nullptr;
+            }
+        }
+
+    private:
+        const detail::edge_kind* kind_ = nullptr;
+        alignas(void*) unsigned char buf_[detail::edge_buffer_size];
+    };
+
+    /// Returns a pointer to the edge property as T, or nullptr if the
+    /// property is of another type.
+    template <typename T>
+    inline const T* edge_cast(const any_edge_property* x)
+    {
+        return x ? x->get_if<T>() : nullptr;
+    }
+
+    template <typename T>
+    inline T* edge_cast(any_edge_property* x)
+    {
+        return x ? x->get_if<T>() : nullptr;
+    }
 }
 
 #endif
@@ -64,7 +64,7 @@ namespace jitana {
 
         auto gprop_writer = [&](std::ostream& os) { os << "rankdir=RL;\n"; };
 
-        write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
+        boost::write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
     }
 
     /// Writes a class graph to the stream in the Graphviz format.
@@ -99,7 +99,7 @@ namespace jitana {
 
         auto gprop_writer = [&](std::ostream& os) { os << "rankdir=LR;"; };
 
-        write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
+        boost::write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
     }
 
     /// Writes a method graph to the stream in the Graphviz format.
@@ -137,7 +137,7 @@ namespace jitana {
 
         auto gprop_writer = [&](std::ostream& os) { os << "rankdir=LR;"; };
 
-        write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
+        boost::write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
     }
 
     /// Writes a method graph to the stream in the Graphviz format.
@@ -183,7 +183,7 @@ namespace jitana {
 
         auto gprop_writer = [&](std::ostream& os) { os << "rankdir=LR;"; };
 
-        write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
+        boost::write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
     }
 
     /// Writes a field graph to the stream in the Graphviz format.
@@ -224,7 +224,7 @@ namespace jitana {
 
         auto gprop_writer = [&](std::ostream& os) { os << "rankdir=LR;"; };
 
-        write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
+        boost::write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
     }
 
     namespace detail {
@@ -320,7 +320,8 @@ namespace jitana {
                     dex_method_hdl mh = *m;
                     if (vm) {
                         if (auto mv = vm->find_method(mh, false)) {
-                            mh = vm->methods()[*mv].hdl;
+                            const auto& cvm = *vm;
+                            mh = cvm.methods()[*mv].hdl;
                         }
                     }
                     os << ",";
@@ -358,7 +359,30 @@ namespace jitana {
                << gprop.jvm_hdl.unique_name << "\";\n";
         };
 
-        write_graphviz(os, g, prop_writer, eprop_writer, gprop_writer);
+        // Same as boost::write_graphviz(), but also writes the def-use and
+        // exception edges kept outside of the adjacency list.
+        os << "digraph G {\n";
+        gprop_writer(os);
+        for (const auto& v : boost::make_iterator_range(vertices(g))) {
+            os << v;
+            prop_writer(os, v);
+            os << ";\n";
+        }
+        for (const auto& e : boost::make_iterator_range(edges(g))) {
+            os << source(e, g) << "->" << target(e, g) << " ";
+            eprop_writer(os, e);
+            os << ";\n";
+        }
+        auto write_edges = [&](const auto& edge_array) {
+            for (const auto& e : edge_array.edges()) {
+                os << e.source << "->" << e.target << " [";
+                print_graphviz_attr(os, e.prop);
+                os << "];\n";
+            }
+        };
+        write_edges(g[boost::graph_bundle].exception_edges);
+        write_edges(g[boost::graph_bundle].def_use_edges);
+        os << "}" << std::endl;
     }
 }
 
@@ -20,11 +20,13 @@
 #include "jitana/vm_core/insn.hpp"
 #include "jitana/vm_graph/graph_common.hpp"
 
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
+#include <boost/iterator/permutation_iterator.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <boost/variant.hpp>
-#include <boost/type_erasure/any_cast.hpp>
 
 namespace jitana {
     namespace detail {
@@ -60,6 +62,135 @@ namespace jitana {
         insn_vertex_descriptor catch_all;
     };
 
+    struct insn_def_use_edge_property {
+        register_idx reg;
+    };
+
+    inline void print_graphviz_attr(std::ostream& os,
+                                    const insn_def_use_edge_property& prop)
+    {
+        os << "color=red, fontcolor=red";
+        os << ", label=\"" << prop.reg << "\"";
+    }
+
+    struct insn_exception_flow_edge_property {
+    };
+
+    inline void
+    print_graphviz_attr(std::ostream& os,
+                        const insn_exception_flow_edge_property& /*prop*/)
+    {
+        os << "color=darkgreen, fontcolor=darkgreen, weight=1";
+    }
+
+    /// Compact adjacency arrays of one kind of instruction edges.
+    ///
+    /// The edges are stored grouped by the source vertex, with a second
+    /// index grouped by the target vertex, so that the edges of one kind
+    /// coming out of or into a vertex are a contiguous array walk.
+    template <typename EdgeProperty>
+    class insn_edge_array {
+    public:
+        struct edge_type {
+            insn_vertex_descriptor source;
+            insn_vertex_descriptor target;
+            EdgeProperty prop;
+        };
+
+        using out_edge_range = boost::iterator_range<const edge_type*>;
+        using in_edge_range = boost::iterator_range<boost::permutation_iterator<
+                const edge_type*, std::vector<uint32_t>::const_iterator>>;
+
+        /// Replaces all the edges in O(n + edges.size()).
+        void assign(std::vector<edge_type> edges, size_t n)
+        {
+            out_offsets_.assign(n + 1, 0);
+            in_offsets_.assign(n + 1, 0);
+            for (const auto& e : edges) {
+                ++out_offsets_[e.source + 1];
+                ++in_offsets_[e.target + 1];
+            }
+            for (size_t v = 0; v < n; ++v) {
+                out_offsets_[v + 1] += out_offsets_[v];
+                in_offsets_[v + 1] += in_offsets_[v];
+            }
+
+            // Counting sort by the source, keeping the order of the edges of
+            // the same source.
+            std::vector<uint32_t> order(edges.size());
+            {
+                auto pos = out_offsets_;
+                for (size_t i = 0; i < edges.size(); ++i) {
+                    order[pos[edges[i].source]++] = i;
+                }
+            }
+            edges_.clear();
+            edges_.reserve(edges.size());
+            for (auto i : order) {
+                edges_.push_back(std::move(edges[i]));
+            }
+
+            in_index_.resize(edges_.size());
+            auto pos = in_offsets_;
+            for (size_t i = 0; i < edges_.size(); ++i) {
+                in_index_[pos[edges_[i].target]++] = i;
+            }
+        }
+
+        void clear()
+        {
+            edges_.clear();
+            in_index_.clear();
+            out_offsets_.clear();
+            in_offsets_.clear();
+        }
+
+        size_t size() const
+        {
+            return edges_.size();
+        }
+
+        bool empty() const
+        {
+            return edges_.empty();
+        }
+
+        /// Returns all the edges grouped by the source.
+        out_edge_range edges() const
+        {
+            return {edges_.data(), edges_.data() + edges_.size()};
+        }
+
+        /// Returns the edges coming out of the vertex.
+        out_edge_range out_edges(insn_vertex_descriptor v) const
+        {
+            if (v + 1 >= out_offsets_.size()) {
+                return {edges_.data(), edges_.data()};
+            }
+            return {edges_.data() + out_offsets_[v],
+                    edges_.data() + out_offsets_[v + 1]};
+        }
+
+        /// Returns the edges coming into the vertex.
+        in_edge_range in_edges(insn_vertex_descriptor v) const
+        {
+            auto first = in_index_.begin();
+            auto last = in_index_.begin();
+            if (v + 1 < in_offsets_.size()) {
+                first += in_offsets_[v];
+                last += in_offsets_[v + 1];
+            }
+            return {boost::make_permutation_iterator(edges_.data(), first),
+                    boost::make_permutation_iterator(edges_.data(), last)};
+        }
+
+    private:
+        std::vector<edge_type> edges_;
+        std::vector<uint32_t> in_index_;
+        std::vector<uint32_t> out_offsets_;
+        std::vector<uint32_t> in_offsets_;
+    };
+
     /// An instruction graph property.
     struct insn_graph_property {
         std::unordered_map<uint16_t, insn_vertex_descriptor> offset_to_vertex;
@@ -71,6 +202,8 @@ namespace jitana {
         size_t outs_size;
         uint32_t insns_off;
         // std::vector<std::string> param_names;
+        insn_edge_array<insn_def_use_edge_property> def_use_edges;
+        insn_edge_array<insn_exception_flow_edge_property> exception_edges;
     };
 
     /// An instruction graph.
@@ -79,8 +212,14 @@ namespace jitana {
                                     boost::bidirectionalS, insn_vertex_property,
                                     insn_edge_property, insn_graph_property>;
 
+    /// Returns the instruction of the vertex.
+    inline const insn& get_insn(const insn_graph& g, insn_vertex_descriptor v)
+    {
+        return g[v].insn;
+    }
+
     template <typename InsnGraph>
-    inline boost::optional<class_vertex_descriptor>
+    inline boost::optional<insn_vertex_descriptor>
     lookup_insn_vertex(uint16_t off, const InsnGraph& g)
     {
         if (num_vertices(g) <= 2) {
@@ -155,9 +294,7 @@ namespace jitana {
     {
         for (const auto& e : boost::make_iterator_range(in_edges(v, g))) {
             // Ignore if it's not a control-flow edge.
-            namespace te = boost::type_erasure;
-            if (te::any_cast<const insn_control_flow_edge_property*>(&g[e])
-                == nullptr) {
+            if (!g[e].template is<insn_control_flow_edge_property>()) {
                 continue;
             }
 
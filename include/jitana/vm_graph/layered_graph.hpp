@@ -0,0 +1,586 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_LAYERED_GRAPH_HPP
+#define JITANA_LAYERED_GRAPH_HPP
+
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/graph/adjacency_iterator.hpp>
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_map/property_map.hpp>
+
+namespace jitana {
+    /// An edge descriptor of a layered_graph.
+    struct layered_edge_descriptor {
+        std::size_t source;
+        std::size_t target;
+        /// The index of the edge in the order of addition.
+        std::size_t idx;
+
+        friend bool operator==(const layered_edge_descriptor& x,
+                               const layered_edge_descriptor& y)
+        {
+            return x.idx == y.idx;
+        }
+
+        friend bool operator!=(const layered_edge_descriptor& x,
+                               const layered_edge_descriptor& y)
+        {
+            return x.idx != y.idx;
+        }
+
+        friend bool operator<(const layered_edge_descriptor& x,
+                              const layered_edge_descriptor& y)
+        {
+            return x.idx < y.idx;
+        }
+    };
+
+    /// Returns the graph property of a new layer on top of a graph with the
+    /// property.
+    ///
+    /// The lookup tables of a layer start empty since the ones of the base
+    /// are searched too. Overload it for the properties that have anything
+    /// else to share.
+    template <typename GraphProperty>
+    inline GraphProperty make_layer_property(const GraphProperty&)
+    {
+        return GraphProperty();
+    }
+
+    namespace detail {
+        /// The vertices and edges added by a layer of a layered_graph.
+        template <typename VertexProperty, typename EdgeProperty,
+                  typename GraphProperty>
+        struct graph_layer {
+            struct adjacent {
+                std::size_t v;
+                std::size_t idx;
+            };
+
+            struct vertex_record {
+                VertexProperty prop;
+                std::vector<adjacent> out_edges;
+                std::vector<adjacent> in_edges;
+            };
+
+            struct edge_record {
+                std::size_t source;
+                std::size_t target;
+                EdgeProperty prop;
+            };
+
+            std::vector<vertex_record> vertices;
+            std::deque<edge_record> edges;
+            GraphProperty prop;
+
+            /// The edges added to the vertices of the base.
+            std::unordered_map<std::size_t, std::vector<adjacent>>
+                    base_out_edges;
+            std::unordered_map<std::size_t, std::vector<adjacent>>
+                    base_in_edges;
+
+            /// The modified copies of the properties of the base.
+            std::unordered_map<std::size_t, VertexProperty> base_vertex_props;
+            std::unordered_map<std::size_t, EdgeProperty> base_edge_props;
+        };
+    }
+
+    /// A bidirectional graph made of a read-only base shared with other
+    /// graphs and a layer of its own on top of it.
+    ///
+    /// The vertices and edges are numbered in the order of addition, the ones
+    /// of the base first. The edges added to the vertices of the base, and
+    /// the properties of the base modified through non-const references, are
+    /// kept in the layer, so the base is never modified or copied.
+    ///
+    /// The graph property is the one of the layer. The lookup tables in it
+    /// are searched by lookup_layered_vertex() together with the ones of the
+    /// base.
+    ///
+    /// Copying a graph takes constant time: the copies share the layer
+    /// until one of them is modified. Vertices and edges cannot be removed.
+    template <typename VertexProperty, typename EdgeProperty,
+              typename GraphProperty>
+    class layered_graph {
+    private:
+        using layer = detail::graph_layer<VertexProperty, EdgeProperty,
+                                          GraphProperty>;
+        using adjacent = typename layer::adjacent;
+
+    public:
+        using vertex_descriptor = std::size_t;
+        using edge_descriptor = layered_edge_descriptor;
+        using directed_category = boost::bidirectional_tag;
+        using edge_parallel_category = boost::allow_parallel_edge_tag;
+
+        struct traversal_category : boost::bidirectional_graph_tag,
+                                    boost::adjacency_graph_tag,
+                                    boost::vertex_list_graph_tag,
+                                    boost::edge_list_graph_tag {
+        };
+
+        using vertices_size_type = std::size_t;
+        using edges_size_type = std::size_t;
+        using degree_size_type = std::size_t;
+
+        using vertex_bundled = VertexProperty;
+        using edge_bundled = EdgeProperty;
+        using graph_bundled = GraphProperty;
+
+        using vertex_iterator = boost::counting_iterator<std::size_t>;
+
+        /// Iterates the adjacency list of a vertex in the layer it belongs
+        /// to, and then the edges added to it by the layer on top.
+        template <bool Out>
+        class incident_edge_iterator
+                : public boost::iterator_facade<incident_edge_iterator<Out>,
+                                                edge_descriptor,
+                                                std::forward_iterator_tag,
+                                                edge_descriptor> {
+        public:
+            incident_edge_iterator() = default;
+
+            incident_edge_iterator(std::size_t v, const adjacent* first,
+                                   const adjacent* last,
+                                   const adjacent* next_first,
+                                   const adjacent* next_last)
+                    : v_(v),
+                      p_(first),
+                      last_(last),
+                      next_first_(next_first),
+                      next_last_(next_last)
+            {
+                skip_empty();
+            }
+
+        private:
+            friend class boost::iterator_core_access;
+
+            edge_descriptor dereference() const
+            {
+                return Out ? edge_descriptor{v_, p_->v, p_->idx}
+                           : edge_descriptor{p_->v, v_, p_->idx};
+            }
+
+            bool equal(const incident_edge_iterator& x) const
+            {
+                return p_ == x.p_;
+            }
+
+            void increment()
+            {
+                ++p_;
+                skip_empty();
+            }
+
+            void skip_empty()
+            {
+                if (p_ == last_ && next_first_ != next_last_) {
+                    p_ = next_first_;
+                    last_ = next_last_;
+                    next_first_ = next_last_;
+                }
+            }
+
+            std::size_t v_ = 0;
+            const adjacent* p_ = nullptr;
+            const adjacent* last_ = nullptr;
+            const adjacent* next_first_ = nullptr;
+            const adjacent* next_last_ = nullptr;
+        };
+
+        using out_edge_iterator = incident_edge_iterator<true>;
+        using in_edge_iterator = incident_edge_iterator<false>;
+
+        using adjacency_iterator = typename boost::adjacency_iterator_generator<
+                layered_graph, vertex_descriptor, out_edge_iterator>::type;
+        using inv_adjacency_iterator =
+                typename boost::inv_adjacency_iterator_generator<
+                        layered_graph, vertex_descriptor,
+                        in_edge_iterator>::type;
+
+        class edge_iterator
+                : public boost::iterator_facade<edge_iterator,
+                                                edge_descriptor,
+                                                std::forward_iterator_tag,
+                                                edge_descriptor> {
+        public:
+            edge_iterator() = default;
+
+            edge_iterator(const layered_graph* g, std::size_t idx)
+                    : g_(g), idx_(idx)
+            {
+            }
+
+        private:
+            friend class boost::iterator_core_access;
+
+            edge_descriptor dereference() const
+            {
+                const auto& x = g_->edge_record(idx_);
+                return {x.source, x.target, idx_};
+            }
+
+            bool equal(const edge_iterator& x) const
+            {
+                return idx_ == x.idx_;
+            }
+
+            void increment()
+            {
+                ++idx_;
+            }
+
+            const layered_graph* g_ = nullptr;
+            std::size_t idx_ = 0;
+        };
+
+        static vertex_descriptor null_vertex()
+        {
+            return std::numeric_limits<vertex_descriptor>::max();
+        }
+
+        layered_graph() : base_(empty_layer()), top_(std::make_shared<layer>())
+        {
+        }
+
+        /// Returns a new graph on top of this one.
+        ///
+        /// The graph becomes the base of the new graph, which shares it
+        /// until this graph is modified. The new graph of a graph that
+        /// already has a base shares the same base instead, and it copies
+        /// the layer of this graph on the first modification.
+        layered_graph fork() const
+        {
+            if (!base_->vertices.empty() || !base_->edges.empty()) {
+                return *this;
+            }
+
+            layered_graph g;
+            g.base_ = top_;
+            g.top_->prop = make_layer_property(top_->prop);
+            return g;
+        }
+
+        /// Returns the graph property of the base.
+        const GraphProperty& base_graph_property() const
+        {
+            return base_->prop;
+        }
+
+        const VertexProperty& operator[](vertex_descriptor v) const
+        {
+            const auto n = base_->vertices.size();
+            if (v >= n) {
+                return top_->vertices[v - n].prop;
+            }
+            const auto& props = top_->base_vertex_props;
+            if (!props.empty()) {
+                auto it = props.find(v);
+                if (it != end(props)) {
+                    return it->second;
+                }
+            }
+            return base_->vertices[v].prop;
+        }
+
+        VertexProperty& operator[](vertex_descriptor v)
+        {
+            auto& t = write();
+            const auto n = base_->vertices.size();
+            if (v >= n) {
+                return t.vertices[v - n].prop;
+            }
+            auto it = t.base_vertex_props.find(v);
+            if (it == end(t.base_vertex_props)) {
+                it = t.base_vertex_props.emplace(v, base_->vertices[v].prop)
+                             .first;
+            }
+            return it->second;
+        }
+
+        const EdgeProperty& operator[](const edge_descriptor& e) const
+        {
+            const auto n = base_->edges.size();
+            if (e.idx >= n) {
+                return top_->edges[e.idx - n].prop;
+            }
+            const auto& props = top_->base_edge_props;
+            if (!props.empty()) {
+                auto it = props.find(e.idx);
+                if (it != end(props)) {
+                    return it->second;
+                }
+            }
+            return base_->edges[e.idx].prop;
+        }
+
+        EdgeProperty& operator[](const edge_descriptor& e)
+        {
+            auto& t = write();
+            const auto n = base_->edges.size();
+            if (e.idx >= n) {
+                return t.edges[e.idx - n].prop;
+            }
+            auto it = t.base_edge_props.find(e.idx);
+            if (it == end(t.base_edge_props)) {
+                it = t.base_edge_props.emplace(e.idx, base_->edges[e.idx].prop)
+                             .first;
+            }
+            return it->second;
+        }
+
+        const GraphProperty& operator[](boost::graph_bundle_t) const
+        {
+            return top_->prop;
+        }
+
+        GraphProperty& operator[](boost::graph_bundle_t)
+        {
+            return write().prop;
+        }
+
+        friend std::pair<vertex_iterator, vertex_iterator>
+        vertices(const layered_graph& g)
+        {
+            return {vertex_iterator(0), vertex_iterator(num_vertices(g))};
+        }
+
+        friend std::size_t num_vertices(const layered_graph& g)
+        {
+            return g.base_->vertices.size() + g.top_->vertices.size();
+        }
+
+        friend std::pair<edge_iterator, edge_iterator>
+        edges(const layered_graph& g)
+        {
+            return {edge_iterator(&g, 0), edge_iterator(&g, num_edges(g))};
+        }
+
+        friend std::size_t num_edges(const layered_graph& g)
+        {
+            return g.base_->edges.size() + g.top_->edges.size();
+        }
+
+        friend std::size_t source(const edge_descriptor& e,
+                                  const layered_graph&)
+        {
+            return e.source;
+        }
+
+        friend std::size_t target(const edge_descriptor& e,
+                                  const layered_graph&)
+        {
+            return e.target;
+        }
+
+        friend std::pair<out_edge_iterator, out_edge_iterator>
+        out_edges(vertex_descriptor v, const layered_graph& g)
+        {
+            return g.template incident_edges<true>(v);
+        }
+
+        friend std::pair<in_edge_iterator, in_edge_iterator>
+        in_edges(vertex_descriptor v, const layered_graph& g)
+        {
+            return g.template incident_edges<false>(v);
+        }
+
+        friend std::size_t out_degree(vertex_descriptor v,
+                                      const layered_graph& g)
+        {
+            auto r = out_edges(v, g);
+            return std::distance(r.first, r.second);
+        }
+
+        friend std::size_t in_degree(vertex_descriptor v,
+                                     const layered_graph& g)
+        {
+            auto r = in_edges(v, g);
+            return std::distance(r.first, r.second);
+        }
+
+        friend std::pair<adjacency_iterator, adjacency_iterator>
+        adjacent_vertices(vertex_descriptor v, const layered_graph& g)
+        {
+            auto r = out_edges(v, g);
+            return {adjacency_iterator(r.first, &g),
+                    adjacency_iterator(r.second, &g)};
+        }
+
+        friend std::pair<inv_adjacency_iterator, inv_adjacency_iterator>
+        inv_adjacent_vertices(vertex_descriptor v, const layered_graph& g)
+        {
+            auto r = in_edges(v, g);
+            return {inv_adjacency_iterator(r.first, &g),
+                    inv_adjacency_iterator(r.second, &g)};
+        }
+
+        friend vertex_descriptor add_vertex(VertexProperty prop,
+                                            layered_graph& g)
+        {
+            auto& t = g.write();
+            t.vertices.push_back({std::move(prop), {}, {}});
+            return num_vertices(g) - 1;
+        }
+
+        friend vertex_descriptor add_vertex(layered_graph& g)
+        {
+            return add_vertex(VertexProperty(), g);
+        }
+
+        friend std::pair<edge_descriptor, bool>
+        add_edge(vertex_descriptor u, vertex_descriptor v, EdgeProperty prop,
+                 layered_graph& g)
+        {
+            auto& t = g.write();
+            const auto idx = num_edges(g);
+            t.edges.push_back({u, v, std::move(prop)});
+            g.template adjacency<true>(t, u).push_back({v, idx});
+            g.template adjacency<false>(t, v).push_back({u, idx});
+            return {{u, v, idx}, true};
+        }
+
+        friend std::pair<edge_descriptor, bool>
+        add_edge(vertex_descriptor u, vertex_descriptor v, layered_graph& g)
+        {
+            return add_edge(u, v, EdgeProperty(), g);
+        }
+
+        friend boost::typed_identity_property_map<std::size_t>
+        get(boost::vertex_index_t, const layered_graph&)
+        {
+            return {};
+        }
+
+    private:
+        /// Returns the layer for modification after detaching it from the
+        /// copies.
+        layer& write()
+        {
+            if (top_.use_count() != 1) {
+                top_ = std::make_shared<layer>(*top_);
+            }
+            return *top_;
+        }
+
+        const typename layer::edge_record& edge_record(std::size_t idx) const
+        {
+            const auto n = base_->edges.size();
+            return idx < n ? base_->edges[idx] : top_->edges[idx - n];
+        }
+
+        template <bool Out>
+        std::pair<incident_edge_iterator<Out>, incident_edge_iterator<Out>>
+        incident_edges(vertex_descriptor v) const
+        {
+            auto range = [](const std::vector<adjacent>& x) {
+                return std::make_pair(x.data(), x.data() + x.size());
+            };
+
+            const auto n = base_->vertices.size();
+            if (v >= n) {
+                const auto& x = top_->vertices[v - n];
+                auto r = range(Out ? x.out_edges : x.in_edges);
+                return {{v, r.first, r.second, r.second, r.second},
+                        {v, r.second, r.second, r.second, r.second}};
+            }
+
+            const auto& x = base_->vertices[v];
+            auto r = range(Out ? x.out_edges : x.in_edges);
+            auto next = std::make_pair(r.second, r.second);
+            const auto& added
+                    = Out ? top_->base_out_edges : top_->base_in_edges;
+            if (!added.empty()) {
+                auto it = added.find(v);
+                if (it != end(added) && !it->second.empty()) {
+                    next = range(it->second);
+                }
+            }
+            return {{v, r.first, r.second, next.first, next.second},
+                    {v, next.second, next.second, next.second, next.second}};
+        }
+
+        template <bool Out>
+        std::vector<adjacent>& adjacency(layer& t, vertex_descriptor v) const
+        {
+            const auto n = base_->vertices.size();
+            if (v >= n) {
+                auto& x = t.vertices[v - n];
+                return Out ? x.out_edges : x.in_edges;
+            }
+            return Out ? t.base_out_edges[v] : t.base_in_edges[v];
+        }
+
+        static const std::shared_ptr<const layer>& empty_layer()
+        {
+            static const std::shared_ptr<const layer> x
+                    = std::make_shared<layer>();
+            return x;
+        }
+
+        /// The base has no base of its own.
+        std::shared_ptr<const layer> base_;
+        std::shared_ptr<layer> top_;
+    };
+
+    /// Finds the vertex of the key in a lookup table of the graph property,
+    /// searching the table of the graph first and then the one of its base.
+    template <typename VertexProperty, typename EdgeProperty,
+              typename GraphProperty, typename Table, typename Key>
+    inline boost::optional<std::size_t> lookup_layered_vertex(
+            const Key& key,
+            const layered_graph<VertexProperty, EdgeProperty, GraphProperty>&
+                    g,
+            Table GraphProperty::*table)
+    {
+        for (const auto* prop :
+             {&g[boost::graph_bundle], &g.base_graph_property()}) {
+            const auto& lut = prop->*table;
+            auto it = lut.find(key);
+            if (it != end(lut)) {
+                return it->second;
+            }
+        }
+        return boost::none;
+    }
+}
+
+namespace boost {
+    template <typename VertexProperty, typename EdgeProperty,
+              typename GraphProperty>
+    struct property_map<jitana::layered_graph<VertexProperty, EdgeProperty,
+                                              GraphProperty>,
+                        vertex_index_t> {
+        using type = typed_identity_property_map<std::size_t>;
+        using const_type = type;
+    };
+}
+
+#endif
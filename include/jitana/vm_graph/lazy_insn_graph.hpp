@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_LAZY_INSN_GRAPH_HPP
+#define JITANA_LAZY_INSN_GRAPH_HPP
+
+#include "jitana/vm_graph/insn_graph.hpp"
+#include "jitana/vm_graph/compact_insn_graph.hpp"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace jitana {
+    /// A source of instruction graphs built on demand.
+    class insn_graph_source {
+    public:
+        virtual ~insn_graph_source() = default;
+
+        /// Builds the instruction graph of the method from its code item.
+        virtual insn_graph make_insn_graph(uint32_t code_off,
+                                           const dex_method_hdl& hdl) const = 0;
+    };
+
+    namespace detail {
+        struct lazy_insn_graph_slot;
+    }
+
+    /// A cache of lazily built instruction graphs.
+    ///
+    /// If the budget is non-zero, the least recently used graphs are evicted
+    /// when the estimated memory used by the evictable graphs exceeds it.
+    /// The compact form of a graph counts against the budget too, and it is
+    /// evicted together with the graph. Evicted graphs are rebuilt from their
+    /// sources on the next access.
+    ///
+    /// The graphs may be built and accessed through const references from
+    /// multiple threads. An evicted graph stays alive while a shared pointer
+    /// returned by lazy_insn_graph::share() refers to it.
+    class insn_graph_cache {
+    public:
+        explicit insn_graph_cache(size_t budget = 0) : budget_(budget)
+        {
+        }
+
+        insn_graph_cache(const insn_graph_cache&) = delete;
+
+        insn_graph_cache& operator=(const insn_graph_cache&) = delete;
+
+        /// Returns the memory budget in bytes (0 for unlimited).
+        size_t budget() const
+        {
+            return budget_.load(std::memory_order_relaxed);
+        }
+
+        /// Sets the memory budget in bytes (0 for unlimited).
+        void set_budget(size_t budget);
+
+        /// Returns the estimated memory used by the evictable graphs in bytes.
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return size_;
+        }
+
+        /// Returns the number of the evictable graphs.
+        size_t count() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return lru_.size();
+        }
+
+        /// Evicts all the evictable graphs.
+        void clear();
+
+    private:
+        friend class lazy_insn_graph;
+        friend struct detail::lazy_insn_graph_slot;
+
+        void update(detail::lazy_insn_graph_slot* s);
+        void erase(detail::lazy_insn_graph_slot* s);
+        void touch(detail::lazy_insn_graph_slot* s);
+        void shrink(const detail::lazy_insn_graph_slot* keep);
+        void unlink(detail::lazy_insn_graph_slot* s);
+
+        mutable std::mutex mutex_;
+        std::list<detail::lazy_insn_graph_slot*> lru_;
+        std::atomic<size_t> budget_;
+        size_t size_ = 0;
+    };
+
+    namespace detail {
+        /// The state shared by the copies of a lazy_insn_graph.
+        ///
+        /// The graph and the compact graph are read and written with the
+        /// atomic shared_ptr operations so that the cache can evict them
+        /// while other threads read them. The mutex makes sure that only one
+        /// thread builds them. The members below the cache are guarded by
+        /// the mutex of the cache.
+        struct lazy_insn_graph_slot {
+            std::shared_ptr<const insn_graph_source> source;
+            uint32_t code_off = 0;
+            dex_method_hdl hdl;
+            std::mutex mutex;
+            std::shared_ptr<insn_graph> graph;
+            std::shared_ptr<const compact_insn_graph> compact;
+            bool pinned = false;
+            std::atomic<size_t> graph_size{0};
+            std::atomic<size_t> compact_size{0};
+            std::shared_ptr<insn_graph_cache> cache;
+            size_t size = 0;
+            bool cached = false;
+            std::list<lazy_insn_graph_slot*>::iterator lru_it;
+
+            ~lazy_insn_graph_slot();
+        };
+    }
+
+    /// An instruction graph built on the first access.
+    ///
+    /// It behaves like a pointer to an insn_graph. An access through a const
+    /// reference builds the graph from its source if needed and leaves it
+    /// evictable by the cache. An access through a non-const reference pins
+    /// the graph so that the modifications are never lost.
+    ///
+    /// Copies share the graph until one of them is accessed through a
+    /// non-const reference (copy-on-write).
+    ///
+    /// The const accesses may be made from multiple threads. The non-const
+    /// accesses must not be concurrent with any other access.
+    ///
+    /// A graph read through a const reference may be evicted by another
+    /// graph being built, possibly on another thread, so it is only handed
+    /// out as a shared pointer: keep the pointer returned by share() while
+    /// the graph is in use.
+    class lazy_insn_graph {
+    public:
+        /// Creates an empty instruction graph.
+        lazy_insn_graph() = default;
+
+        /// Creates a pinned instruction graph.
+        explicit lazy_insn_graph(insn_graph g);
+
+        /// Creates an instruction graph to be built from the source.
+        lazy_insn_graph(std::shared_ptr<const insn_graph_source> source,
+                        uint32_t code_off, const dex_method_hdl& hdl);
+
+        /// Replaces the instruction graph with a pinned one.
+        lazy_insn_graph& operator=(insn_graph g);
+
+        /// Returns the shared pointer to the graph, which keeps it alive
+        /// until the end of the full expression.
+        std::shared_ptr<const insn_graph> operator->() const
+        {
+            return materialize();
+        }
+
+        insn_graph& operator*()
+        {
+            if (slot_ && slot_->pinned && !slot_->compact
+                && slot_.use_count() == 1) {
+                return *slot_->graph;
+            }
+            return pin();
+        }
+
+        insn_graph* operator->()
+        {
+            return &**this;
+        }
+
+        /// Returns the shared pointer to the graph that stays valid even if
+        /// the graph is evicted.
+        std::shared_ptr<const insn_graph> share() const
+        {
+            return materialize();
+        }
+
+        /// Returns the shared pointer to the compact form of the graph.
+        ///
+        /// The compact graph is made from the graph including the
+        /// modifications, and it always has the def-use edges since the
+        /// analyses running on it cannot add them. It is kept until the graph
+        /// is accessed through a non-const reference or evicted, and it is
+        /// counted in the budget of the cache. Building it does not leave the
+        /// graph built.
+        std::shared_ptr<const compact_insn_graph> share_compact() const;
+
+        /// Returns true if the graph is built.
+        bool materialized() const
+        {
+            return !slot_ || std::atomic_load(&slot_->graph);
+        }
+
+        /// Returns the offset of the code item the graph is built from, or 0
+        /// if it has no source.
+        uint32_t code_off() const
+        {
+            return slot_ && slot_->source ? slot_->code_off : 0;
+        }
+
+        /// Returns true if the graph is pinned.
+        bool pinned() const
+        {
+            return slot_ && slot_->pinned;
+        }
+
+        /// Evicts the graph and its compact form unless it is pinned.
+        void evict();
+
+        /// Makes the graph evictable by the cache.
+        void set_cache(std::shared_ptr<insn_graph_cache> cache);
+
+    private:
+        std::shared_ptr<insn_graph> materialize() const;
+        insn_graph& pin();
+        static const std::shared_ptr<insn_graph>& empty_graph();
+
+        std::shared_ptr<detail::lazy_insn_graph_slot> slot_;
+    };
+
+    /// Returns the shared pointer to the graph in the representation.
+    template <typename InsnGraph>
+    std::shared_ptr<const InsnGraph> share_insn_graph(const lazy_insn_graph& g);
+
+    template <>
+    inline std::shared_ptr<const insn_graph>
+    share_insn_graph<insn_graph>(const lazy_insn_graph& g)
+    {
+        return g.share();
+    }
+
+    template <>
+    inline std::shared_ptr<const compact_insn_graph>
+    share_insn_graph<compact_insn_graph>(const lazy_insn_graph& g)
+    {
+        return g.share_compact();
+    }
+}
+
+#endif
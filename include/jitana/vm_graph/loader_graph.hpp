@@ -51,6 +51,9 @@ namespace jitana {
 
     /// A loader graph property.
     struct loader_graph_property {
+        /// The loader vertices indexed by the class loader handles, or
+        /// null_vertex() if the handle is unused.
+        std::vector<loader_vertex_descriptor> hdl_to_vertex;
     };
 
     /// A loader graph.
@@ -63,8 +66,11 @@ namespace jitana {
     inline boost::optional<loader_vertex_descriptor>
     find_loader_vertex(const class_loader_hdl& hdl, const LoaderGraph& g)
     {
-        for (const auto& v : boost::make_iterator_range(vertices(g))) {
-            if (g[v].loader.hdl() == hdl) {
+        const auto& lut = g[boost::graph_bundle].hdl_to_vertex;
+        const auto idx = unsigned(hdl);
+        if (idx < lut.size()) {
+            auto v = lut[idx];
+            if (v != boost::graph_traits<loader_graph>::null_vertex()) {
                 return v;
             }
         }
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef JITANA_METHOD_DISPATCH_HPP
+#define JITANA_METHOD_DISPATCH_HPP
+
+#include "jitana/vm_graph/class_graph.hpp"
+#include "jitana/vm_graph/method_graph.hpp"
+#include "jitana/util/persistent_vector.hpp"
+
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <boost/range/iterator_range.hpp>
+
+namespace jitana {
+    /// An index of the virtual method dispatch.
+    ///
+    /// It has the methods overriding each method, and the method invoked
+    /// through each vtable slot of each class. The dispatch tables share the
+    /// entries with the table of the superclass.
+    ///
+    /// The graphs only grow, and a class is always added after its
+    /// superclass. update() indexes the added methods and classes only.
+    class method_dispatch {
+    public:
+        method_dispatch() = default;
+
+        method_dispatch(const class_graph& cg, const method_graph& mg)
+        {
+            update(cg, mg);
+        }
+
+        /// Indexes the classes and methods added since the last update.
+        void update(const class_graph& cg, const method_graph& mg);
+
+        /// Returns true if all the classes and methods are indexed.
+        bool is_current(const class_graph& cg, const method_graph& mg) const
+        {
+            return tables_.size() == num_vertices(cg)
+                    && direct_overriders_.size() == num_vertices(mg);
+        }
+
+        /// Returns the methods overriding the method directly or indirectly
+        /// in the depth-first order.
+        ///
+        /// The methods are collected from the direct overriders in time
+        /// linear in the number of them, and the result stays valid after
+        /// the index is updated.
+        std::vector<method_vertex_descriptor>
+        overriding_methods(method_vertex_descriptor v) const;
+
+        /// Returns the method invoked through the vtable slot on an instance
+        /// of the class.
+        boost::optional<method_vertex_descriptor>
+        dispatch(class_vertex_descriptor cv, size_t slot) const
+        {
+            const auto& table = tables_[cv];
+            if (slot < table.size()) {
+                return table[slot];
+            }
+            return boost::none;
+        }
+
+    private:
+        /// The methods directly overriding each method in the order of
+        /// addition.
+        std::vector<std::vector<method_vertex_descriptor>> direct_overriders_;
+        std::vector<persistent_vector<method_vertex_descriptor>> tables_;
+    };
+}
+
+#endif
@@ -18,25 +18,21 @@
 #define JITANA_METHOD_GRAPH_HPP
 
 #include "jitana/vm_graph/insn_graph.hpp"
+#include "jitana/vm_graph/lazy_insn_graph.hpp"
 #include "jitana/vm_graph/graph_common.hpp"
+#include "jitana/vm_graph/layered_graph.hpp"
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <unordered_map>
 
 namespace jitana {
-    namespace detail {
-        using method_graph_traits
-                = boost::adjacency_list_traits<boost::vecS, boost::vecS,
-                                               boost::bidirectionalS>;
-    }
-
     /// A method vertex descriptor.
-    using method_vertex_descriptor
-            = detail::method_graph_traits::vertex_descriptor;
+    using method_vertex_descriptor = std::size_t;
 
     /// A method edge descriptor.
-    using method_edge_descriptor = detail::method_graph_traits::edge_descriptor;
+    using method_edge_descriptor = layered_edge_descriptor;
 
     struct method_param {
         std::string descriptor;
@@ -50,7 +46,7 @@ namespace jitana {
         dex_type_hdl class_hdl;
         dex_access_flags access_flags;
         std::vector<method_param> params;
-        insn_graph insns;
+        lazy_insn_graph insns;
     };
 
     /// A method graph edge property.
@@ -62,36 +58,38 @@ namespace jitana {
                 jvm_hdl_to_vertex;
         std::unordered_map<dex_method_hdl, method_vertex_descriptor>
                 hdl_to_vertex;
+
+        /// The cache of the instruction graphs of the methods.
+        std::shared_ptr<insn_graph_cache> insn_cache
+                = std::make_shared<insn_graph_cache>();
     };
 
+    /// Shares the instruction graph cache with the base.
+    inline method_graph_property
+    make_layer_property(const method_graph_property& base)
+    {
+        method_graph_property x;
+        x.insn_cache = base.insn_cache;
+        return x;
+    }
+
     /// A method graph.
-    using method_graph = boost::adjacency_list<
-            boost::vecS, boost::vecS, boost::bidirectionalS,
-            method_vertex_property, method_edge_property,
-            method_graph_property>;
+    using method_graph
+            = layered_graph<method_vertex_property, method_edge_property,
+                            method_graph_property>;
 
-    template <typename MethodGraph>
     inline boost::optional<method_vertex_descriptor>
-    lookup_method_vertex(const dex_method_hdl& hdl, const MethodGraph& g)
+    lookup_method_vertex(const dex_method_hdl& hdl, const method_graph& g)
     {
-        const auto& lut = g[boost::graph_bundle].hdl_to_vertex;
-        auto it = lut.find(hdl);
-        if (it != end(lut)) {
-            return it->second;
-        }
-        return boost::none;
+        return lookup_layered_vertex(hdl, g,
+                                     &method_graph_property::hdl_to_vertex);
     }
 
-    template <typename MethodGraph>
     inline boost::optional<method_vertex_descriptor>
-    lookup_method_vertex(const jvm_method_hdl& hdl, const MethodGraph& g)
+    lookup_method_vertex(const jvm_method_hdl& hdl, const method_graph& g)
     {
-        const auto& lut = g[boost::graph_bundle].jvm_hdl_to_vertex;
-        auto it = lut.find(hdl);
-        if (it != end(lut)) {
-            return it->second;
-        }
-        return boost::none;
+        return lookup_layered_vertex(hdl, g,
+                                     &method_graph_property::jvm_hdl_to_vertex);
     }
 
     struct method_super_edge_property {
@@ -28,9 +28,10 @@ contextual_call_graph jitana::make_cha_call_graph(
 {
     contextual_call_graph ccg;
 
-    const auto& mg = vm.methods();
-    auto inheritance_mg
-            = make_edge_filtered_graph<method_super_edge_property>(mg);
+    // Read the graph through a const reference so that it works on a sealed
+    // virtual machine too.
+    const auto& cvm = vm;
+    const auto& mg = cvm.methods();
 
     // Copy the entry points.
     {
@@ -56,7 +57,8 @@ contextual_call_graph jitana::make_cha_call_graph(
         // std::cout << "-------------------------------------\n";
         // std::cout << mg[mv].jvm_hdl << "\n";
 
-        const auto& ig = mg[mv].insns;
+        const auto ig_ptr = mg[mv].insns.share();
+        const auto& ig = *ig_ptr;
 
         for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
             const auto* invoke_insn = get<insn_invoke>(&ig[iv].insn);
@@ -70,20 +72,18 @@ contextual_call_graph jitana::make_cha_call_graph(
 
             // std::cout << *invoke_insn << "\n";
             if (auto const_mv = vm.find_method(invoke_insn->const_val, true)) {
-                boost::vector_property_map<int> color_map(
-                        static_cast<unsigned>(num_vertices(inheritance_mg)));
-                auto f = [&](method_vertex_descriptor target_mv,
-                             const decltype(inheritance_mg)&) {
+                auto f = [&](method_vertex_descriptor target_mv) {
                     add_edge(mg[mv].hdl, mg[target_mv].hdl, eprop, ccg);
                     if (!visited[target_mv]) {
                         worklist.push(target_mv);
                         visited[target_mv] = true;
                     }
-                    return false;
                 };
-                boost::depth_first_visit(inheritance_mg, *const_mv,
-                                         boost::default_dfs_visitor{},
-                                         color_map, f);
+                f(*const_mv);
+                for (const auto& target_mv :
+                     vm.dispatch().overriding_methods(*const_mv)) {
+                    f(target_mv);
+                }
             }
         }
     }
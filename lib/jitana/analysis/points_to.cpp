@@ -17,6 +17,7 @@
 #include "jitana/analysis/points_to.hpp"
 #include "jitana/analysis/def_use.hpp"
 #include "jitana/algorithm/unique_sort.hpp"
+#include "jitana/vm_graph/class_hierarchy.hpp"
 
 #include <vector>
 #include <queue>
@@ -50,28 +51,34 @@ namespace std {
 }
 
 namespace {
+    template <typename InsnGraph>
     struct points_to_algorithm_data {
         pointer_assignment_graph& pag;
         contextual_call_graph& ccg;
         virtual_machine& vm;
+        // The graphs are only read, so they are accessed through a const
+        // reference, which works on a sealed virtual machine too.
+        const virtual_machine& cvm;
         bool on_the_fly_cg;
 
-        const insn_graph* ig = nullptr;
+        const InsnGraph* ig = nullptr;
         insn_vertex_descriptor iv;
         dex_insn_hdl insn_hdl;
         dex_insn_hdl context = no_insn_hdl;
 
         std::deque<pag_vertex_descriptor> worklist;
         std::unordered_set<invocation> visited;
+        class_hierarchy hierarchy;
 
         points_to_algorithm_data(pointer_assignment_graph& pag,
                                  contextual_call_graph& ccg,
                                  virtual_machine& vm, bool on_the_fly_cg)
-                : pag(pag), ccg(ccg), vm(vm), on_the_fly_cg(on_the_fly_cg)
+                : pag(pag), ccg(ccg), vm(vm), cvm(vm),
+                  on_the_fly_cg(on_the_fly_cg)
         {
         }
 
-        void move_current_insn(const insn_graph* ig, insn_vertex_descriptor iv)
+        void move_current_insn(const InsnGraph* ig, insn_vertex_descriptor iv)
         {
             points_to_algorithm_data::ig = ig;
             points_to_algorithm_data::iv = iv;
@@ -91,6 +98,34 @@ namespace {
             propagate(dst_v, pag[src_v].points_to_set);
         }
 
+        /// Returns true if the class is the same as, or a subtype of, the
+        /// supertype.
+        bool is_subtype_of(class_vertex_descriptor cv,
+                           class_vertex_descriptor super_cv)
+        {
+            // Index the classes loaded since the last query.
+            hierarchy.update(cvm.classes());
+            return hierarchy.is_subtype_of(cv, super_cv);
+        }
+
+        /// Returns the method invoked on an instance of the class.
+        boost::optional<method_vertex_descriptor>
+        dispatch_method(const dex_type_hdl& type_hdl, jvm_method_hdl jmh)
+        {
+            if (auto cv = vm.find_class(type_hdl, false)) {
+                const auto& slots = *cvm.classes()[*cv].vtable_slots;
+                if (auto slot = slots.find(jmh.unique_name)) {
+                    if (auto mv = vm.dispatch().dispatch(*cv, *slot)) {
+                        return mv;
+                    }
+                }
+            }
+
+            // Not in the vtable: resolve the method by the name.
+            jmh.type_hdl = vm.make_jvm_hdl(type_hdl);
+            return vm.find_method(jmh, false);
+        }
+
     private:
         void propagate(pag_vertex_descriptor dst_v,
                        const std::vector<pag_vertex_descriptor>& out_set)
@@ -114,26 +149,23 @@ namespace {
 }
 
 namespace {
-    template <typename Func>
-    inline void for_each_incoming_reg(points_to_algorithm_data& d_,
+    template <typename InsnGraph, typename Func>
+    inline void for_each_incoming_reg(points_to_algorithm_data<InsnGraph>& d_,
                                       register_idx reg, Func f)
     {
-        using boost::make_iterator_range;
-        using boost::type_erasure::any_cast;
-
         dex_reg_hdl reg_hdl(d_.insn_hdl, reg.value);
 
-        for (const auto& e : make_iterator_range(in_edges(d_.iv, *d_.ig))) {
-            using edge_prop_t = insn_def_use_edge_property;
-            const auto* de = any_cast<const edge_prop_t*>(&(*d_.ig)[e]);
-            if (de != nullptr && de->reg == reg) {
-                reg_hdl.insn_hdl.idx = source(e, *d_.ig);
+        const auto& du_edges = (*d_.ig)[boost::graph_bundle].def_use_edges;
+        for (const auto& e : du_edges.in_edges(d_.iv)) {
+            if (e.prop.reg == reg) {
+                reg_hdl.insn_hdl.idx = e.source;
                 f(reg_hdl);
             }
         }
     }
 
-    inline void add_invoke_edges(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_invoke_edges(points_to_algorithm_data<InsnGraph>& d_,
                                  method_vertex_descriptor mv,
                                  const insn_invoke& insn)
     {
@@ -146,10 +178,11 @@ namespace {
             // d_.propagate_incremental(src_v, dst_v);
         };
 
-        const auto& mg = d_.vm.methods();
+        const auto& mg = d_.cvm.methods();
         const auto& tgt_mvprop = mg[mv];
         const auto& params = tgt_mvprop.params;
-        const auto& tgt_igprop = tgt_mvprop.insns[boost::graph_bundle];
+        auto tgt_ig_ptr = share_insn_graph<InsnGraph>(tgt_mvprop.insns);
+        const auto& tgt_igprop = (*tgt_ig_ptr)[boost::graph_bundle];
 
         if (tgt_mvprop.access_flags & acc_abstract) {
             return;
@@ -220,7 +253,7 @@ namespace {
         auto ret_desc = tgt_mvprop.jvm_hdl.return_descriptor()[0];
         if (ret_desc == 'L' || ret_desc == '[') {
             dex_insn_hdl tgt_exit_insn_hdl(tgt_mvprop.hdl,
-                                           num_vertices(tgt_mvprop.insns) - 1);
+                                           num_vertices(*tgt_ig_ptr) - 1);
             dex_reg_hdl src_reg_hdl(tgt_exit_insn_hdl,
                                     register_idx::idx_result);
             dex_reg_hdl dst_reg_hdl(d_.insn_hdl, register_idx::idx_result);
@@ -233,7 +266,8 @@ namespace {
         }
     }
 
-    inline void add_alloc_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_alloc_edge(points_to_algorithm_data<InsnGraph>& d_,
                                register_idx dst_reg,
                                const boost::optional<dex_type_hdl>& type)
     {
@@ -249,13 +283,13 @@ namespace {
         d_.propagate_all(src_v, dst_v);
     }
 
-    inline void add_assign_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_assign_edge(points_to_algorithm_data<InsnGraph>& d_,
                                 register_idx dst_reg, register_idx src_reg,
                                 const boost::optional<dex_type_hdl>& dst_type
                                 = boost::none)
     {
         using boost::make_iterator_range;
-        using boost::type_erasure::any_cast;
 
         dex_reg_hdl dst_reg_hdl(d_.insn_hdl, dst_reg.value);
 
@@ -277,7 +311,8 @@ namespace {
         });
     }
 
-    inline void add_astore_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_astore_edge(points_to_algorithm_data<InsnGraph>& d_,
                                 register_idx src_reg, register_idx obj_reg,
                                 register_idx /*idx_reg*/)
     {
@@ -300,7 +335,8 @@ namespace {
         });
     }
 
-    inline void add_aload_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_aload_edge(points_to_algorithm_data<InsnGraph>& d_,
                                register_idx dst_reg, register_idx obj_reg,
                                register_idx /*idx_reg*/)
     {
@@ -319,7 +355,8 @@ namespace {
         });
     }
 
-    inline void add_istore_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_istore_edge(points_to_algorithm_data<InsnGraph>& d_,
                                 register_idx src_reg, register_idx obj_reg,
                                 const dex_field_hdl& field_hdl)
     {
@@ -330,7 +367,7 @@ namespace {
             return;
         }
 
-        const auto& fg = d_.vm.fields();
+        const auto& fg = d_.cvm.fields();
         if (fg[*fv].type_char == 'L' || fg[*fv].type_char == '[') {
             for_each_incoming_reg(
                     d_, src_reg, [&](const dex_reg_hdl& src_reg_hdl) {
@@ -357,7 +394,8 @@ namespace {
         }
     }
 
-    inline void add_iload_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_iload_edge(points_to_algorithm_data<InsnGraph>& d_,
                                register_idx dst_reg, register_idx obj_reg,
                                const dex_field_hdl& field_hdl)
     {
@@ -368,7 +406,7 @@ namespace {
             return;
         }
 
-        const auto& fg = d_.vm.fields();
+        const auto& fg = d_.cvm.fields();
         if (fg[*fv].type_char == 'L' || fg[*fv].type_char == '[') {
             dex_reg_hdl dst_reg_hdl(d_.insn_hdl, dst_reg.value);
 
@@ -390,11 +428,12 @@ namespace {
         }
     }
 
-    inline void add_sstore_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_sstore_edge(points_to_algorithm_data<InsnGraph>& d_,
                                 register_idx src_reg,
                                 const dex_field_hdl& field_hdl)
     {
-        const auto& fg = d_.vm.fields();
+        const auto& fg = d_.cvm.fields();
         const auto& fv = d_.vm.find_field(field_hdl, false);
         if (!fv) {
             std::stringstream ss;
@@ -417,11 +456,12 @@ namespace {
         }
     }
 
-    inline void add_sload_edge(points_to_algorithm_data& d_,
+    template <typename InsnGraph>
+    inline void add_sload_edge(points_to_algorithm_data<InsnGraph>& d_,
                                register_idx dst_reg,
                                const dex_field_hdl& field_hdl)
     {
-        const auto& fg = d_.vm.fields();
+        const auto& fg = d_.cvm.fields();
         const auto& fv = d_.vm.find_field(field_hdl, false);
         if (!fv) {
             std::stringstream ss;
@@ -442,9 +482,10 @@ namespace {
 }
 
 namespace {
+    template <typename InsnGraph>
     class pag_insn_visitor : public boost::static_visitor<void> {
     public:
-        pag_insn_visitor(points_to_algorithm_data& d,
+        pag_insn_visitor(points_to_algorithm_data<InsnGraph>& d,
                          std::queue<invocation>& invoc_queue)
                 : d_(d), invoc_queue_(invoc_queue)
         {
@@ -485,7 +526,8 @@ namespace {
                 return;
             }
 
-            add_assign_edge(d_, x.regs[0], x.regs[0], d_.vm.classes()[*cv].hdl);
+            add_assign_edge(d_, x.regs[0], x.regs[0],
+                            d_.cvm.classes()[*cv].hdl);
         }
 
         void operator()(const insn_const_string& x)
@@ -499,7 +541,7 @@ namespace {
                 return;
             }
 
-            add_alloc_edge(d_, x.regs[0], d_.vm.classes()[*cv].hdl);
+            add_alloc_edge(d_, x.regs[0], d_.cvm.classes()[*cv].hdl);
         }
 
         void operator()(const insn_const_class& x)
@@ -513,7 +555,7 @@ namespace {
                 return;
             }
 
-            add_alloc_edge(d_, x.regs[0], d_.vm.classes()[*cv].hdl);
+            add_alloc_edge(d_, x.regs[0], d_.cvm.classes()[*cv].hdl);
         }
 
         void operator()(const insn_new_instance& x)
@@ -527,7 +569,7 @@ namespace {
 
             // Run <clinit> of the target class.
             {
-                const auto& cg = d_.vm.classes();
+                const auto& cg = d_.cvm.classes();
                 auto clinit_mv = d_.vm.find_method(
                         jvm_method_hdl(cg[*cv].jvm_hdl, "<clinit>()V"), false);
                 if (clinit_mv) {
@@ -535,7 +577,7 @@ namespace {
                 }
             }
 
-            add_alloc_edge(d_, x.regs[0], d_.vm.classes()[*cv].hdl);
+            add_alloc_edge(d_, x.regs[0], d_.cvm.classes()[*cv].hdl);
         }
 
         void operator()(const insn_new_array& x)
@@ -551,7 +593,7 @@ namespace {
                 return;
             }
 
-            add_alloc_edge(d_, x.regs[0], d_.vm.classes()[*cv].hdl);
+            add_alloc_edge(d_, x.regs[0], d_.cvm.classes()[*cv].hdl);
 #else
             add_alloc_edge(x.regs[0], boost::none); // x.const_val);
 #endif
@@ -580,7 +622,7 @@ namespace {
                 return;
             }
 
-            add_iload_edge(d_, x.regs[0], x.regs[1], d_.vm.fields()[*fv].hdl);
+            add_iload_edge(d_, x.regs[0], x.regs[1], d_.cvm.fields()[*fv].hdl);
         }
 
         void operator()(const insn_iput& x)
@@ -592,7 +634,7 @@ namespace {
                 return;
             }
 
-            add_istore_edge(d_, x.regs[0], x.regs[1], d_.vm.fields()[*fv].hdl);
+            add_istore_edge(d_, x.regs[0], x.regs[1], d_.cvm.fields()[*fv].hdl);
         }
 
         void operator()(const insn_sget& x)
@@ -606,7 +648,7 @@ namespace {
 
             // Run <clinit> of the target class.
             {
-                const auto& fg = d_.vm.fields();
+                const auto& fg = d_.cvm.fields();
                 auto clinit_mv = d_.vm.find_method(
                         jvm_method_hdl(fg[*fv].jvm_hdl.type_hdl, "<clinit>()V"),
                         false);
@@ -615,7 +657,7 @@ namespace {
                 }
             }
 
-            add_sload_edge(d_, x.regs[0], d_.vm.fields()[*fv].hdl);
+            add_sload_edge(d_, x.regs[0], d_.cvm.fields()[*fv].hdl);
         }
 
         void operator()(const insn_sput& x)
@@ -629,7 +671,7 @@ namespace {
 
             // Run <clinit> of the target class.
             {
-                const auto& fg = d_.vm.fields();
+                const auto& fg = d_.cvm.fields();
                 auto clinit_mv = d_.vm.find_method(
                         jvm_method_hdl(fg[*fv].jvm_hdl.type_hdl, "<clinit>()V"),
                         false);
@@ -638,7 +680,7 @@ namespace {
                 }
             }
 
-            add_sstore_edge(d_, x.regs[0], d_.vm.fields()[*fv].hdl);
+            add_sstore_edge(d_, x.regs[0], d_.cvm.fields()[*fv].hdl);
         }
 
         void operator()(const insn_invoke& x)
@@ -650,7 +692,7 @@ namespace {
                 return;
             }
 
-            const auto& mg = d_.vm.methods();
+            const auto& mg = d_.cvm.methods();
             switch (x.op) {
             case opcode::op_invoke_static:
             case opcode::op_invoke_static_range:
@@ -681,21 +723,15 @@ namespace {
             }
 
             if (!d_.on_the_fly_cg || !info(x.op).can_virtually_invoke()) {
-                auto inheritance_mg
-                        = make_edge_filtered_graph<method_super_edge_property>(
-                                mg);
-
-                boost::vector_property_map<int> color_map(
-                        static_cast<unsigned>(num_vertices(inheritance_mg)));
-                auto f = [&](method_vertex_descriptor v,
-                             const decltype(inheritance_mg)&) {
+                auto f = [&](method_vertex_descriptor v) {
                     invoc_queue_.push({d_.insn_hdl, v});
                     add_invoke_edges(d_, v, x);
-                    return false;
                 };
-                boost::depth_first_visit(inheritance_mg, *mv,
-                                         boost::default_dfs_visitor{},
-                                         color_map, f);
+                f(*mv);
+                for (const auto& v :
+                     d_.vm.dispatch().overriding_methods(*mv)) {
+                    f(v);
+                }
             }
         }
 
@@ -709,10 +745,11 @@ namespace {
         }
 
     private:
-        points_to_algorithm_data& d_;
+        points_to_algorithm_data<InsnGraph>& d_;
         std::queue<invocation>& invoc_queue_;
     };
 
+    template <typename InsnGraph>
     class pag_updater {
     public:
         pag_updater(pointer_assignment_graph& pag, contextual_call_graph& ccg,
@@ -777,21 +814,20 @@ namespace {
                     for (const auto& ih : d_.pag[v].virtual_invoke_insns) {
                         auto mv = *d_.vm.find_method(ih.second.method_hdl,
                                                      false);
-                        const insn_graph& ig = d_.vm.methods()[mv].insns;
+                        auto ig_ptr = share_insn_graph<InsnGraph>(
+                                d_.cvm.methods()[mv].insns);
+                        const InsnGraph& ig = *ig_ptr;
                         insn_vertex_descriptor iv = ih.second.idx;
-                        const auto* insn = get<insn_invoke>(&ig[iv].insn);
+                        const auto& ig_insn = get_insn(ig, iv);
+                        const auto* insn = get<insn_invoke>(&ig_insn);
                         assert(insn);
 
                         // Target JVM method handle.
                         auto target_jmh = d_.vm.make_jvm_hdl(insn->const_val);
 
                         for (const auto& ath : alloc_types) {
-                            // Update the type of the target_jmh to the actual
-                            // one.
-                            target_jmh.type_hdl = d_.vm.make_jvm_hdl(ath);
-
-                            // Process the invoked method.
-                            auto mv = d_.vm.find_method(target_jmh, false);
+                            // Process the method invoked on the actual type.
+                            auto mv = d_.dispatch_method(ath, target_jmh);
                             auto prev_context = d_.context;
                             auto prev_insn_hdl = d_.insn_hdl;
                             auto prev_iv = d_.iv;
@@ -825,12 +861,14 @@ namespace {
                     continue;
                 }
 
-                const auto& mg = d_.vm.methods();
+                const auto& mg = d_.cvm.methods();
                 const auto& tgt_mvprop = mg[invoc.mv];
                 auto src_mv
                         = *d_.vm.find_method(invoc.callsite.method_hdl, false);
                 auto src_iv = invoc.callsite.idx;
-                const auto& src_insn = mg[src_mv].insns[src_iv].insn;
+                auto src_ig_ptr
+                        = share_insn_graph<InsnGraph>(mg[src_mv].insns);
+                const auto& src_insn = get_insn(*src_ig_ptr, src_iv);
 
                 ccg_edge_property eprop;
                 eprop.virtual_call = info(op(src_insn)).can_virtually_invoke();
@@ -858,7 +896,6 @@ namespace {
             // Apply type filtering.
             if (const auto& type = d_.pag[v].type) {
                 if (auto cv = d_.vm.find_class(*type, false)) {
-                    const auto& cg = d_.vm.classes();
                     auto it = std::remove_if(
                             begin(in_set), end(in_set),
                             [&](const pag_vertex_descriptor& alloc_v) {
@@ -871,7 +908,7 @@ namespace {
                                 if (!alloc_cv) {
                                     return false;
                                 }
-                                return !is_superclass_of(*cv, *alloc_cv, cg);
+                                return !d_.is_subtype_of(*alloc_cv, *cv);
                             });
                     in_set.erase(it, end(in_set));
                 }
@@ -895,7 +932,8 @@ namespace {
             struct visitor : boost::static_visitor<void> {
                 visitor(pag_vertex_descriptor dereferencer_v,
                         pag_vertex_descriptor obj_v,
-                        points_to_algorithm_data& d, edge_list& edges_to_add)
+                        points_to_algorithm_data<InsnGraph>& d,
+                        edge_list& edges_to_add)
                         : dereferencer_v_(dereferencer_v),
                           obj_v(obj_v),
                           d_(d),
@@ -916,8 +954,7 @@ namespace {
                     auto& g = d_.pag;
                     auto obj_in_set = d_.pag[obj_v].in_set;
 
-                    const auto& fg = d_.vm.fields();
-                    const auto& cg = d_.vm.classes();
+                    const auto& fg = d_.cvm.fields();
 
                     auto field_hdl = x.field_hdl;
                     auto fv = d_.vm.find_field(field_hdl, false);
@@ -927,7 +964,7 @@ namespace {
                         if (const auto& alloc_type = d_.pag[alloc_v].type) {
                             if (auto alloc_cv
                                 = d_.vm.find_class(*alloc_type, false)) {
-                                if (!is_superclass_of(*cv, *alloc_cv, cg)) {
+                                if (!d_.is_subtype_of(*alloc_cv, *cv)) {
                                     continue;
                                 }
                             }
@@ -990,7 +1027,7 @@ namespace {
             private:
                 pag_vertex_descriptor dereferencer_v_;
                 pag_vertex_descriptor obj_v;
-                points_to_algorithm_data& d_;
+                points_to_algorithm_data<InsnGraph>& d_;
                 edge_list& edges_to_add_;
             };
 
@@ -1055,29 +1092,44 @@ namespace {
                 d_.context = invoc.callsite;
                 auto mv = invoc.mv;
 
-                const auto& mg = d_.vm.methods();
+                const auto& mg = d_.cvm.methods();
                 const auto& mvprop = mg[mv];
-                const auto& ig = mvprop.insns;
+                // Keep the graph alive since the visitor may build the
+                // graphs of the other methods.
+                auto ig_ptr = share_insn_graph<InsnGraph>(mvprop.insns);
+                const auto& ig = *ig_ptr;
 
-                pag_insn_visitor vis(d_, invoc_queue);
+                pag_insn_visitor<InsnGraph> vis(d_, invoc_queue);
                 for (auto iv : boost::make_iterator_range(vertices(ig))) {
                     d_.move_current_insn(&ig, iv);
-                    boost::apply_visitor(vis, ig[iv].insn);
+                    const auto& insn = get_insn(ig, iv);
+                    boost::apply_visitor(vis, insn);
                 }
             }
         }
 
     private:
-        points_to_algorithm_data d_;
+        points_to_algorithm_data<InsnGraph> d_;
     };
 }
 
+template <typename InsnGraph>
 bool jitana::update_points_to_graphs(pointer_assignment_graph& pag,
                                      contextual_call_graph& ccg,
                                      virtual_machine& vm,
                                      const method_vertex_descriptor& mv,
                                      bool on_the_fly_cg)
 {
-    pag_updater updater(pag, ccg, vm, on_the_fly_cg);
+    pag_updater<InsnGraph> updater(pag, ccg, vm, on_the_fly_cg);
     return updater.update(mv);
 }
+
+template bool jitana::update_points_to_graphs<insn_graph>(
+        pointer_assignment_graph& pag, contextual_call_graph& ccg,
+        virtual_machine& vm, const method_vertex_descriptor& mv,
+        bool on_the_fly_cg);
+
+template bool jitana::update_points_to_graphs<compact_insn_graph>(
+        pointer_assignment_graph& pag, contextual_call_graph& ccg,
+        virtual_machine& vm, const method_vertex_descriptor& mv,
+        bool on_the_fly_cg);
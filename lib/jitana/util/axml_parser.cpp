@@ -1857,7 +1857,13 @@ void jitana::read_axml(const std::string& filename,
 {
     boost::iostreams::mapped_file file(filename);
 
-    stream_reader reader(file.begin(), file.end());
+    read_axml(file.begin(), file.end(), pt);
+}
+
+void jitana::read_axml(const void* first, const void* last,
+                       boost::property_tree::ptree& pt)
+{
+    stream_reader reader(first, last);
     axml_parser p(reader, pt);
     p.parse();
 }
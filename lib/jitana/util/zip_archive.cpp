@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/util/zip_archive.hpp"
+#include "jitana/util/stream_reader.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <boost/crc.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+using namespace jitana;
+
+namespace {
+    constexpr uint32_t local_header_signature = 0x04034b50;
+    constexpr uint32_t central_header_signature = 0x02014b50;
+    constexpr uint32_t end_of_central_dir_signature = 0x06054b50;
+
+    constexpr size_t local_header_size = 30;
+    constexpr size_t end_of_central_dir_size = 22;
+
+    [[noreturn]] void throw_error(const std::string& filename,
+                                  const std::string& what)
+    {
+        std::stringstream ss;
+        ss << filename << ": " << what;
+        throw zip_archive_error(ss.str());
+    }
+}
+
+zip_archive::zip_archive(std::string filename)
+        : filename_(std::move(filename)),
+          file_(std::make_shared<boost::iostreams::mapped_file_source>())
+{
+    try {
+        file_->open(filename_);
+        if (!file_->is_open()) {
+            throw std::runtime_error("file is not opened");
+        }
+    }
+    catch (const std::exception&) {
+        std::stringstream ss;
+        ss << "failed to open ";
+        ss << filename_;
+        throw zip_archive_error(ss.str());
+    }
+
+    begin_ = reinterpret_cast<const uint8_t*>(file_->begin());
+    end_ = reinterpret_cast<const uint8_t*>(file_->end());
+
+    try {
+        read_central_directory();
+    }
+    catch (const zip_archive_error&) {
+        throw;
+    }
+    catch (const std::exception& e) {
+        throw_error(filename_, e.what());
+    }
+}
+
+bool zip_archive::is_zip_file(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    char magic[4] = {};
+    return ifs.read(magic, sizeof(magic))
+            && std::equal(magic, magic + 4, "PK\x03\x04");
+}
+
+void zip_archive::read_central_directory()
+{
+    // Find the end of central directory record. It is followed by the
+    // comment of variable length, so search backward from the end.
+    const size_t file_size = end_ - begin_;
+    if (file_size < end_of_central_dir_size) {
+        throw_error(filename_, "too small for a ZIP archive");
+    }
+    const auto* eocd = end_ - end_of_central_dir_size;
+    const auto* eocd_min = end_ - std::min<size_t>(
+                                          file_size, end_of_central_dir_size
+                                                  + 0xffff);
+    stream_reader reader(begin_, end_);
+    for (;; --eocd) {
+        reader.move_head(eocd - begin_);
+        if (reader.get<uint32_t>() == end_of_central_dir_signature) {
+            break;
+        }
+        if (eocd == eocd_min) {
+            throw_error(filename_, "end of central directory is not found");
+        }
+    }
+
+    // Read the end of central directory record.
+    const auto& disk_number = reader.get<uint16_t>();
+    const auto& central_dir_disk_number = reader.get<uint16_t>();
+    reader.get<uint16_t>();
+    const auto& entries_size = reader.get<uint16_t>();
+    const auto& central_dir_size = reader.get<uint32_t>();
+    const auto& central_dir_off = reader.get<uint32_t>();
+    if (disk_number != 0 || central_dir_disk_number != 0) {
+        throw_error(filename_, "multi-disk archive is not supported");
+    }
+    if (entries_size == 0xffff || central_dir_size == 0xffffffff
+        || central_dir_off == 0xffffffff) {
+        throw_error(filename_, "ZIP64 archive is not supported");
+    }
+
+    // Read the central directory.
+    entries_.reserve(entries_size);
+    reader.move_head(central_dir_off);
+    for (unsigned i = 0; i < entries_size; ++i) {
+        if (reader.get<uint32_t>() != central_header_signature) {
+            throw_error(filename_, "invalid central directory header");
+        }
+
+        zip_entry entry;
+        reader.get<uint16_t>(); // Version made by.
+        reader.get<uint16_t>(); // Version needed to extract.
+        entry.flags = reader.get<uint16_t>();
+        entry.method = reader.get<uint16_t>();
+        reader.get<uint16_t>(); // Last modification time.
+        reader.get<uint16_t>(); // Last modification date.
+        entry.crc32 = reader.get<uint32_t>();
+        entry.compressed_size = reader.get<uint32_t>();
+        entry.uncompressed_size = reader.get<uint32_t>();
+        const auto& name_size = reader.get<uint16_t>();
+        const auto& extra_size = reader.get<uint16_t>();
+        const auto& comment_size = reader.get<uint16_t>();
+        reader.get<uint16_t>(); // Disk number start.
+        reader.get<uint16_t>(); // Internal file attributes.
+        reader.get<uint32_t>(); // External file attributes.
+        entry.local_header_off = reader.get<uint32_t>();
+        const auto* name = begin_ + reader.head();
+        reader.move_head_forward(name_size + extra_size + comment_size);
+        entry.name.assign(reinterpret_cast<const char*>(name), name_size);
+
+        entries_.push_back(std::move(entry));
+    }
+}
+
+const zip_entry* zip_archive::find(boost::string_view name) const
+{
+    auto it = std::find_if(begin(entries_), end(entries_),
+                           [&](const zip_entry& e) { return e.name == name; });
+    return it != end(entries_) ? &*it : nullptr;
+}
+
+zip_entry_data zip_archive::read(const zip_entry& entry) const
+{
+    if (entry.flags & 0x1) {
+        throw_error(filename_, entry.name + " is encrypted");
+    }
+
+    // Find the data from the local file header. The extra field may differ
+    // from the one in the central directory.
+    stream_reader reader(begin_, end_);
+    reader.move_head(entry.local_header_off);
+    if (reader.get<uint32_t>() != local_header_signature) {
+        throw_error(filename_, "invalid local file header of " + entry.name);
+    }
+    reader.move_head(entry.local_header_off + local_header_size - 4);
+    const auto& name_size = reader.get<uint16_t>();
+    const auto& extra_size = reader.get<uint16_t>();
+    reader.move_head_forward(name_size + extra_size);
+    const auto* data = begin_ + reader.head();
+    if (entry.compressed_size > size_t(end_ - data)) {
+        throw_error(filename_, "truncated entry " + entry.name);
+    }
+
+    zip_entry_data result;
+    switch (entry.method) {
+    case zip_entry::stored:
+        if (entry.compressed_size != entry.uncompressed_size) {
+            throw_error(filename_, "invalid size of " + entry.name);
+        }
+        if (reinterpret_cast<uintptr_t>(data) % 4 == 0) {
+            // Use the mapped memory directly.
+            result.begin = data;
+            result.end = data + entry.uncompressed_size;
+            result.owner = file_;
+            return result;
+        }
+        else {
+            // Copy the entry that is not aligned by zipalign since the DEX
+            // file parser assumes the 4-byte alignment.
+            auto buf = std::make_shared<std::vector<uint8_t>>(
+                    data, data + entry.uncompressed_size);
+            result.begin = buf->data();
+            result.end = buf->data() + buf->size();
+            result.owner = std::move(buf);
+            return result;
+        }
+    case zip_entry::deflated:
+        break;
+    default:
+        throw_error(filename_, "unsupported compression method of "
+                                       + entry.name);
+    }
+
+    // Inflate the raw deflate stream into a buffer.
+    namespace io = boost::iostreams;
+    auto buf = std::make_shared<std::vector<uint8_t>>(entry.uncompressed_size);
+    try {
+        io::zlib_params params;
+        params.noheader = true;
+        io::filtering_istream is;
+        is.push(io::zlib_decompressor(params));
+        is.push(io::array_source(reinterpret_cast<const char*>(data),
+                                 entry.compressed_size));
+        is.read(reinterpret_cast<char*>(buf->data()), buf->size());
+        if (size_t(is.gcount()) != buf->size() || is.get() != EOF) {
+            throw_error(filename_, "invalid size of " + entry.name);
+        }
+    }
+    catch (const io::zlib_error&) {
+        throw_error(filename_, "failed to inflate " + entry.name);
+    }
+
+    boost::crc_32_type crc;
+    crc.process_bytes(buf->data(), buf->size());
+    if (crc.checksum() != entry.crc32) {
+        throw_error(filename_, "CRC mismatch of " + entry.name);
+    }
+
+    result.begin = buf->data();
+    result.end = buf->data() + buf->size();
+    result.owner = std::move(buf);
+    return result;
+}
@@ -18,21 +18,52 @@
 #include "jitana/vm_core/virtual_machine.hpp"
 #include "jitana/vm_core/dex_file.hpp"
 
+#include <sstream>
+
 using namespace jitana;
 using namespace jitana::detail;
 
-dex_file_hdl class_loader::add_file(const std::string& filename)
+dex_file_hdl
+class_loader::impl::next_file_hdl(const class_loader_hdl& hdl) const
 {
+    if (unsigned(hdl) >= 1u << class_loader_hdl_bits) {
+        std::stringstream ss;
+        ss << "class loader handle is out of range: " << hdl;
+        throw std::runtime_error(ss.str());
+    }
+    if (dex_files.size() >= 1u << dex_file_idx_bits) {
+        std::stringstream ss;
+        ss << "too many DEX files in class loader " << hdl;
+        throw std::runtime_error(ss.str());
+    }
+
     dex_file_hdl file_hdl;
-    file_hdl.loader_hdl = hdl_;
-    file_hdl.idx = uint8_t(impl_->dex_files.size());
-    impl_->dex_files.emplace_back(file_hdl, filename);
+    file_hdl.loader_hdl = hdl;
+    file_hdl.idx = uint16_t(dex_files.size());
+    return file_hdl;
+}
+
+dex_file_hdl class_loader::add_file(const std::string& filename)
+{
+    auto file_hdl = impl_->next_file_hdl(hdl_);
+    impl_->dex_files.emplace_back(file_hdl, filename, impl_->level);
+    return file_hdl;
+}
+
+dex_file_hdl class_loader::add_file(const std::string& filename,
+                                    const uint8_t* file_begin,
+                                    const uint8_t* file_end,
+                                    std::shared_ptr<const void> owner)
+{
+    auto file_hdl = impl_->next_file_hdl(hdl_);
+    impl_->dex_files.emplace_back(file_hdl, filename, file_begin, file_end,
+                                  std::move(owner), impl_->level);
     return file_hdl;
 }
 
 boost::optional<class_vertex_descriptor>
 class_loader::load_class(virtual_machine& vm,
-                         const std::string& descriptor) const
+                         boost::string_view descriptor) const
 {
     // Try to lookup first.
     if (auto v = lookup_class(vm, descriptor)) {
@@ -50,25 +81,69 @@ class_loader::load_class(virtual_machine& vm,
 }
 
 boost::optional<class_vertex_descriptor>
-class_loader::lookup_class(virtual_machine& vm,
-                           const std::string& descriptor) const
+class_loader::lookup_class(const virtual_machine& vm,
+                           boost::string_view descriptor) const
 {
-    return lookup_class_vertex({hdl_, descriptor}, vm.classes());
+    // A class cannot be loaded if its descriptor is not interned yet.
+    auto desc_sym = symbol::find(descriptor);
+    if (!desc_sym) {
+        return boost::none;
+    }
+    return lookup_class_vertex({hdl_, *desc_sym}, vm.classes());
 }
 
 boost::optional<method_vertex_descriptor>
-class_loader::lookup_method(virtual_machine& vm, const std::string& descriptor,
-                            const std::string& unique_name) const
+class_loader::lookup_method(const virtual_machine& vm,
+                            boost::string_view descriptor,
+                            boost::string_view unique_name) const
 {
-    return lookup_method_vertex({{hdl_, descriptor}, unique_name},
-                                vm.methods());
+    auto desc_sym = symbol::find(descriptor);
+    auto name_sym = symbol::find(unique_name);
+    if (!desc_sym || !name_sym) {
+        return boost::none;
+    }
+    const auto type_hdl = jvm_type_hdl{hdl_, *desc_sym};
+    if (auto mv = lookup_method_vertex({type_hdl, *name_sym}, vm.methods())) {
+        return mv;
+    }
+
+    // Resolve the inherited method through the superclasses.
+    const auto& cg = vm.classes();
+    auto cv = lookup_class_vertex(type_hdl, cg);
+    while (cv && (cv = superclass_vertex(*cv, cg))) {
+        if (auto mv = lookup_method_vertex({cg[*cv].jvm_hdl, *name_sym},
+                                           vm.methods())) {
+            return mv;
+        }
+    }
+    return boost::none;
 }
 
 boost::optional<field_vertex_descriptor>
-class_loader::lookup_field(virtual_machine& vm, const std::string& descriptor,
-                           const std::string& name) const
+class_loader::lookup_field(const virtual_machine& vm,
+                           boost::string_view descriptor,
+                           boost::string_view name) const
 {
-    return lookup_field_vertex({{hdl_, descriptor}, name}, vm.fields());
+    auto desc_sym = symbol::find(descriptor);
+    auto name_sym = symbol::find(name);
+    if (!desc_sym || !name_sym) {
+        return boost::none;
+    }
+    const auto type_hdl = jvm_type_hdl{hdl_, *desc_sym};
+    if (auto fv = lookup_field_vertex({type_hdl, *name_sym}, vm.fields())) {
+        return fv;
+    }
+
+    // Resolve the inherited field through the superclasses.
+    const auto& cg = vm.classes();
+    auto cv = lookup_class_vertex(type_hdl, cg);
+    while (cv && (cv = superclass_vertex(*cv, cg))) {
+        if (auto fv = lookup_field_vertex({cg[*cv].jvm_hdl, *name_sym},
+                                          vm.fields())) {
+            return fv;
+        }
+    }
+    return boost::none;
 }
 
 bool class_loader::load_all_classes(virtual_machine& vm) const
@@ -84,6 +159,17 @@ bool class_loader::load_all_classes(virtual_machine& vm) const
     return loaded_all_classes;
 }
 
+bool class_loader::load_all_classes(virtual_machine& vm,
+                                    unsigned num_threads) const
+{
+    std::vector<const dex_file*> files;
+    for (const auto& df : impl_->dex_files) {
+        files.push_back(&df);
+    }
+
+    return dex_file::load_all_classes(vm, files, num_threads);
+}
+
 std::string class_loader::descriptor(const dex_type_hdl& hdl) const
 {
     const auto& dex_file = dex_files()[hdl.file_hdl.idx];
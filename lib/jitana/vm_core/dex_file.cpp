@@ -17,18 +17,145 @@
 #include "jitana/vm_core/dex_file.hpp"
 #include "jitana/vm_core/insn_info.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <thread>
 
 #include <boost/range/iterator_range.hpp>
 
 using namespace jitana;
 using namespace jitana::detail;
 
+/// The body of a class decoded from the DEX file.
+///
+/// It contains everything that can be computed without looking at the other
+/// classes, so it can be decoded concurrently and linked later.
+struct dex_file::class_body {
+    std::vector<field_vertex_property> static_fields;
+    std::vector<field_vertex_property> instance_fields;
+    std::vector<method_vertex_property> direct_methods;
+    std::vector<method_vertex_property> virtual_methods;
+};
+
+/// The source of the instruction graphs of the methods in the DEX file.
+///
+/// It keeps a copy of the DEX file so that the instruction graphs can be built
+/// after the class is loaded. The copy shares the mapping and the lookup
+/// index with the original since the string pool refers to the index.
+class dex_file::insn_source : public insn_graph_source {
+public:
+    explicit insn_source(const dex_file& df) : df_(df)
+    {
+    }
+
+    insn_graph make_insn_graph(uint32_t code_off,
+                               const dex_method_hdl& hdl) const override
+    {
+        return df_.make_insn_graph(code_off, hdl);
+    }
+
+private:
+    dex_file df_;
+};
+
+namespace {
+    uint8_t jvm_sizeof(char c)
+    {
+        switch (c) {
+        case 'V': // void
+        case 'B': // byte
+        case 'Z': // boolean
+            return 1;
+        case 'S': // short
+        case 'C': // char
+            return 2;
+        case 'J': // long
+        case 'D': // double
+            return 8;
+        default:
+            return 4;
+        }
+    }
+
+    enum class dbg_opcode : uint8_t {
+        end_sequence,
+        advance_pc,
+        advance_line,
+        start_local,
+        start_local_extended,
+        end_local,
+        restart_local,
+        set_prologue_end,
+        set_epilogue_begin,
+        set_file,
+        special_opcode_start
+    };
+}
+
+void detail::get_class_data_values(const stream_reader& reader,
+                                   uint64_t fields_size, uint64_t methods_size,
+                                   std::vector<uint32_t>& values)
+{
+    // Each field has two values and each method has three. Check the sizes
+    // before allocating the buffer since each value has at least one byte.
+    const auto n = 2 * fields_size + 3 * methods_size;
+    const auto* end = static_cast<const uint8_t*>(reader.end());
+    const auto* head
+            = static_cast<const uint8_t*>(reader.begin()) + reader.head();
+    if (n > uint64_t(end - head)) {
+        throw std::runtime_error("invalid class_data_item");
+    }
+    values.resize(n);
+    reader.get_uleb128_batch(values.data(), values.size());
+}
+
+trusted_stream_reader detail::validate_debug_info(const stream_reader& reader)
+{
+    auto r = reader;
+
+    // Skip the starting line number and the parameter names.
+    r.skip_uleb128(1);
+    r.skip_uleb128(r.get_uleb128());
+
+    // Skip the bytecode. The sleb128 values have the same length as the
+    // uleb128 values.
+    for (;;) {
+        switch (r.get<dbg_opcode>()) {
+        case dbg_opcode::end_sequence:
+            return trusted_stream_reader(
+                    static_cast<const uint8_t*>(reader.begin())
+                            + reader.head(),
+                    reader.end());
+        case dbg_opcode::advance_pc:
+        case dbg_opcode::advance_line:
+        case dbg_opcode::end_local:
+        case dbg_opcode::restart_local:
+        case dbg_opcode::set_file:
+            r.skip_uleb128(1);
+            break;
+        case dbg_opcode::start_local:
+            r.skip_uleb128(3);
+            break;
+        case dbg_opcode::start_local_extended:
+            r.skip_uleb128(4);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
 dex_file::dex_file(dex_file_hdl hdl, std::string filename,
-                   const uint8_t* file_begin, const uint8_t* file_end)
-        : hdl_(std::move(hdl)), file_(std::make_shared<mapped_file>())
+                   const uint8_t* file_begin, const uint8_t* file_end,
+                   std::shared_ptr<const void> owner, load_level level)
+        : hdl_(std::move(hdl)),
+          level_(level),
+          file_(std::make_shared<mapped_file>())
 {
     file_->name = std::move(filename);
+    file_->owner = std::move(owner);
 
     file_->begin = file_begin;
     file_->end = file_end;
@@ -36,8 +163,10 @@ dex_file::dex_file(dex_file_hdl hdl, std::string filename,
     load_dex_file();
 }
 
-dex_file::dex_file(dex_file_hdl hdl, std::string filename)
-        : hdl_(std::move(hdl)), file_(std::make_shared<mapped_file>())
+dex_file::dex_file(dex_file_hdl hdl, std::string filename, load_level level)
+        : hdl_(std::move(hdl)),
+          level_(level),
+          file_(std::make_shared<mapped_file>())
 {
     file_->name = std::move(filename);
 
@@ -127,74 +256,273 @@ void dex_file::load_dex_file()
     class_defs_ = boost::make_iterator_range(
             class_defs_begin, class_defs_begin + header_->class_defs_size);
 
-    // Compute the lookup tables.
-    for (const auto& def : class_defs_) {
-        // Update the class definition lookup table.
-        class_def_lut_[ids_.descriptor(def.class_idx())] = &def;
+    // Use the sidecar index file if it matches. Otherwise, scan the DEX file.
+    if (auto index = dex_index::open(dex_index::sidecar_filename(file_->name),
+                                     dex_begin_, file_->end)) {
+        index_ = std::move(*index);
+    }
+    else {
+        index_ = build_index();
+    }
+    if (!index_.string_data_offs().empty()) {
+        ids_.string_data_offs_ = index_.string_data_offs().begin();
+    }
+
+    insn_source_ = std::make_shared<insn_source>(*this);
 
-        // Update the code offset lookup table.
-        if (def.class_data_off() != 0) {
-            reader.move_head(def.class_data_off());
+    decoded_bodies_ = std::make_shared<std::vector<std::unique_ptr<class_body>>>(
+            class_defs_.size());
+}
 
-            const auto& static_fields_size = reader.get_uleb128();
-            const auto& instance_fields_size = reader.get_uleb128();
-            const auto& direct_methods_size = reader.get_uleb128();
-            const auto& virtual_methods_size = reader.get_uleb128();
+dex_index dex_file::build_index() const
+{
+    stream_reader reader(dex_begin_, file_->end);
 
-            // Ignore static fields.
-            auto static_field_idx = dex_field_idx{0};
-            for (size_t i = 0; i < static_fields_size; ++i) {
-                static_field_idx += reader.get_uleb128();
-                reader.get_uleb128();
+    // Create the class descriptor hash table.
+    std::vector<dex_index_bucket> buckets(
+            dex_index::buckets_size_for(class_defs_.size()),
+            dex_index_bucket{0, dex_index_bucket::empty_bucket});
+    const auto mask = buckets.size() - 1;
+    for (uint32_t i = 0; i < class_defs_.size(); ++i) {
+        const char* desc = ids_.descriptor(class_defs_[i].class_idx());
+        const auto len = std::strlen(desc);
+        const auto h = dex_index::hash(desc, desc + len);
+        for (auto j = h & mask;; j = (j + 1) & mask) {
+            auto& b = buckets[j];
+            if (b.class_def_idx == dex_index_bucket::empty_bucket) {
+                b = {h, i};
+                break;
             }
-
-            // Ignore instance fields.
-            auto instance_field_idx = dex_field_idx{0};
-            for (size_t i = 0; i < instance_fields_size; ++i) {
-                instance_field_idx += reader.get_uleb128();
-                reader.get_uleb128();
+            if (b.hash == h
+                && std::strcmp(ids_.descriptor(
+                                       class_defs_[b.class_def_idx].class_idx()),
+                               desc)
+                        == 0) {
+                // Duplicated definition: the last one wins.
+                b.class_def_idx = i;
+                break;
             }
+        }
+    }
 
-            auto direct_method_idx = dex_method_idx{0};
-            for (size_t i = 0; i < direct_methods_size; ++i) {
-                direct_method_idx += reader.get_uleb128();
-                reader.get_uleb128();
-                auto code_off = reader.get_uleb128();
-                if (code_off != 0) {
-                    code_off_lut_.emplace_back(code_off, direct_method_idx);
-                }
-            }
+    // Create the code offset table. The number of the method IDs is the
+    // upper bound of the number of the code items.
+    std::vector<dex_code_off_entry> code_offs;
+    code_offs.reserve(header_->method_ids_size);
+    stream_reader code_reader = reader;
+    std::vector<uint32_t> values;
+    for (const auto& def : class_defs_) {
+        if (def.class_data_off() == 0) {
+            continue;
+        }
 
-            auto virtual_method_idx = dex_method_idx{0};
-            for (size_t i = 0; i < virtual_methods_size; ++i) {
-                virtual_method_idx += reader.get_uleb128();
-                reader.get_uleb128();
-                auto code_off = reader.get_uleb128();
+        reader.move_head(def.class_data_off());
+
+        const auto& static_fields_size = reader.get_uleb128();
+        const auto& instance_fields_size = reader.get_uleb128();
+        const auto& direct_methods_size = reader.get_uleb128();
+        const auto& virtual_methods_size = reader.get_uleb128();
+        get_class_data_values(
+                reader, uint64_t(static_fields_size) + instance_fields_size,
+                uint64_t(direct_methods_size) + virtual_methods_size, values);
+
+        // Ignore the fields.
+        const auto* value = values.data()
+                + 2 * (static_fields_size + instance_fields_size);
+
+        auto add_methods = [&](size_t size) {
+            auto method_idx = dex_method_idx{0};
+            for (size_t i = 0; i < size; ++i, value += 3) {
+                method_idx += value[0];
+                auto code_off = value[2];
                 if (code_off != 0) {
-                    code_off_lut_.emplace_back(code_off, virtual_method_idx);
+                    code_reader.move_head(code_off);
+                    const auto& code_header
+                            = code_reader.get<dex_code_header>();
+                    code_offs.push_back(
+                            {code_off, code_header.insns_size, method_idx});
                 }
             }
+        };
+        add_methods(direct_methods_size);
+        add_methods(virtual_methods_size);
+    }
+    std::sort(begin(code_offs), end(code_offs),
+              [](const dex_code_off_entry& lhs, const dex_code_off_entry& rhs) {
+                  return lhs.code_off < rhs.code_off;
+              });
 
-            std::sort(begin(code_off_lut_), end(code_off_lut_));
+    // The string offsets are only computed when the index is saved.
+    return dex_index(std::move(buckets), std::move(code_offs), {});
+}
+
+const dex_class_def*
+dex_file::find_class_def(boost::string_view descriptor) const
+{
+    const auto buckets = index_.buckets();
+    if (buckets.empty()) {
+        return nullptr;
+    }
+
+    const auto h = dex_index::hash(descriptor.data(),
+                                   descriptor.data() + descriptor.size());
+    const auto mask = buckets.size() - 1;
+    for (auto j = h & mask;; j = (j + 1) & mask) {
+        const auto& b = buckets[j];
+        if (b.class_def_idx == dex_index_bucket::empty_bucket) {
+            return nullptr;
+        }
+        if (b.hash == h) {
+            const auto& def = class_defs_[b.class_def_idx];
+            if (descriptor == ids_.descriptor(def.class_idx())) {
+                return &def;
+            }
         }
     }
 }
 
+void dex_file::save_index() const
+{
+    save_index(dex_index::sidecar_filename(file_->name));
+}
+
+void dex_file::save_index(const std::string& filename) const
+{
+    // Add the offsets of the string characters.
+    std::vector<uint32_t> string_data_offs;
+    string_data_offs.reserve(ids_.string_ids_.size());
+    for (uint32_t i = 0; i < ids_.string_ids_.size(); ++i) {
+        auto str = ids_.c_str(i);
+        string_data_offs.push_back(reinterpret_cast<const uint8_t*>(str)
+                                   - dex_begin_);
+    }
+
+    auto buckets = index_.buckets();
+    auto code_offs = index_.code_offs();
+    dex_index index({buckets.begin(), buckets.end()},
+                    {code_offs.begin(), code_offs.end()},
+                    std::move(string_data_offs));
+    index.save(filename, *header_);
+}
+
+dex_file::class_body
+dex_file::decode_class_body(const dex_class_def& def,
+                            bool materialize_insns) const
+{
+    class_body body;
+
+    if (def.class_data_off() == 0) {
+        return body;
+    }
+
+    // Create the handles for this class.
+    auto dex_hdl = dex_type_hdl{hdl_, static_cast<uint32_t>(def.class_idx())};
+    auto jvm_hdl = jvm_type_hdl{hdl_.loader_hdl,
+                                ids_.descriptor(def.class_idx())};
+
+    stream_reader reader(dex_begin_, file_->end);
+    reader.move_head(def.class_data_off());
+
+    const auto& static_fields_size = reader.get_uleb128();
+    const auto& instance_fields_size = reader.get_uleb128();
+    const auto& direct_methods_size = reader.get_uleb128();
+    const auto& virtual_methods_size = reader.get_uleb128();
+    std::vector<uint32_t> values;
+    get_class_data_values(
+            reader, uint64_t(static_fields_size) + instance_fields_size,
+            uint64_t(direct_methods_size) + virtual_methods_size, values);
+    const auto* value = values.data();
+
+    auto decode_fields = [&](std::vector<field_vertex_property>& fields,
+                             size_t size, auto kind) {
+        fields.reserve(size);
+        auto field_idx = dex_field_idx{0};
+        for (size_t i = 0; i < size; ++i) {
+            field_idx += *value++;
+            auto access_flags = make_dex_access_flags(*value++);
+            char type_char = ids_.descriptor(field_idx)[0];
+
+            auto dex_f_hdl
+                    = dex_field_hdl{hdl_, static_cast<uint32_t>(field_idx)};
+            field_vertex_property fvprop;
+            fvprop.kind = kind;
+            fvprop.hdl = dex_f_hdl;
+            fvprop.jvm_hdl = jvm_field_hdl{jvm_hdl, ids_.name(field_idx)};
+            fvprop.class_hdl = dex_hdl;
+            fvprop.access_flags = access_flags;
+            fvprop.offset = 0; // Computed when linked.
+            fvprop.size = jvm_sizeof(type_char);
+            fvprop.type_char = type_char;
+            fields.push_back(std::move(fvprop));
+        }
+    };
+
+    auto decode_methods = [&](std::vector<method_vertex_property>& methods,
+                              size_t size) {
+        methods.resize(size);
+        auto method_idx = dex_method_idx{0};
+        for (auto& mvprop : methods) {
+            method_idx += *value++;
+            auto access_flags = make_dex_access_flags(*value++);
+            auto code_off = *value++;
+            const auto& param_descriptors = ids_.param_descriptors(method_idx);
+
+            auto dex_m_hdl
+                    = dex_method_hdl{hdl_, static_cast<uint32_t>(method_idx)};
+            auto jvm_m_hdl
+                    = jvm_method_hdl{jvm_hdl, ids_.unique_name(method_idx)};
+            mvprop.hdl = dex_m_hdl;
+            mvprop.jvm_hdl = jvm_m_hdl;
+            mvprop.class_hdl = dex_hdl;
+            mvprop.access_flags = access_flags;
+            mvprop.params.reserve(param_descriptors.size());
+            for (const auto& d : param_descriptors) {
+                mvprop.params.emplace_back();
+                mvprop.params.back().descriptor = d;
+            }
+
+            if (level_ == load_level::full) {
+                parse_param_names(mvprop, code_off);
+            }
+
+            // The instructions are loaded when they are accessed first. The
+            // methods without the code have empty graphs, like the abstract
+            // methods.
+            if (level_ == load_level::signatures) {
+                code_off = 0;
+            }
+            mvprop.insns = lazy_insn_graph(insn_source_, code_off, dex_m_hdl);
+            if (materialize_insns) {
+                mvprop.insns.share();
+            }
+        }
+    };
+
+    decode_fields(body.static_fields, static_fields_size,
+                  field_vertex_property::static_field);
+    decode_fields(body.instance_fields, instance_fields_size,
+                  field_vertex_property::instance_field);
+    decode_methods(body.direct_methods, direct_methods_size);
+    decode_methods(body.virtual_methods, virtual_methods_size);
+
+    return body;
+}
+
 boost::optional<class_vertex_descriptor>
-dex_file::load_class(virtual_machine& vm, const std::string& descriptor) const
+dex_file::load_class(virtual_machine& vm, boost::string_view descriptor) const
 {
     // Find the class definition from the lookup table.
-    auto def_it = class_def_lut_.find(descriptor);
-    if (def_it == end(class_def_lut_)) {
+    const auto* def_ptr = find_class_def(descriptor);
+    if (!def_ptr) {
         return boost::none;
     }
-    const auto& def = *def_it->second;
+    const auto& def = *def_ptr;
 
     // Load the super class.
     boost::optional<class_vertex_descriptor> super_v;
     if (def.superclass_idx().valid()) {
         auto super_hdl = dex_type_hdl{
-                hdl_, static_cast<uint16_t>(def.superclass_idx())};
+                hdl_, static_cast<uint32_t>(def.superclass_idx())};
         super_v = vm.find_class(super_hdl, true);
         if (!super_v) {
             return boost::none;
@@ -218,279 +546,119 @@ dex_file::load_class(virtual_machine& vm, const std::string& descriptor) const
         }
     }
 
+    // Use the class body decoded in advance if available.
+    class_body body;
+    auto& decoded = (*decoded_bodies_)[&def - class_defs_.begin()];
+    if (decoded) {
+        body = std::move(*decoded);
+        decoded.reset();
+    }
+    else {
+        body = decode_class_body(def, false);
+    }
+
     // Create the handles for this class.
-    auto dex_hdl = dex_type_hdl{hdl_, static_cast<uint16_t>(def.class_idx())};
+    auto dex_hdl = dex_type_hdl{hdl_, static_cast<uint32_t>(def.class_idx())};
     auto jvm_hdl = jvm_type_hdl{hdl_.loader_hdl, descriptor};
 
     // Create field tables.
-    auto static_fields = std::vector<dex_field_hdl>{};
-    auto instance_fields = std::vector<dex_field_hdl>{};
+    auto static_fields = persistent_vector<dex_field_hdl>{};
+    auto instance_fields = persistent_vector<dex_field_hdl>{};
 
     // Create method tables.
-    auto dtable = std::vector<dex_method_hdl>{}; // For direct methods.
-    auto vtable = std::vector<dex_method_hdl>{}; // For virtual methods (vtbl).
+    auto dtable = persistent_vector<dex_method_hdl>{}; // For direct methods.
+    auto vtable = persistent_vector<dex_method_hdl>{}; // For virtual methods.
+    auto vtable_slots = std::make_shared<vtable_index>();
 
     uint16_t static_offset = 0;
     uint16_t instance_offset = 0;
 
-    // Load the class data.
+    // Link the class data.
     if (def.class_data_off() != 0) {
-        stream_reader reader(dex_begin_, file_->end);
-        reader.move_head(def.class_data_off());
-
         auto& fg = vm.fields();
         auto& mg = vm.methods();
 
-        const auto& static_fields_size = reader.get_uleb128();
-        const auto& instance_fields_size = reader.get_uleb128();
-        const auto& direct_methods_size = reader.get_uleb128();
-        const auto& virtual_methods_size = reader.get_uleb128();
-
-        auto jvm_sizeof = [](char c) -> uint8_t {
-            switch (c) {
-            case 'V': // void
-            case 'B': // byte
-            case 'Z': // boolean
-                return 1;
-            case 'S': // short
-            case 'C': // char
-                return 2;
-            case 'J': // long
-            case 'D': // double
-                return 8;
-            default:
-                return 4;
-            }
-        };
+        // Inherit the tables from the superclass. The entries are shared, and
+        // the JVM handles of the inherited members are resolved through the
+        // superclass on lookup.
+        if (super_v) {
+            const auto& cvm = vm;
+            const auto& super_prop = cvm.classes()[*super_v];
+            static_fields = super_prop.static_fields;
+            instance_fields = super_prop.instance_fields;
+            dtable = super_prop.dtable;
+            vtable = super_prop.vtable;
+            vtable_slots = std::make_shared<vtable_index>(
+                    super_prop.vtable_slots);
+            static_offset = super_prop.static_size;
+            instance_offset = super_prop.instance_size;
+        }
 
         // Create static fields.
-        {
-            if (super_v) {
-                // Inherit the static_fields from the superclass.
-                static_fields = vm.classes()[*super_v].static_fields;
-                static_offset = vm.classes()[*super_v].static_size;
-
-                // Register the JVM handles.
-                for (const auto& field_hdl : static_fields) {
-                    auto fv = lookup_field_vertex(field_hdl, fg);
-                    auto jvm_f_hdl = fg[*fv].jvm_hdl;
-                    jvm_f_hdl.type_hdl = jvm_hdl;
-                    fg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_f_hdl] = *fv;
-                }
-            }
+        for (auto& fvprop : body.static_fields) {
+            // Create a field vertex.
+            fvprop.offset = static_offset;
+            auto fv = add_vertex(std::move(fvprop), fg);
+            fg[boost::graph_bundle].hdl_to_vertex[fg[fv].hdl] = fv;
+            fg[boost::graph_bundle].jvm_hdl_to_vertex[fg[fv].jvm_hdl] = fv;
 
-            auto static_field_idx = dex_field_idx{0};
-            for (size_t i = 0; i < static_fields_size; ++i) {
-                static_field_idx += reader.get_uleb128();
-                auto access_flags = make_dex_access_flags(reader.get_uleb128());
-                const auto& name = ids_.name(static_field_idx);
-                char type_char = ids_.descriptor(static_field_idx)[0];
-                auto size = jvm_sizeof(type_char);
-
-                // Create a field vertex.
-                auto dex_f_hdl = dex_field_hdl{
-                        hdl_, static_cast<uint16_t>(static_field_idx)};
-                auto jvm_f_hdl = jvm_field_hdl{jvm_hdl, name};
-                field_vertex_property fvprop;
-                fvprop.kind = field_vertex_property::static_field;
-                fvprop.hdl = dex_f_hdl;
-                fvprop.jvm_hdl = jvm_f_hdl;
-                fvprop.class_hdl = dex_hdl;
-                fvprop.access_flags = access_flags;
-                fvprop.offset = static_offset;
-                fvprop.size = size;
-                fvprop.type_char = type_char;
-                auto fv = add_vertex(fvprop, fg);
-                fg[boost::graph_bundle].hdl_to_vertex[dex_f_hdl] = fv;
-                fg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_f_hdl] = fv;
-
-                static_fields.push_back(dex_f_hdl);
-
-                static_offset += size;
-            }
+            static_fields.push_back(fg[fv].hdl);
+
+            static_offset += fg[fv].size;
         }
 
         // Create instance fields.
-        {
-            if (super_v) {
-                // Inherit the instance_fields from the superclass.
-                instance_fields = vm.classes()[*super_v].instance_fields;
-                instance_offset = vm.classes()[*super_v].instance_size;
-
-                // Register the JVM handles.
-                for (const auto& field_hdl : instance_fields) {
-                    auto fv = lookup_field_vertex(field_hdl, fg);
-                    auto jvm_f_hdl = fg[*fv].jvm_hdl;
-                    jvm_f_hdl.type_hdl = jvm_hdl;
-                    fg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_f_hdl] = *fv;
-                }
-            }
+        for (auto& fvprop : body.instance_fields) {
+            // Create a field vertex.
+            fvprop.offset = instance_offset;
+            auto fv = add_vertex(std::move(fvprop), fg);
+            fg[boost::graph_bundle].hdl_to_vertex[fg[fv].hdl] = fv;
+            fg[boost::graph_bundle].jvm_hdl_to_vertex[fg[fv].jvm_hdl] = fv;
 
-            auto instance_field_idx = dex_field_idx{0};
-            for (size_t i = 0; i < instance_fields_size; ++i) {
-                instance_field_idx += reader.get_uleb128();
-                auto access_flags = make_dex_access_flags(reader.get_uleb128());
-                const auto& name = ids_.name(instance_field_idx);
-                char type_char = ids_.descriptor(instance_field_idx)[0];
-                auto size = jvm_sizeof(type_char);
-
-                // Create a field vertex.
-                auto dex_f_hdl = dex_field_hdl{
-                        hdl_, static_cast<uint16_t>(instance_field_idx)};
-                auto jvm_f_hdl = jvm_field_hdl{jvm_hdl, name};
-                field_vertex_property fvprop;
-                fvprop.kind = field_vertex_property::instance_field;
-                fvprop.hdl = dex_f_hdl;
-                fvprop.jvm_hdl = jvm_f_hdl;
-                fvprop.class_hdl = dex_hdl;
-                fvprop.access_flags = access_flags;
-                fvprop.offset = instance_offset;
-                fvprop.size = size;
-                fvprop.type_char = type_char;
-                auto fv = add_vertex(fvprop, fg);
-                fg[boost::graph_bundle].hdl_to_vertex[dex_f_hdl] = fv;
-                fg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_f_hdl] = fv;
-
-                instance_fields.push_back(dex_f_hdl);
-
-                instance_offset += size;
-            }
+            instance_fields.push_back(fg[fv].hdl);
+
+            instance_offset += fg[fv].size;
         }
 
         // Create direct methods.
-        {
-            if (super_v) {
-                // Inherit the dtable from the superclass.
-                const auto& super_dtable = vm.classes()[*super_v].dtable;
-                dtable = super_dtable;
-                dtable.reserve(super_dtable.size() + virtual_methods_size);
-
-                // Register the JVM handles.
-                for (const auto& field_hdl : dtable) {
-                    auto mv = lookup_method_vertex(field_hdl, mg);
-                    auto jvm_f_hdl = mg[*mv].jvm_hdl;
-                    jvm_f_hdl.type_hdl = jvm_hdl;
-                    mg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_f_hdl] = *mv;
-                }
-            }
-            else {
-                // No superclass: start with an empty dtable.
-                dtable.reserve(virtual_methods_size);
-            }
-
-            auto direct_method_idx = dex_method_idx{0};
-            for (size_t i = 0; i < direct_methods_size; ++i) {
-                direct_method_idx += reader.get_uleb128();
-                auto access_flags = make_dex_access_flags(reader.get_uleb128());
-                auto code_off = reader.get_uleb128();
-                const auto& unique_name = ids_.unique_name(direct_method_idx);
-                const auto& param_descriptors
-                        = ids_.param_descriptors(direct_method_idx);
-
-                // Create a method vertex.
-                auto dex_m_hdl = dex_method_hdl{
-                        hdl_, static_cast<uint16_t>(direct_method_idx)};
-                auto jvm_m_hdl = jvm_method_hdl{jvm_hdl, unique_name};
-                method_vertex_property mvprop;
-                mvprop.hdl = dex_m_hdl;
-                mvprop.jvm_hdl = jvm_m_hdl;
-                mvprop.class_hdl = dex_hdl;
-                mvprop.access_flags = access_flags;
-                mvprop.params.reserve(param_descriptors.size());
-                for (const auto& d : param_descriptors) {
-                    mvprop.params.emplace_back();
-                    mvprop.params.back().descriptor = d;
-                }
-                auto mv = add_vertex(mvprop, mg);
-                mg[boost::graph_bundle].hdl_to_vertex[dex_m_hdl] = mv;
-                mg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_m_hdl] = mv;
-
-                // Load the instructions.
-                mg[mv].insns = make_insn_graph(mg[mv], code_off, dex_m_hdl,
-                                               jvm_m_hdl);
-
-                dtable.push_back(dex_m_hdl);
-            }
+        for (auto& mvprop : body.direct_methods) {
+            // Create a method vertex.
+            auto mv = add_vertex(std::move(mvprop), mg);
+            mg[mv].insns.set_cache(mg[boost::graph_bundle].insn_cache);
+            mg[boost::graph_bundle].hdl_to_vertex[mg[mv].hdl] = mv;
+            mg[boost::graph_bundle].jvm_hdl_to_vertex[mg[mv].jvm_hdl] = mv;
+
+            dtable.push_back(mg[mv].hdl);
         }
 
         // Create virtual methods.
-        {
-            if (super_v) {
-                // Inherit the vtable from the superclass.
-                const auto& super_vtable = vm.classes()[*super_v].vtable;
-                vtable = super_vtable;
-                vtable.reserve(super_vtable.size() + virtual_methods_size);
-
-                // Register the JVM handles.
-                for (const auto& field_hdl : vtable) {
-                    auto mv = lookup_method_vertex(field_hdl, mg);
-                    auto jvm_f_hdl = mg[*mv].jvm_hdl;
-                    jvm_f_hdl.type_hdl = jvm_hdl;
-                    mg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_f_hdl] = *mv;
+        const auto vtab_inherited_size = vtable.size();
+        for (auto& mvprop : body.virtual_methods) {
+            // Create a method vertex.
+            auto mv = add_vertex(std::move(mvprop), mg);
+            mg[mv].insns.set_cache(mg[boost::graph_bundle].insn_cache);
+            mg[boost::graph_bundle].hdl_to_vertex[mg[mv].hdl] = mv;
+            mg[boost::graph_bundle].jvm_hdl_to_vertex[mg[mv].jvm_hdl] = mv;
+
+            const auto& unique_name = mg[mv].jvm_hdl.unique_name;
+            auto slot = vtable_slots->find(unique_name);
+            if (slot && *slot < vtab_inherited_size) {
+                // Same entry found: override.
+                auto super_mv = lookup_method_vertex(vtable[*slot], mg);
+                if (!super_mv) {
+                    std::stringstream ss;
+                    ss << "invalid DEX file: ";
+                    ss << file_->name;
+                    throw std::runtime_error(ss.str());
                 }
+                method_super_edge_property eprop;
+                eprop.interface = false; // FIXME.
+                add_edge(*super_mv, mv, eprop, mg);
             }
             else {
-                // No superclass: start with an empty vtable.
-                vtable.reserve(virtual_methods_size);
-            }
-
-            const auto vtab_inherited_size = vtable.size();
-            auto virtual_method_idx = dex_method_idx{0};
-            for (size_t i = 0; i < virtual_methods_size; ++i) {
-                virtual_method_idx += reader.get_uleb128();
-                auto access_flags = make_dex_access_flags(reader.get_uleb128());
-                auto code_off = reader.get_uleb128();
-                const auto& unique_name = ids_.unique_name(virtual_method_idx);
-                const auto& param_descriptors
-                        = ids_.param_descriptors(virtual_method_idx);
-
-                // Create a method vertex.
-                auto dex_m_hdl = dex_method_hdl{
-                        hdl_, static_cast<uint16_t>(virtual_method_idx)};
-                auto jvm_m_hdl = jvm_method_hdl{jvm_hdl, unique_name};
-                method_vertex_property mvprop;
-                mvprop.hdl = dex_m_hdl;
-                mvprop.jvm_hdl = jvm_m_hdl;
-                mvprop.class_hdl = dex_hdl;
-                mvprop.access_flags = access_flags;
-                for (const auto& d : param_descriptors) {
-                    mvprop.params.emplace_back();
-                    mvprop.params.back().descriptor = d;
-                }
-                auto mv = add_vertex(mvprop, mg);
-                mg[boost::graph_bundle].hdl_to_vertex[dex_m_hdl] = mv;
-                mg[boost::graph_bundle].jvm_hdl_to_vertex[jvm_m_hdl] = mv;
-
-                // Load the instructions.
-                mg[mv].insns = make_insn_graph(mvprop, code_off, dex_m_hdl,
-                                               jvm_m_hdl);
-
-                const auto vtab_inherited_end
-                        = begin(vtable) + vtab_inherited_size;
-                auto it = std::find_if(begin(vtable), vtab_inherited_end,
-                                       [&](const dex_method_hdl& h) {
-                                           auto v = lookup_method_vertex(h, mg);
-                                           const auto& n
-                                                   = mg[*v].jvm_hdl.unique_name;
-                                           return unique_name == n;
-                                       });
-                if (it != vtab_inherited_end) {
-                    // Same entry found: override.
-                    auto super_v = lookup_method_vertex(*it, mg);
-                    if (!super_v) {
-                        std::stringstream ss;
-                        ss << "invalid DEX file: ";
-                        ss << file_->name;
-                        throw std::runtime_error(ss.str());
-                    }
-                    method_super_edge_property eprop;
-                    eprop.interface = false; // FIXME.
-                    add_edge(*super_v, mv, eprop, mg);
-                }
-                else {
-                    // New entry.
-                    vtable.push_back(dex_m_hdl);
-                }
+                // New entry.
+                vtable_slots->insert(unique_name, vtable.size());
+                vtable.push_back(mg[mv].hdl);
             }
         }
     }
@@ -500,10 +668,11 @@ dex_file::load_class(virtual_machine& vm, const std::string& descriptor) const
     vprop.hdl = dex_hdl;
     vprop.jvm_hdl = jvm_hdl;
     vprop.access_flags = def.access_flags();
-    vprop.instance_fields = instance_fields;
-    vprop.static_fields = static_fields;
-    vprop.dtable = dtable;
-    vprop.vtable = vtable;
+    vprop.instance_fields = std::move(instance_fields);
+    vprop.static_fields = std::move(static_fields);
+    vprop.dtable = std::move(dtable);
+    vprop.vtable = std::move(vtable);
+    vprop.vtable_slots = std::move(vtable_slots);
     vprop.static_size = static_offset;
     vprop.instance_size = instance_offset;
     auto v = add_vertex(vprop, vm.classes());
@@ -537,22 +706,102 @@ bool dex_file::load_all_classes(virtual_machine& vm) const
     return loaded_all_classes;
 }
 
+bool dex_file::load_all_classes(virtual_machine& vm,
+                                const std::vector<const dex_file*>& files,
+                                unsigned num_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Make the list of the classes that are not loaded yet.
+    std::vector<std::pair<const dex_file*, size_t>> work;
+    for (const auto* df : files) {
+        for (size_t i = 0; i < df->class_defs_.size(); ++i) {
+            auto type_hdl = dex_type_hdl(df->hdl_,
+                                         df->class_defs_[i].class_idx().value);
+            if (!lookup_class_vertex(type_hdl, vm.classes())) {
+                work.emplace_back(df, i);
+            }
+        }
+    }
+
+    // Decode the class bodies concurrently. Each thread has its own buffer,
+    // so the work index is the only shared state.
+    using body_buffer
+            = std::vector<std::pair<size_t, std::unique_ptr<class_body>>>;
+    std::vector<body_buffer> buffers(num_threads);
+    std::atomic<size_t> next_work{0};
+    auto decode = [&](body_buffer& buffer) {
+        for (auto i = next_work++; i < work.size(); i = next_work++) {
+            const auto& df = *work[i].first;
+            const auto& def = df.class_defs_[work[i].second];
+            try {
+                buffer.emplace_back(i, std::make_unique<class_body>(
+                                               df.decode_class_body(def, true)));
+            }
+            catch (...) {
+                // Leave it to load_class() to decode the class again and
+                // report the error.
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; ++t) {
+        try {
+            threads.emplace_back(decode, std::ref(buffers[t]));
+        }
+        catch (const std::system_error&) {
+            // Continue with the threads we already have.
+            break;
+        }
+    }
+    decode(buffers[0]);
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Hand the decoded bodies over to the DEX files.
+    for (auto& buffer : buffers) {
+        for (auto& x : buffer) {
+            const auto& w = work[x.first];
+            (*w.first->decoded_bodies_)[w.second] = std::move(x.second);
+        }
+    }
+
+    // Link the classes in the same order as the sequential version so that
+    // the vertex numbering stays the same.
+    bool loaded_all_classes = true;
+    for (const auto* df : files) {
+        if (!df->load_all_classes(vm)) {
+            loaded_all_classes = false;
+        }
+    }
+
+    // Discard the bodies of the classes that could not be linked.
+    for (const auto* df : files) {
+        for (auto& body : *df->decoded_bodies_) {
+            body.reset();
+        }
+    }
+
+    return loaded_all_classes;
+}
+
 boost::optional<std::pair<dex_method_hdl, uint32_t>>
 dex_file::find_method_hdl(uint32_t dex_off) const
 {
-    auto it = std::upper_bound(
-            begin(code_off_lut_), end(code_off_lut_), dex_off,
-            [](uint32_t lhs, const auto& rhs) { return lhs < rhs.first; });
-    if (it == begin(code_off_lut_)) {
+    const auto code_offs = index_.code_offs();
+    auto it = std::upper_bound(code_offs.begin(), code_offs.end(), dex_off,
+                               [](uint32_t lhs, const dex_code_off_entry& rhs) {
+                                   return lhs < rhs.code_off;
+                               });
+    if (it == code_offs.begin()) {
         return boost::none;
     }
     --it;
 
-    // Get the size of the instructions list, in 16-bit code units.
-    auto insns_size
-            = *reinterpret_cast<const uint32_t*>(dex_begin_ + it->first + 12);
-
-    uint32_t insn_off = dex_off - it->first;
+    uint32_t insn_off = dex_off - it->code_off;
     if (insn_off < 16) {
         // The offset is too small, meaning that it points to the code header.
         return boost::none;
@@ -564,23 +813,58 @@ dex_file::find_method_hdl(uint32_t dex_off) const
     // Instruction offset is in 16-bit code unit instead of 8.
     insn_off >>= 1;
 
-    if (insn_off >= insns_size) {
+    if (insn_off >= it->insns_size) {
         // The offset is too big.
         return boost::none;
     }
 
     dex_method_hdl method_hdl;
     method_hdl.file_hdl = hdl_;
-    method_hdl.idx = it->second.value;
+    method_hdl.idx = it->method_idx.value;
 
     return std::make_pair(method_hdl, insn_off);
 }
 
-insn_graph dex_file::make_insn_graph(method_vertex_property& mvprop,
-                                     uint32_t code_off,
-                                     const dex_method_hdl& dex_m_hdl,
-                                     const jvm_method_hdl& jvm_m_hdl) const
+void dex_file::parse_param_names(method_vertex_property& mvprop,
+                                 uint32_t code_off) const
+{
+    if (code_off == 0) {
+        return;
+    }
+
+    stream_reader reader(dex_begin_, file_->end);
+    reader.move_head(code_off);
+    const auto& debug_info_off = reader.get<dex_code_header>().debug_info_off;
+    if (debug_info_off == 0) {
+        return;
+    }
+    reader.move_head(debug_info_off);
+
+    // Skip the starting line number.
+    reader.get_uleb128();
+
+    // Get the parameter names.
+    size_t parameters_size = reader.get_uleb128();
+    if (mvprop.params.size() == parameters_size) {
+        std::vector<uint32_t> values(parameters_size);
+        reader.get_uleb128_batch(values.data(), values.size());
+        for (size_t i = 0; i < parameters_size; ++i) {
+            dex_string_idx param_name_idx = values[i] - 1;
+            if (param_name_idx.valid()) {
+                mvprop.params[i].name = ids_.c_str(param_name_idx);
+            }
+        }
+    }
+}
+
+insn_graph dex_file::make_insn_graph(uint32_t code_off,
+                                     const dex_method_hdl& dex_m_hdl) const
 {
+    dex_method_idx method_idx = dex_m_hdl.idx;
+    auto jvm_m_hdl = jvm_method_hdl{
+            jvm_type_hdl{hdl_.loader_hdl, ids_.class_descriptor(method_idx)},
+            ids_.unique_name(method_idx)};
+
     insn_graph g;
     g[boost::graph_bundle].hdl = dex_m_hdl;
     g[boost::graph_bundle].jvm_hdl = jvm_m_hdl;
@@ -916,8 +1200,8 @@ insn_graph dex_file::make_insn_graph(method_vertex_property& mvprop,
             // const-string vAA, string@BBBB
             {
                 const auto& raw = raw_insn->fmt_21c;
-                // const char* const_val = "STRING";//find_string(raw.idx_b);
-                const char* const_val = ids_.c_str(dex_string_idx(raw.idx_b));
+                dex_string_idx idx(raw.idx_b);
+                dex_string_ref const_val(idx, ids_.c_str(idx));
 
                 prop.insn = insn_const_string(op, {{raw.reg_a}}, const_val);
             }
@@ -926,8 +1210,8 @@ insn_graph dex_file::make_insn_graph(method_vertex_property& mvprop,
             // const-string/jumbo vAA, string@BBBBBBBB
             {
                 const auto& raw = raw_insn->fmt_31c;
-                // const char* const_val = "STRING";//find_string(raw.idx_b);
-                const char* const_val = ids_.c_str(dex_string_idx(raw.idx_b));
+                dex_string_idx idx(raw.idx_b);
+                dex_string_ref const_val(idx, ids_.c_str(idx));
 
                 prop.insn = insn_const_string(op, {{raw.reg_a}}, const_val);
             }
@@ -1759,50 +2043,33 @@ insn_graph dex_file::make_insn_graph(method_vertex_property& mvprop,
         }
     }
 
-    parse_debug_info(g, mvprop, raw_header->debug_info_off);
+    if (level_ == load_level::full) {
+        parse_debug_info(g, raw_header->debug_info_off);
+    }
 
     return g;
 }
 
-void dex_file::parse_debug_info(insn_graph& g, method_vertex_property& mvprop,
-                                uint32_t debug_info_off) const
+void dex_file::parse_debug_info(insn_graph& g, uint32_t debug_info_off) const
 {
     if (debug_info_off == 0) {
         return;
     }
 
-    // Create a stream reader.
-    stream_reader reader(dex_begin_, file_->end);
-    reader.move_head(debug_info_off);
+    // Create a stream reader. The whole item is validated first so that the
+    // bytecode can be executed without checking the range.
+    stream_reader checked_reader(dex_begin_, file_->end);
+    checked_reader.move_head(debug_info_off);
+    auto reader = validate_debug_info(checked_reader);
 
     // Get the starting line number.
     uint32_t line_start = reader.get_uleb128();
 
-    // Get the parameter names.
-    size_t parameters_size = reader.get_uleb128();
-    if (mvprop.params.size() == parameters_size) {
-        for (size_t i = 0; i < parameters_size; ++i) {
-            dex_string_idx param_name_idx = reader.get_uleb128p1();
-            if (param_name_idx.valid()) {
-                mvprop.params[i].name = ids_.c_str(param_name_idx);
-            }
-        }
-    }
+    // Skip the parameter names. They are read by parse_param_names().
+    reader.skip_uleb128(reader.get_uleb128());
 
-    // Opcode.
-    enum class dbg_opcode : uint8_t {
-        end_sequence,
-        advance_pc,
-        advance_line,
-        start_local,
-        start_local_extended,
-        end_local,
-        restart_local,
-        set_prologue_end,
-        set_epilogue_begin,
-        set_file,
-        special_opcode_start
-    };
+    // The operands of the opcodes.
+    uint32_t operands[4];
 
     bool line_num_valid = true;
 
@@ -1830,18 +2097,22 @@ void dex_file::parse_debug_info(insn_graph& g, method_vertex_property& mvprop,
             break;
         case dbg_opcode::start_local:
             // Introduce a local variable at the current address.
+            reader.get_uleb128_batch(operands, 3);
             break;
         case dbg_opcode::start_local_extended:
             // Introduce a local with a type signature at the current address.
+            reader.get_uleb128_batch(operands, 4);
             break;
         case dbg_opcode::end_local:
             // Mark the currently-live local variable as out of scope at the
             // current address.
+            reader.get_uleb128();
             break;
         case dbg_opcode::restart_local:
             // Re-introduce a local variable at the current address. The name
             // and type are the same as the last local that was live in the
             // specified register.
+            reader.get_uleb128();
             break;
         case dbg_opcode::set_prologue_end:
             // Set the prologue_end state machine register, indicating that the
@@ -1863,6 +2134,7 @@ void dex_file::parse_debug_info(insn_graph& g, method_vertex_property& mvprop,
             {
                 // For now, we ignore set_file. So invalidate the line numbers
                 // from now on.
+                reader.get_uleb128p1();
                 line_num_valid = false;
             }
             break;
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_core/dex_index.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+using namespace jitana;
+using namespace jitana::detail;
+
+namespace {
+    constexpr uint8_t index_magic[8] = {'j', 'i', 'd', 'x', '\n', '0', '0', '1'};
+
+    /// Returns the range of the section if it is within the file.
+    template <typename T>
+    boost::optional<boost::iterator_range<const T*>>
+    get_section(const uint8_t* begin, size_t file_size, uint32_t off,
+                uint32_t size)
+    {
+        if (off % alignof(T) != 0
+            || uint64_t(off) + uint64_t(size) * sizeof(T) > file_size) {
+            return boost::none;
+        }
+        auto first = reinterpret_cast<const T*>(begin + off);
+        return boost::make_iterator_range(first, first + size);
+    }
+}
+
+struct dex_index::storage {
+    std::vector<dex_index_bucket> buckets;
+    std::vector<dex_code_off_entry> code_offs;
+    std::vector<uint32_t> string_data_offs;
+    boost::iostreams::mapped_file_source file;
+};
+
+dex_index::dex_index() : dex_index({}, {}, {})
+{
+}
+
+dex_index::dex_index(std::vector<dex_index_bucket> buckets,
+                     std::vector<dex_code_off_entry> code_offs,
+                     std::vector<uint32_t> string_data_offs)
+{
+    auto s = std::make_shared<storage>();
+    s->buckets = std::move(buckets);
+    s->code_offs = std::move(code_offs);
+    s->string_data_offs = std::move(string_data_offs);
+
+    buckets_ = boost::make_iterator_range(s->buckets.data(),
+                                          s->buckets.data()
+                                                  + s->buckets.size());
+    code_offs_ = boost::make_iterator_range(s->code_offs.data(),
+                                            s->code_offs.data()
+                                                    + s->code_offs.size());
+    string_data_offs_ = boost::make_iterator_range(
+            s->string_data_offs.data(),
+            s->string_data_offs.data() + s->string_data_offs.size());
+    storage_ = std::move(s);
+}
+
+boost::optional<dex_index> dex_index::open(const std::string& filename,
+                                           const uint8_t* dex_begin,
+                                           const uint8_t* dex_end)
+{
+    if (size_t(dex_end - dex_begin) < sizeof(dex_header)) {
+        return boost::none;
+    }
+    const auto& header = *reinterpret_cast<const dex_header*>(dex_begin);
+    const auto dex_size = size_t(dex_end - dex_begin);
+
+    auto s = std::make_shared<storage>();
+    try {
+        s->file.open(filename);
+    }
+    catch (const std::exception&) {
+        // No sidecar index file.
+        return boost::none;
+    }
+    if (!s->file.is_open() || s->file.size() < sizeof(dex_index_header)) {
+        return boost::none;
+    }
+
+    const auto* begin = reinterpret_cast<const uint8_t*>(s->file.data());
+    const auto file_size = s->file.size();
+    const auto& h = *reinterpret_cast<const dex_index_header*>(begin);
+
+    // Check if the index is made from the same DEX file.
+    if (std::memcmp(h.magic, index_magic, sizeof(index_magic)) != 0
+        || std::memcmp(h.signature, header.signature, sizeof(h.signature))
+                != 0
+        || h.dex_file_size != header.file_size
+        || h.class_defs_size != header.class_defs_size
+        || h.string_ids_size != header.string_ids_size) {
+        return boost::none;
+    }
+
+    auto buckets = get_section<dex_index_bucket>(begin, file_size,
+                                                 h.buckets_off, h.buckets_size);
+    auto code_offs = get_section<dex_code_off_entry>(
+            begin, file_size, h.code_offs_off, h.code_offs_size);
+    auto string_data_offs = get_section<uint32_t>(
+            begin, file_size, h.string_data_offs_off, h.string_data_offs_size);
+    if (!buckets || !code_offs || !string_data_offs) {
+        return boost::none;
+    }
+
+    // Validate the tables so that a broken index file never makes us read
+    // outside of the DEX file. The offsets are checked against the mapped
+    // extent since the size in the header is not trusted either.
+    if (h.buckets_size <= h.class_defs_size
+        || (h.buckets_size & (h.buckets_size - 1)) != 0) {
+        return boost::none;
+    }
+    for (const auto& b : *buckets) {
+        if (b.class_def_idx != dex_index_bucket::empty_bucket
+            && b.class_def_idx >= h.class_defs_size) {
+            return boost::none;
+        }
+    }
+    uint32_t prev_code_off = 0;
+    for (const auto& e : *code_offs) {
+        if (e.code_off < prev_code_off
+            || uint64_t(e.code_off) + 16 + uint64_t(e.insns_size) * 2
+                    > dex_size
+            || e.method_idx.value >= header.method_ids_size) {
+            return boost::none;
+        }
+        prev_code_off = e.code_off;
+    }
+    if (!string_data_offs->empty()) {
+        if (h.string_data_offs_size != h.string_ids_size) {
+            return boost::none;
+        }
+        // A string is read up to the NUL character, so it must start at or
+        // before the last NUL character in the DEX file.
+        const auto* last_nul = dex_end;
+        while (last_nul != dex_begin && *(last_nul - 1) != '\0') {
+            --last_nul;
+        }
+        const auto max_off = size_t(last_nul - dex_begin);
+        for (const auto& off : *string_data_offs) {
+            if (off >= max_off) {
+                return boost::none;
+            }
+        }
+    }
+
+    dex_index index;
+    index.buckets_ = *buckets;
+    index.code_offs_ = *code_offs;
+    index.string_data_offs_ = *string_data_offs;
+    index.storage_ = std::move(s);
+    return index;
+}
+
+void dex_index::save(const std::string& filename,
+                     const dex_header& header) const
+{
+    dex_index_header h;
+    std::memcpy(h.magic, index_magic, sizeof(index_magic));
+    std::memcpy(h.signature, header.signature, sizeof(h.signature));
+    h.dex_file_size = header.file_size;
+    h.class_defs_size = header.class_defs_size;
+    h.string_ids_size = header.string_ids_size;
+
+    // All the sections are 4-byte aligned since every entry is made of
+    // 32-bit words.
+    uint32_t off = sizeof(dex_index_header);
+    h.buckets_size = buckets_.size();
+    h.buckets_off = off;
+    off += h.buckets_size * sizeof(dex_index_bucket);
+    h.code_offs_size = code_offs_.size();
+    h.code_offs_off = off;
+    off += h.code_offs_size * sizeof(dex_code_off_entry);
+    h.string_data_offs_size = string_data_offs_.size();
+    h.string_data_offs_off = off;
+
+    // Write to a temporary file first so that a reader never sees a
+    // partially written index.
+    const auto tmp_filename = filename + ".tmp";
+    {
+        std::ofstream ofs(tmp_filename, std::ios::binary | std::ios::trunc);
+        auto write = [&](const auto& range) {
+            ofs.write(reinterpret_cast<const char*>(range.begin()),
+                      range.size() * sizeof(*range.begin()));
+        };
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        write(buckets_);
+        write(code_offs_);
+        write(string_data_offs_);
+        if (!ofs) {
+            std::stringstream ss;
+            ss << "failed to write ";
+            ss << tmp_filename;
+            throw std::runtime_error(ss.str());
+        }
+    }
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        std::remove(tmp_filename.c_str());
+        std::stringstream ss;
+        ss << "failed to write ";
+        ss << filename;
+        throw std::runtime_error(ss.str());
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_core/symbol.hpp"
+
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace jitana;
+using namespace jitana::detail;
+
+namespace {
+    /// A key of the symbol lookup table with the precomputed hash value.
+    struct symbol_key {
+        boost::string_view str;
+        size_t hash;
+
+        friend bool operator==(const symbol_key& x, const symbol_key& y)
+        {
+            return x.str == y.str;
+        }
+    };
+
+    struct symbol_key_hash {
+        size_t operator()(const symbol_key& x) const
+        {
+            return x.hash;
+        }
+    };
+
+    /// The table mapping the strings to the symbol IDs.
+    ///
+    /// It is split into the shards with their own locks so that the threads
+    /// loading classes concurrently rarely wait for each other.
+    class symbol_lookup_table {
+    public:
+        boost::optional<uint32_t> find(const symbol_key& key)
+        {
+            auto& s = shard_for(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.ids.find(key);
+            if (it == end(s.ids)) {
+                return boost::none;
+            }
+            return it->second;
+        }
+
+        uint32_t insert(const symbol_key& key)
+        {
+            auto& s = shard_for(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.ids.find(key);
+            if (it != end(s.ids)) {
+                return it->second;
+            }
+
+            auto id = next_id_++;
+            if (id >= symbol_entry_table::max_blocks
+                               * symbol_entry_table::block_size) {
+                throw std::runtime_error("too many symbols");
+            }
+            const auto* entry
+                    = new symbol_entry{key.hash, std::string(key.str)};
+            publish(id, entry);
+
+            s.ids.emplace(symbol_key{entry->str, key.hash}, id);
+            return id;
+        }
+
+    private:
+        struct shard {
+            std::mutex mutex;
+            std::unordered_map<symbol_key, uint32_t, symbol_key_hash> ids;
+        };
+
+        shard& shard_for(const symbol_key& key)
+        {
+            // Use the upper bits since the lower bits select the buckets.
+            return shards_[(key.hash >> 16) % n_shards];
+        }
+
+        void publish(uint32_t id, const symbol_entry* entry)
+        {
+            auto& table = symbol_entries();
+            auto& block_ptr
+                    = table.blocks_[id >> symbol_entry_table::block_bits];
+            auto block = block_ptr.load(std::memory_order_acquire);
+            if (!block) {
+                // Allocate a new block. Another thread may have allocated it
+                // for a different ID in the same block.
+                auto new_block = new const symbol_entry*
+                        [symbol_entry_table::block_size]{};
+                if (block_ptr.compare_exchange_strong(
+                            block, new_block, std::memory_order_acq_rel)) {
+                    block = new_block;
+                }
+                else {
+                    delete[] new_block;
+                }
+            }
+            block[id & (symbol_entry_table::block_size - 1)] = entry;
+        }
+
+        static constexpr size_t n_shards = 64;
+        shard shards_[n_shards];
+
+        // The ID 0 is reserved for the empty string.
+        std::atomic<uint32_t> next_id_{1};
+    };
+
+    symbol_lookup_table& symbol_lookup()
+    {
+        static symbol_lookup_table table;
+        return table;
+    }
+}
+
+symbol::symbol(boost::string_view s)
+{
+    if (!s.empty()) {
+        id_ = symbol_lookup().insert({s, symbol_hash(s)});
+    }
+}
+
+boost::optional<symbol> symbol::find(boost::string_view s)
+{
+    if (s.empty()) {
+        return symbol();
+    }
+
+    if (auto id = symbol_lookup().find({s, symbol_hash(s)})) {
+        return from_id(*id);
+    }
+    return boost::none;
+}
@@ -15,12 +15,18 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/depth_first_search.hpp>
 
 #include "jitana/vm_core/virtual_machine.hpp"
 #include "jitana/vm_core/dex_file.hpp"
+#include "jitana/util/zip_archive.hpp"
 #include "jitana/vm_graph/edge_filtered_graph.hpp"
 
 using namespace jitana;
@@ -28,9 +34,32 @@ using namespace jitana::detail;
 
 loader_vertex_descriptor virtual_machine::add_loader(class_loader loader)
 {
+    throw_if_sealed();
+
+    // The handle indexes the lookup table, so it must fit in the packed
+    // layout even if the loader has no DEX files yet.
+    const auto idx = unsigned(loader.hdl());
+    if (idx >= 1u << class_loader_hdl_bits) {
+        std::stringstream ss;
+        ss << "class loader handle is out of range: " << loader.hdl();
+        throw std::runtime_error(ss.str());
+    }
+
     loader_vertex_property vp;
     vp.loader = std::move(loader);
-    return add_vertex(vp, loaders_);
+    auto v = add_vertex(vp, write_loaders());
+
+    // Register the handle unless it is already used by another loader.
+    auto& lut = write_loaders()[boost::graph_bundle].hdl_to_vertex;
+    const auto null_v = boost::graph_traits<loader_graph>::null_vertex();
+    if (idx >= lut.size()) {
+        lut.resize(idx + 1, null_v);
+    }
+    if (lut[idx] == null_v) {
+        lut[idx] = v;
+    }
+
+    return v;
 }
 
 loader_vertex_descriptor
@@ -38,28 +67,173 @@ virtual_machine::add_loader(class_loader loader,
                             const class_loader_hdl& parent_hdl)
 {
     auto v = add_loader(loader);
-    auto p = find_loader_vertex(parent_hdl, loaders_);
-    add_edge(v, *p, loader_parent_edge_property(), loaders_);
+    auto p = find_loader_vertex(parent_hdl, *loaders_);
+    add_edge(v, *p, loader_parent_edge_property(), write_loaders());
     return v;
 }
 
 loader_vertex_descriptor
 virtual_machine::add_apk(const class_loader_hdl& hdl,
-                         const std::string& apk_dir,
+                         const std::string& apk_path,
                          const class_loader_hdl& parent_hdl)
 {
-    apk_info info(apk_dir);
+    if (!zip_archive::is_zip_file(apk_path)) {
+        // The directory where the APK is extracted.
+        apk_info info(apk_path);
+
+        const auto& filenames = {apk_path + "/classes.dex"};
+        class_loader loader(hdl, info.package_name(), begin(filenames),
+                            end(filenames));
+
+        auto v = add_loader(loader, parent_hdl);
+        write_loaders()[v].info = std::move(info);
+
+        return v;
+    }
 
-    const auto& filenames = {apk_dir + "/classes.dex"};
+    zip_archive apk(apk_path);
+    apk_info info(apk);
+
+    const std::vector<std::string> filenames;
     class_loader loader(hdl, info.package_name(), begin(filenames),
                         end(filenames));
 
+    // Add the DEX files in the same order as the runtime: classes.dex,
+    // classes2.dex, and so on until the first missing one.
+    for (int i = 1;; ++i) {
+        const auto name = i == 1 ? std::string("classes.dex")
+                                 : "classes" + std::to_string(i) + ".dex";
+        const auto* entry = apk.find(name);
+        if (!entry) {
+            break;
+        }
+        auto data = apk.read(*entry);
+        loader.add_file(apk_path + "!/" + name, data.begin, data.end,
+                        std::move(data.owner));
+    }
+
     auto v = add_loader(loader, parent_hdl);
-    loaders_[v].info = std::move(info);
+    write_loaders()[v].info = std::move(info);
 
     return v;
 }
 
+dex_file_hdl virtual_machine::add_dex_file(const class_loader_hdl& loader_hdl,
+                                           const std::string& filename)
+{
+    throw_if_sealed();
+
+    auto lv = find_loader_vertex(loader_hdl, *loaders_);
+    if (!lv) {
+        std::stringstream ss;
+        ss << "invalid loader handle ";
+        ss << loader_hdl;
+        throw std::runtime_error(ss.str());
+    }
+    return write_loaders()[*lv].loader.add_file(filename);
+}
+
+void virtual_machine::seal()
+{
+    // Compute everything the lookups need now so that they never modify the
+    // cache.
+    for (const auto& v : boost::make_iterator_range(vertices(*loaders_))) {
+        delegation_chain(v);
+    }
+    dispatch();
+    sealed_ = true;
+}
+
+void virtual_machine::set_insn_graph_budget(size_t budget)
+{
+    if (insn_cache_owner_.use_count() != 1) {
+        throw std::runtime_error("the instruction graph cache is shared with "
+                                 "another virtual machine");
+    }
+    const auto& mg = methods_;
+    mg[boost::graph_bundle].insn_cache->set_budget(budget);
+}
+
+void virtual_machine::throw_if_sealed() const
+{
+    if (sealed_) {
+        throw std::runtime_error("the virtual machine is sealed");
+    }
+}
+
+const method_dispatch& virtual_machine::dispatch()
+{
+    const auto& cg = classes_;
+    const auto& mg = methods_;
+    if (!sealed_ && !dispatch_->is_current(cg, mg)) {
+        dispatch_.write().update(cg, mg);
+    }
+    return *dispatch_;
+}
+
+virtual_machine virtual_machine::fork() const
+{
+    // The resolution cache is rebuilt by the fork instead of being copied.
+    virtual_machine vm;
+    vm.loaders_ = loaders_;
+    vm.classes_ = classes_.fork();
+    vm.methods_ = methods_.fork();
+    vm.fields_ = fields_.fork();
+    vm.dispatch_ = dispatch_;
+    vm.loaders_generation_ = loaders_generation_;
+    vm.insn_cache_owner_ = insn_cache_owner_;
+    return vm;
+}
+
+const std::vector<loader_vertex_descriptor>&
+virtual_machine::delegation_chain(loader_vertex_descriptor v)
+{
+    if (sealed_) {
+        return resolution_cache_.delegation_chains[v];
+    }
+
+    auto& chain = valid_resolution_cache().delegation_chains[v];
+    if (chain.empty()) {
+        // Visit the loaders in the depth-first order.
+        std::vector<bool> visited(num_vertices(*loaders_));
+        std::vector<loader_vertex_descriptor> stack = {v};
+        while (!stack.empty()) {
+            auto u = stack.back();
+            stack.pop_back();
+            if (visited[u]) {
+                continue;
+            }
+            visited[u] = true;
+            chain.push_back(u);
+
+            // Push the parents in reverse so that the first one is visited
+            // first. The other edges are added by the analyses.
+            auto first = stack.size();
+            for (const auto& e : boost::make_iterator_range(
+                         out_edges(u, *loaders_))) {
+                if (edge_cast<loader_parent_edge_property>(&(*loaders_)[e])) {
+                    stack.push_back(target(e, *loaders_));
+                }
+            }
+            std::reverse(begin(stack) + first, end(stack));
+        }
+    }
+    return chain;
+}
+
+virtual_machine::resolution_cache& virtual_machine::valid_resolution_cache()
+{
+    // The caches are made for the loader graph with the DEX files. Start over
+    // if it may have been modified since then.
+    auto& cache = resolution_cache_;
+    if (cache.loaders_generation != loaders_generation_) {
+        cache = resolution_cache();
+        cache.loaders_generation = loaders_generation_;
+        cache.delegation_chains.resize(num_vertices(*loaders_));
+    }
+    return cache;
+}
+
 boost::optional<class_vertex_descriptor>
 virtual_machine::find_class(const jvm_type_hdl& hdl, bool try_load)
 {
@@ -68,44 +242,39 @@ virtual_machine::find_class(const jvm_type_hdl& hdl, bool try_load)
         return cv;
     }
 
+    if (sealed_) {
+        try_load = false;
+    }
+
     // Find the starting class loader vertex.
-    auto lv = find_loader_vertex(hdl.loader_hdl, loaders_);
+    auto lv = find_loader_vertex(hdl.loader_hdl, *loaders_);
     if (!lv) {
         // Invalid loader handle.
         return boost::none;
     }
 
-    // Find the class.
-    struct class_finder : boost::default_dfs_visitor {
-        virtual_machine& vm;
-        const jvm_type_hdl& hdl;
-        bool try_load;
-
-        class_finder(virtual_machine& vm, const jvm_type_hdl& hdl,
-                     bool try_load)
-                : vm(vm), hdl(hdl), try_load(try_load)
-        {
-        }
+    // Don't search again if it has failed to load.
+    auto& cache = sealed_ ? resolution_cache_ : valid_resolution_cache();
+    if (cache.missing_classes.count(hdl)) {
+        return boost::none;
+    }
 
-        void discover_vertex(const loader_vertex_descriptor& v,
-                             const loader_graph& g)
-        {
-            if (auto found_class = try_load
-                        ? g[v].loader.load_class(vm, hdl.descriptor)
-                        : g[v].loader.lookup_class(vm, hdl.descriptor)) {
-                throw *found_class;
+    // Find the class.
+    for (const auto& v : delegation_chain(*lv)) {
+        const auto& loader = (*loaders_)[v].loader;
+        if (auto cv = try_load ? loader.load_class(*this, hdl.descriptor)
+                               : loader.lookup_class(*this, hdl.descriptor)) {
+            // Class found: remember the initiating handle, and return.
+            if (!sealed_) {
+                classes_[boost::graph_bundle].jvm_hdl_to_vertex[hdl]
+                        = *cv;
             }
+            return cv;
         }
-    } vis(*this, hdl, try_load);
-    boost::vector_property_map<int> color_map(
-            static_cast<unsigned>(num_vertices(loaders_)));
-    try {
-        boost::depth_first_visit(loaders_, *lv, vis, color_map);
     }
-    catch (const class_vertex_descriptor& cv) {
-        // Class found: remember the initiating handle, and return.
-        classes_[boost::graph_bundle].jvm_hdl_to_vertex[hdl] = cv;
-        return cv;
+
+    if (try_load) {
+        cache.missing_classes.insert(hdl);
     }
 
     return boost::none;
@@ -121,7 +290,7 @@ virtual_machine::find_class(const dex_type_hdl& hdl, bool try_load)
 
     auto found_class = find_class(make_jvm_hdl(hdl), try_load);
 
-    if (found_class) {
+    if (found_class && !sealed_) {
         // Remember the initiating handle.
         classes_[boost::graph_bundle].hdl_to_vertex[hdl] = *found_class;
     }
@@ -132,13 +301,15 @@ virtual_machine::find_class(const dex_type_hdl& hdl, bool try_load)
 boost::optional<method_vertex_descriptor>
 virtual_machine::find_method(const jvm_method_hdl& hdl, bool try_load)
 {
-    // TODO: Rewrite to make it more efficient.
-
     // Check the lookup table first.
     if (auto mv = lookup_method_vertex(hdl, methods_)) {
         return mv;
     }
 
+    if (sealed_) {
+        try_load = false;
+    }
+
     if (try_load) {
         if (!find_class(hdl.type_hdl, true)) {
             return boost::none;
@@ -151,40 +322,33 @@ virtual_machine::find_method(const jvm_method_hdl& hdl, bool try_load)
     }
 
     // Find the starting class loader vertex.
-    auto lv = find_loader_vertex(hdl.type_hdl.loader_hdl, loaders_);
+    auto lv = find_loader_vertex(hdl.type_hdl.loader_hdl, *loaders_);
     if (!lv) {
         // Invalid loader handle.
         return boost::none;
     }
 
-    // Find the method.
-    struct method_finder : boost::default_dfs_visitor {
-        virtual_machine& vm;
-        const jvm_method_hdl& hdl;
-
-        method_finder(virtual_machine& vm, const jvm_method_hdl& hdl)
-                : vm(vm), hdl(hdl)
-        {
-        }
+    // Don't search again if it has failed to load.
+    auto& cache = sealed_ ? resolution_cache_ : valid_resolution_cache();
+    if (cache.missing_methods.count(hdl)) {
+        return boost::none;
+    }
 
-        void discover_vertex(const loader_vertex_descriptor& v,
-                             const loader_graph& g)
-        {
-            if (auto found_method = g[v].loader.lookup_method(
-                        vm, hdl.type_hdl.descriptor, hdl.unique_name)) {
-                throw *found_method;
+    // Find the method.
+    for (const auto& v : delegation_chain(*lv)) {
+        if (auto mv = (*loaders_)[v].loader.lookup_method(
+                    *this, hdl.type_hdl.descriptor, hdl.unique_name)) {
+            // Method found: remember the initiating handle, and return.
+            if (!sealed_) {
+                methods_[boost::graph_bundle].jvm_hdl_to_vertex[hdl]
+                        = *mv;
             }
+            return mv;
         }
-    } vis(*this, hdl);
-    boost::vector_property_map<int> color_map(
-            static_cast<unsigned>(num_vertices(loaders_)));
-    try {
-        boost::depth_first_visit(loaders_, *lv, vis, color_map);
     }
-    catch (const method_vertex_descriptor& mv) {
-        // Method found: remember the initiating handle, and return.
-        methods_[boost::graph_bundle].jvm_hdl_to_vertex[hdl] = mv;
-        return mv;
+
+    if (try_load) {
+        cache.missing_methods.insert(hdl);
     }
 
     return boost::none;
@@ -200,9 +364,10 @@ virtual_machine::find_method(const dex_method_hdl& hdl, bool try_load)
 
     auto found_method = find_method(make_jvm_hdl(hdl), try_load);
 
-    if (found_method) {
+    if (found_method && !sealed_) {
         // Remember the initiating handle.
-        methods_[boost::graph_bundle].hdl_to_vertex[hdl] = *found_method;
+        methods_[boost::graph_bundle].hdl_to_vertex[hdl]
+                = *found_method;
     }
 
     return found_method;
@@ -211,13 +376,15 @@ virtual_machine::find_method(const dex_method_hdl& hdl, bool try_load)
 boost::optional<field_vertex_descriptor>
 virtual_machine::find_field(const jvm_field_hdl& hdl, bool try_load)
 {
-    // TODO: Rewrite to make it more efficient.
-
     // Check the lookup table first.
     if (auto fv = lookup_field_vertex(hdl, fields_)) {
         return fv;
     }
 
+    if (sealed_) {
+        try_load = false;
+    }
+
     if (try_load) {
         if (!find_class(hdl.type_hdl, true)) {
             return boost::none;
@@ -230,40 +397,33 @@ virtual_machine::find_field(const jvm_field_hdl& hdl, bool try_load)
     }
 
     // Find the starting class loader vertex.
-    auto lv = find_loader_vertex(hdl.type_hdl.loader_hdl, loaders_);
+    auto lv = find_loader_vertex(hdl.type_hdl.loader_hdl, *loaders_);
     if (!lv) {
         // Invalid loader handle.
         return boost::none;
     }
 
-    // Find the field.
-    struct field_finder : boost::default_dfs_visitor {
-        virtual_machine& vm;
-        const jvm_field_hdl& hdl;
-
-        field_finder(virtual_machine& vm, const jvm_field_hdl& hdl)
-                : vm(vm), hdl(hdl)
-        {
-        }
+    // Don't search again if it has failed to load.
+    auto& cache = sealed_ ? resolution_cache_ : valid_resolution_cache();
+    if (cache.missing_fields.count(hdl)) {
+        return boost::none;
+    }
 
-        void discover_vertex(const loader_vertex_descriptor& v,
-                             const loader_graph& g)
-        {
-            if (auto found_field = g[v].loader.lookup_field(
-                        vm, hdl.type_hdl.descriptor, hdl.unique_name)) {
-                throw *found_field;
+    // Find the field.
+    for (const auto& v : delegation_chain(*lv)) {
+        if (auto fv = (*loaders_)[v].loader.lookup_field(
+                    *this, hdl.type_hdl.descriptor, hdl.unique_name)) {
+            // Field found: remember the initiating handle, and return.
+            if (!sealed_) {
+                fields_[boost::graph_bundle].jvm_hdl_to_vertex[hdl]
+                        = *fv;
             }
+            return fv;
         }
-    } vis(*this, hdl);
-    boost::vector_property_map<int> color_map(
-            static_cast<unsigned>(num_vertices(loaders_)));
-    try {
-        boost::depth_first_visit(loaders_, *lv, vis, color_map);
     }
-    catch (const field_vertex_descriptor& fv) {
-        // Field found: remember the initiating handle, and return.
-        fields_[boost::graph_bundle].jvm_hdl_to_vertex[hdl] = fv;
-        return fv;
+
+    if (try_load) {
+        cache.missing_fields.insert(hdl);
     }
 
     return boost::none;
@@ -279,7 +439,7 @@ virtual_machine::find_field(const dex_field_hdl& hdl, bool try_load)
 
     auto found_field = find_field(make_jvm_hdl(hdl), try_load);
 
-    if (found_field) {
+    if (found_field && !sealed_) {
         // Remember the initiating handle.
         fields_[boost::graph_bundle].hdl_to_vertex[hdl] = *found_field;
     }
@@ -291,16 +451,16 @@ boost::optional<std::pair<method_vertex_descriptor, insn_vertex_descriptor>>
 virtual_machine::find_insn(const dex_file_hdl& file_hdl, uint32_t offset,
                            bool try_load)
 {
-    auto lv = find_loader_vertex(file_hdl.loader_hdl, loaders_);
+    auto lv = find_loader_vertex(file_hdl.loader_hdl, *loaders_);
     if (!lv) {
         return boost::none;
     }
 
-    if (loaders_[*lv].loader.dex_files().size() <= file_hdl.idx) {
+    if ((*loaders_)[*lv].loader.dex_files().size() <= file_hdl.idx) {
         return boost::none;
     }
 
-    auto& dex_file = loaders_[*lv].loader.dex_files()[file_hdl.idx];
+    auto& dex_file = (*loaders_)[*lv].loader.dex_files()[file_hdl.idx];
     auto p = dex_file.find_method_hdl(offset);
     if (!p) {
         return boost::none;
@@ -314,8 +474,9 @@ virtual_machine::find_insn(const dex_file_hdl& file_hdl, uint32_t offset,
         return boost::none;
     }
 
-    const auto& ig = methods_[*mv].insns;
-    auto iv = lookup_insn_vertex(local_off, ig);
+    const auto& mg = methods_;
+    auto ig = mg[*mv].insns.share();
+    auto iv = lookup_insn_vertex(local_off, *ig);
     if (!iv) {
         return boost::none;
     }
@@ -325,8 +486,10 @@ virtual_machine::find_insn(const dex_file_hdl& file_hdl, uint32_t offset,
 
 bool virtual_machine::load_all_classes(const class_loader_hdl& loader_hdl)
 {
+    throw_if_sealed();
+
     // Find the starting class loader vertex.
-    auto lv = find_loader_vertex(loader_hdl, loaders_);
+    auto lv = find_loader_vertex(loader_hdl, *loaders_);
     if (!lv) {
         std::stringstream ss;
         ss << "invalid loader handle ";
@@ -334,14 +497,44 @@ bool virtual_machine::load_all_classes(const class_loader_hdl& loader_hdl)
         throw std::runtime_error(ss.str());
     }
 
-    return loaders_[*lv].loader.load_all_classes(*this);
+    return (*loaders_)[*lv].loader.load_all_classes(*this);
+}
+
+bool virtual_machine::load_all_classes(const class_loader_hdl& loader_hdl,
+                                       unsigned num_threads)
+{
+    return load_all_classes(std::vector<class_loader_hdl>{loader_hdl},
+                            num_threads);
+}
+
+bool virtual_machine::load_all_classes(
+        const std::vector<class_loader_hdl>& loader_hdls, unsigned num_threads)
+{
+    throw_if_sealed();
+
+    std::vector<const dex_file*> files;
+    for (const auto& loader_hdl : loader_hdls) {
+        auto lv = find_loader_vertex(loader_hdl, *loaders_);
+        if (!lv) {
+            std::stringstream ss;
+            ss << "invalid loader handle ";
+            ss << loader_hdl;
+            throw std::runtime_error(ss.str());
+        }
+
+        for (const auto& df : (*loaders_)[*lv].loader.dex_files()) {
+            files.push_back(&df);
+        }
+    }
+
+    return dex_file::load_all_classes(*this, files, num_threads);
 }
 
 jvm_type_hdl virtual_machine::make_jvm_hdl(const dex_type_hdl& type_hdl) const
 {
     const auto& loader_hdl = type_hdl.file_hdl.loader_hdl;
 
-    auto lv = find_loader_vertex(loader_hdl, loaders_);
+    auto lv = find_loader_vertex(loader_hdl, *loaders_);
     if (!lv) {
         std::stringstream ss;
         ss << "invalid type handle ";
@@ -349,7 +542,7 @@ jvm_type_hdl virtual_machine::make_jvm_hdl(const dex_type_hdl& type_hdl) const
         throw std::runtime_error(ss.str());
     }
 
-    return {loader_hdl, loaders_[*lv].loader.descriptor(type_hdl)};
+    return {loader_hdl, (*loaders_)[*lv].loader.descriptor(type_hdl)};
 }
 
 jvm_method_hdl
@@ -357,7 +550,7 @@ virtual_machine::make_jvm_hdl(const dex_method_hdl& method_hdl) const
 {
     const auto& loader_hdl = method_hdl.file_hdl.loader_hdl;
 
-    auto lv = find_loader_vertex(loader_hdl, loaders_);
+    auto lv = find_loader_vertex(loader_hdl, *loaders_);
     if (!lv) {
         std::stringstream ss;
         ss << "invalid method handle ";
@@ -365,7 +558,7 @@ virtual_machine::make_jvm_hdl(const dex_method_hdl& method_hdl) const
         throw std::runtime_error(ss.str());
     }
 
-    const auto& loader = loaders_[*lv].loader;
+    const auto& loader = (*loaders_)[*lv].loader;
     return {{loader_hdl, loader.class_descriptor(method_hdl)},
             loader.unique_name(method_hdl)};
 }
@@ -375,7 +568,7 @@ virtual_machine::make_jvm_hdl(const dex_field_hdl& field_hdl) const
 {
     const auto& loader_hdl = field_hdl.file_hdl.loader_hdl;
 
-    auto lv = find_loader_vertex(loader_hdl, loaders_);
+    auto lv = find_loader_vertex(loader_hdl, *loaders_);
     if (!lv) {
         std::stringstream ss;
         ss << "invalid field handle ";
@@ -383,22 +576,160 @@ virtual_machine::make_jvm_hdl(const dex_field_hdl& field_hdl) const
         throw std::runtime_error(ss.str());
     }
 
-    const auto& loader = loaders_[*lv].loader;
+    const auto& loader = (*loaders_)[*lv].loader;
     return {{loader_hdl, loader.class_descriptor(field_hdl)},
             loader.name(field_hdl)};
 }
 
 namespace {
-    bool
-    load_recursive_impl(virtual_machine& vm, method_vertex_descriptor v,
-                        std::unordered_set<method_vertex_descriptor>& visited);
+    /// Builds instruction graphs using a pool of threads.
+    class insn_graph_prefetcher {
+    public:
+        explicit insn_graph_prefetcher(unsigned num_threads)
+        {
+            for (unsigned t = 1; t < num_threads; ++t) {
+                try {
+                    threads_.emplace_back([this] { run(); });
+                }
+                catch (const std::system_error&) {
+                    // Continue with the threads we already have.
+                    break;
+                }
+            }
+        }
+
+        ~insn_graph_prefetcher()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            work_cv_.notify_all();
+            for (auto& t : threads_) {
+                t.join();
+            }
+        }
+
+        /// Builds the graphs, and returns when all of them are built.
+        void build(const std::vector<const lazy_insn_graph*>& graphs)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                graphs_ = &graphs;
+                next_ = 0;
+                busy_ = threads_.size();
+                ++generation_;
+            }
+            work_cv_.notify_all();
+            build_graphs();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cv_.wait(lock, [&] { return busy_ == 0; });
+            graphs_ = nullptr;
+        }
+
+    private:
+        void run()
+        {
+            unsigned generation = 0;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    work_cv_.wait(lock, [&] {
+                        return stop_ || generation_ != generation;
+                    });
+                    if (stop_) {
+                        return;
+                    }
+                    generation = generation_;
+                }
+
+                build_graphs();
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    --busy_;
+                }
+                done_cv_.notify_one();
+            }
+        }
 
+        void build_graphs()
+        {
+            const auto& graphs = *graphs_;
+            for (auto i = next_++; i < graphs.size(); i = next_++) {
+                try {
+                    graphs[i]->share();
+                }
+                catch (...) {
+                    // Leave it to the loader to build the graph again and
+                    // report the error.
+                }
+            }
+        }
+
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable work_cv_;
+        std::condition_variable done_cv_;
+        const std::vector<const lazy_insn_graph*>* graphs_ = nullptr;
+        std::atomic<size_t> next_{0};
+        size_t busy_ = 0;
+        unsigned generation_ = 0;
+        bool stop_ = false;
+    };
+
+    /// Loads the methods reachable from a method using an explicit work
+    /// stack.
+    ///
+    /// The tasks are run in the same order as a recursive traversal: each
+    /// method is scanned instruction by instruction, and the methods found
+    /// at an instruction are loaded before scanning the next one.
     class recursive_loader : public boost::static_visitor<void> {
     public:
         recursive_loader(virtual_machine& vm,
-                         std::unordered_set<method_vertex_descriptor>& visited)
-                : vm_(vm), visited_(visited)
+                         std::unordered_set<method_vertex_descriptor>& visited,
+                         unsigned num_threads)
+                : vm_(vm), cvm_(vm), visited_(visited)
         {
+            // Building the graphs concurrently is only safe without
+            // eviction.
+            const auto& mg = vm_.methods();
+            if (num_threads > 1
+                && mg[boost::graph_bundle].insn_cache->budget() == 0) {
+                prefetcher_ = std::make_unique<insn_graph_prefetcher>(
+                        num_threads);
+            }
+        }
+
+        void run(method_vertex_descriptor v)
+        {
+            tasks_.push_back({task::visit, v, 0});
+            while (!tasks_.empty()) {
+                auto t = tasks_.back();
+                tasks_.pop_back();
+                switch (t.kind) {
+                case task::visit:
+                    visit(t.v);
+                    break;
+                case task::scan:
+                    scan(t.idx);
+                    break;
+                case task::expand:
+                    // Load all the methods that the invocation may dispatch
+                    // to in the order of the depth-first search.
+                    {
+                        const auto& targets
+                                = vm_.dispatch().overriding_methods(t.v);
+                        for (auto it = targets.end();
+                             it != targets.begin();) {
+                            tasks_.push_back({task::visit, *--it, 0});
+                        }
+                        tasks_.push_back({task::visit, t.v, 0});
+                    }
+                    break;
+                }
+            }
         }
 
         void operator()(const insn_const_string&)
@@ -480,15 +811,7 @@ namespace {
             }
 
             // Try to load <clinit>.
-            {
-                const auto& fg = vm_.fields();
-                auto clinit_mv = vm_.find_method(
-                        jvm_method_hdl(fg[*fv].jvm_hdl.type_hdl, "<clinit>()V"),
-                        true);
-                if (clinit_mv) {
-                    load_recursive_impl(vm_, *clinit_mv, visited_);
-                }
-            }
+            load_clinit(cvm_.fields()[*fv].jvm_hdl.type_hdl);
         }
 
         void operator()(const insn_sput& x)
@@ -501,15 +824,7 @@ namespace {
             }
 
             // Try to load <clinit>.
-            {
-                const auto& fg = vm_.fields();
-                auto clinit_mv = vm_.find_method(
-                        jvm_method_hdl(fg[*fv].jvm_hdl.type_hdl, "<clinit>()V"),
-                        true);
-                if (clinit_mv) {
-                    load_recursive_impl(vm_, *clinit_mv, visited_);
-                }
-            }
+            load_clinit(cvm_.fields()[*fv].jvm_hdl.type_hdl);
         }
 
         void operator()(const insn_invoke& x)
@@ -519,51 +834,19 @@ namespace {
                 return;
             }
 
-            const auto& mg = vm_.methods();
+            // Find the overriding methods after loading <clinit> since it
+            // may load more of them.
+            tasks_.push_back({task::expand, *mv, 0});
+
             switch (x.op) {
             case opcode::op_invoke_static:
             case opcode::op_invoke_static_range:
                 // Try to load <clinit>.
-                {
-                    auto clinit_mv = vm_.find_method(
-                            jvm_method_hdl(mg[*mv].jvm_hdl.type_hdl,
-                                           "<clinit>()V"),
-                            true);
-                    if (clinit_mv) {
-                        load_recursive_impl(vm_, *clinit_mv, visited_);
-                    }
-                }
+                load_clinit(cvm_.methods()[*mv].jvm_hdl.type_hdl);
                 break;
             default:
                 break;
             }
-
-            const auto& mig
-                    = make_edge_filtered_graph<method_super_edge_property>(mg);
-            using method_inheritance_graph = decltype(mig);
-
-            std::vector<method_vertex_descriptor> targets;
-            struct target_finder : boost::default_dfs_visitor {
-                std::vector<method_vertex_descriptor>& targets;
-
-                target_finder(std::vector<method_vertex_descriptor>& targets)
-                        : targets(targets)
-                {
-                }
-
-                void discover_vertex(const method_vertex_descriptor& v,
-                                     method_inheritance_graph&)
-                {
-                    targets.push_back(v);
-                }
-            } vis(targets);
-            boost::vector_property_map<int> color_map(
-                    static_cast<unsigned>(num_vertices(mig)));
-            boost::depth_first_visit(mig, *mv, vis, color_map);
-
-            for (auto tv : targets) {
-                load_recursive_impl(vm_, tv, visited_);
-            }
         }
 
         void operator()(const insn_invoke_quick&)
@@ -576,38 +859,107 @@ namespace {
         }
 
     private:
-        virtual_machine& vm_;
-        std::unordered_set<method_vertex_descriptor>& visited_;
-    };
+        struct task {
+            enum kind_type : uint8_t { visit, scan, expand } kind;
+            method_vertex_descriptor v;
+            size_t idx;
+        };
+
+        void visit(method_vertex_descriptor v)
+        {
+            if (!visited_.insert(v).second) {
+                return;
+            }
 
-    bool
-    load_recursive_impl(virtual_machine& vm, method_vertex_descriptor v,
-                        std::unordered_set<method_vertex_descriptor>& visited)
-    {
-        if (visited.find(v) != end(visited)) {
-            return true;
+            // Keep the graph alive since loading the other methods may evict
+            // it.
+            auto ig = cvm_.methods()[v].insns.share();
+            if (num_vertices(*ig) == 0) {
+                return;
+            }
+
+            if (prefetcher_) {
+                prefetch_callees(*ig);
+            }
+
+            frames_.push_back(std::move(ig));
+            tasks_.push_back({task::scan, 0, 0});
         }
-        visited.insert(v);
 
-        auto ig = vm.methods()[v].insns;
+        void scan(size_t idx)
+        {
+            // The graph being scanned is always on the top since the methods
+            // loaded from it have finished.
+            const auto& ig = *frames_.back();
+            if (idx == num_vertices(ig)) {
+                frames_.pop_back();
+                return;
+            }
 
-        if (num_vertices(ig) == 0) {
-            return true;
+            tasks_.push_back({task::scan, 0, idx + 1});
+            boost::apply_visitor(*this, ig[idx].insn);
         }
 
-        recursive_loader rloader(vm, visited);
-        for (auto iv : boost::make_iterator_range(vertices(ig))) {
-            boost::apply_visitor(rloader, ig[iv].insn);
+        void load_clinit(const jvm_type_hdl& type_hdl)
+        {
+            auto clinit_mv = vm_.find_method(
+                    jvm_method_hdl(type_hdl, "<clinit>()V"), true);
+            if (clinit_mv) {
+                tasks_.push_back({task::visit, *clinit_mv, 0});
+            }
         }
 
-        return true;
-    }
+        /// Builds the graphs of the loaded methods invoked from the graph
+        /// concurrently since they are visited next.
+        void prefetch_callees(const insn_graph& ig)
+        {
+            const auto& mg = cvm_.methods();
+            prefetch_.clear();
+            for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
+                const auto* x = boost::get<insn_invoke>(&ig[iv].insn);
+                if (!x) {
+                    continue;
+                }
+                auto mv = vm_.find_method(x->const_val, false);
+                if (mv && !visited_.count(*mv)
+                    && !mg[*mv].insns.materialized()) {
+                    prefetch_.push_back(&mg[*mv].insns);
+                }
+            }
+            std::sort(begin(prefetch_), end(prefetch_));
+            prefetch_.erase(std::unique(begin(prefetch_), end(prefetch_)),
+                            end(prefetch_));
+            if (prefetch_.size() > 1) {
+                prefetcher_->build(prefetch_);
+            }
+        }
+
+        virtual_machine& vm_;
+        /// Reads the graphs without modifying the ones of a fork.
+        const virtual_machine& cvm_;
+        std::unordered_set<method_vertex_descriptor>& visited_;
+        std::vector<task> tasks_;
+        std::vector<std::shared_ptr<const insn_graph>> frames_;
+        std::unique_ptr<insn_graph_prefetcher> prefetcher_;
+        std::vector<const lazy_insn_graph*> prefetch_;
+    };
 }
 
 std::unordered_set<method_vertex_descriptor>
 virtual_machine::load_recursive(method_vertex_descriptor v)
 {
+    return load_recursive(v, 1);
+}
+
+std::unordered_set<method_vertex_descriptor>
+virtual_machine::load_recursive(method_vertex_descriptor v,
+                                unsigned num_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
     std::unordered_set<method_vertex_descriptor> visited;
-    load_recursive_impl(*this, v, visited);
+    recursive_loader(*this, visited, num_threads).run(v);
     return visited;
 }
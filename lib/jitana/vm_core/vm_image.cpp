@@ -0,0 +1,867 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_core/virtual_machine.hpp"
+#include "jitana/vm_core/dex_file.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+using namespace jitana;
+using namespace jitana::detail;
+
+namespace {
+    constexpr uint8_t image_magic[8]
+            = {'j', 'v', 'm', 'i', '\n', '0', '0', '2'};
+
+    enum image_section_id : unsigned {
+        sec_loaders,
+        sec_loader_edges,
+        sec_dex_files,
+        sec_string_offs,
+        sec_chars,
+        sec_hdls,
+        sec_classes,
+        sec_class_edges,
+        sec_methods,
+        sec_params,
+        sec_method_edges,
+        sec_fields,
+        sec_class_jvm_lut,
+        sec_class_lut,
+        sec_method_jvm_lut,
+        sec_method_lut,
+        sec_field_jvm_lut,
+        sec_field_lut,
+        num_sections
+    };
+
+    struct image_section {
+        uint32_t off;
+        uint32_t size;
+    };
+
+    struct image_header {
+        uint8_t magic[8];
+        uint32_t file_size;
+        uint32_t reserved;
+        image_section sections[num_sections];
+    };
+    static_assert(std::is_pod<image_header>::value, "");
+
+    struct image_loader {
+        uint32_t hdl;
+        uint32_t dex_files_size;
+    };
+
+    struct image_loader_edge {
+        uint32_t source;
+        uint32_t target;
+    };
+
+    struct image_dex_file {
+        uint8_t signature[20];
+        uint32_t file_size;
+        uint32_t level;
+    };
+
+    /// A range in the handle section.
+    struct image_range {
+        uint32_t begin;
+        uint32_t size;
+    };
+
+    /// No vertex.
+    constexpr uint32_t image_no_vertex = 0xffffffff;
+
+    /// A class. The tables hold the entries following the ones of the class
+    /// specified by the super index, which are shared on loading.
+    struct image_class {
+        uint64_t hdl;
+        uint32_t loader;
+        uint32_t descriptor;
+        uint32_t access_flags;
+        uint16_t static_size;
+        uint16_t instance_size;
+        uint32_t super;
+        image_range static_fields;
+        image_range instance_fields;
+        image_range dtable;
+        image_range vtable;
+    };
+    static_assert(std::is_pod<image_class>::value, "");
+
+    struct image_super_edge {
+        uint32_t source;
+        uint32_t target;
+        uint32_t interface;
+    };
+
+    struct image_method {
+        uint64_t hdl;
+        uint64_t class_hdl;
+        uint32_t loader;
+        uint32_t descriptor;
+        uint32_t unique_name;
+        uint32_t access_flags;
+        uint32_t code_off;
+        /// A range in the parameter section.
+        image_range params;
+    };
+    static_assert(std::is_pod<image_method>::value, "");
+
+    struct image_param {
+        uint32_t descriptor;
+        uint32_t name;
+    };
+
+    struct image_field {
+        uint64_t hdl;
+        uint64_t class_hdl;
+        uint32_t loader;
+        uint32_t descriptor;
+        uint32_t name;
+        uint32_t access_flags;
+        uint16_t offset;
+        uint8_t kind;
+        uint8_t size;
+        char type_char;
+    };
+    static_assert(std::is_pod<image_field>::value, "");
+
+    struct image_jvm_type_entry {
+        uint32_t loader;
+        uint32_t descriptor;
+        uint32_t vertex;
+    };
+
+    struct image_jvm_member_entry {
+        uint32_t loader;
+        uint32_t descriptor;
+        uint32_t name;
+        uint32_t vertex;
+    };
+
+    struct image_hdl_entry {
+        uint64_t hdl;
+        uint64_t vertex;
+    };
+
+    dex_file_hdl unpack_file_hdl(uint32_t x)
+    {
+        dex_file_hdl hdl;
+        hdl.loader_hdl = x >> dex_file_idx_bits;
+        hdl.idx = x & ((1u << dex_file_idx_bits) - 1);
+        return hdl;
+    }
+
+    template <typename Hdl>
+    Hdl unpack_hdl(uint64_t x)
+    {
+        return Hdl(unpack_file_hdl(x >> 32), static_cast<uint32_t>(x));
+    }
+
+    /// Builds the sections of an image.
+    class image_writer {
+    public:
+        template <typename T>
+        void append(image_section_id id, const T& x)
+        {
+            static_assert(std::is_pod<T>::value, "");
+            auto& s = sections_[id];
+            s.append(reinterpret_cast<const char*>(&x), sizeof(x));
+            ++sizes_[id];
+        }
+
+        /// Returns the index of the string in the string table.
+        uint32_t string_idx(boost::string_view str)
+        {
+            auto it = string_to_idx_.find(str.to_string());
+            if (it != end(string_to_idx_)) {
+                return it->second;
+            }
+
+            uint32_t idx = sizes_[sec_string_offs];
+            append(sec_string_offs, uint32_t(sections_[sec_chars].size()));
+            sections_[sec_chars].append(str.data(), str.size());
+            sections_[sec_chars] += '\0';
+            sizes_[sec_chars] = sections_[sec_chars].size();
+            string_to_idx_.emplace(str.to_string(), idx);
+            return idx;
+        }
+
+        /// Returns the index of the symbol in the string table.
+        uint32_t string_idx(const symbol& sym)
+        {
+            auto it = symbol_to_idx_.find(sym.id());
+            if (it != end(symbol_to_idx_)) {
+                return it->second;
+            }
+            auto idx = string_idx(sym.view());
+            symbol_to_idx_.emplace(sym.id(), idx);
+            return idx;
+        }
+
+        /// Appends the handles from the index to the handle section.
+        template <typename Hdl>
+        image_range hdls(const persistent_vector<Hdl>& xs, size_t first)
+        {
+            image_range r = {sizes_[sec_hdls], uint32_t(xs.size() - first)};
+            for (auto i = first; i < xs.size(); ++i) {
+                append(sec_hdls, static_cast<uint64_t>(xs[i]));
+            }
+            return r;
+        }
+
+        void save(const std::string& filename) const
+        {
+            // Align every section to 8 bytes for the 64-bit handles.
+            image_header h = {};
+            std::memcpy(h.magic, image_magic, sizeof(image_magic));
+            uint64_t off = sizeof(image_header);
+            for (unsigned i = 0; i < num_sections; ++i) {
+                off = (off + 7) & ~uint64_t(7);
+                h.sections[i].off = off;
+                h.sections[i].size = sizes_[i];
+                off += sections_[i].size();
+            }
+            if (off > 0xffffffff) {
+                throw std::runtime_error("image is too large");
+            }
+            h.file_size = off;
+
+            // Write to a temporary file first so that a reader never sees a
+            // partially written image.
+            const auto tmp_filename = filename + ".tmp";
+            {
+                std::ofstream ofs(tmp_filename,
+                                  std::ios::binary | std::ios::trunc);
+                ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+                uint64_t pos = sizeof(image_header);
+                for (unsigned i = 0; i < num_sections; ++i) {
+                    static const char padding[8] = {};
+                    ofs.write(padding, h.sections[i].off - pos);
+                    ofs.write(sections_[i].data(), sections_[i].size());
+                    pos = h.sections[i].off + sections_[i].size();
+                }
+                if (!ofs) {
+                    std::stringstream ss;
+                    ss << "failed to write ";
+                    ss << tmp_filename;
+                    throw std::runtime_error(ss.str());
+                }
+            }
+            if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+                std::remove(tmp_filename.c_str());
+                std::stringstream ss;
+                ss << "failed to write ";
+                ss << filename;
+                throw std::runtime_error(ss.str());
+            }
+        }
+
+    private:
+        std::string sections_[num_sections];
+        uint32_t sizes_[num_sections] = {};
+        std::unordered_map<std::string, uint32_t> string_to_idx_;
+        std::unordered_map<uint32_t, uint32_t> symbol_to_idx_;
+    };
+
+    /// Reads the sections of a mapped image.
+    class image_reader {
+    public:
+        explicit image_reader(const boost::iostreams::mapped_file_source& file)
+                : begin_(reinterpret_cast<const uint8_t*>(file.data())),
+                  file_size_(file.size())
+        {
+        }
+
+        /// Returns false if the header or the sections are broken.
+        bool valid() const
+        {
+            if (file_size_ < sizeof(image_header)) {
+                return false;
+            }
+            const auto& h = header();
+            if (std::memcmp(h.magic, image_magic, sizeof(image_magic)) != 0
+                || h.file_size != file_size_) {
+                return false;
+            }
+            if (!check<image_loader>(sec_loaders)
+                || !check<image_loader_edge>(sec_loader_edges)
+                || !check<image_dex_file>(sec_dex_files)
+                || !check<uint32_t>(sec_string_offs)
+                || !check<char>(sec_chars) || !check<uint64_t>(sec_hdls)
+                || !check<image_class>(sec_classes)
+                || !check<image_super_edge>(sec_class_edges)
+                || !check<image_method>(sec_methods)
+                || !check<image_param>(sec_params)
+                || !check<image_super_edge>(sec_method_edges)
+                || !check<image_field>(sec_fields)
+                || !check<image_jvm_type_entry>(sec_class_jvm_lut)
+                || !check<image_hdl_entry>(sec_class_lut)
+                || !check<image_jvm_member_entry>(sec_method_jvm_lut)
+                || !check<image_hdl_entry>(sec_method_lut)
+                || !check<image_jvm_member_entry>(sec_field_jvm_lut)
+                || !check<image_hdl_entry>(sec_field_lut)) {
+                return false;
+            }
+
+            // Every string must be terminated within the section.
+            auto chars = section<char>(sec_chars);
+            if (!chars.empty() && chars.back() != '\0') {
+                return false;
+            }
+            for (const auto& off : section<uint32_t>(sec_string_offs)) {
+                if (off >= chars.size()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const image_header& header() const
+        {
+            return *reinterpret_cast<const image_header*>(begin_);
+        }
+
+        template <typename T>
+        boost::iterator_range<const T*> section(image_section_id id) const
+        {
+            const auto& s = header().sections[id];
+            auto first = reinterpret_cast<const T*>(begin_ + s.off);
+            return boost::make_iterator_range(first, first + s.size);
+        }
+
+        /// Returns the handles in the range, or an empty range if it is out
+        /// of the section.
+        boost::iterator_range<const uint64_t*> hdls(const image_range& r) const
+        {
+            auto all = section<uint64_t>(sec_hdls);
+            if (uint64_t(r.begin) + r.size > all.size()) {
+                return {};
+            }
+            return boost::make_iterator_range(all.begin() + r.begin,
+                                              all.begin() + r.begin + r.size);
+        }
+
+    private:
+        template <typename T>
+        bool check(image_section_id id) const
+        {
+            const auto& s = header().sections[id];
+            return s.off % 8 == 0
+                    && uint64_t(s.off) + uint64_t(s.size) * sizeof(T)
+                    <= file_size_;
+        }
+
+        const uint8_t* begin_;
+        size_t file_size_;
+    };
+
+    template <typename Graph, typename Prop>
+    std::vector<image_super_edge> super_edges(const Graph& g)
+    {
+        std::vector<image_super_edge> result;
+        for (const auto& e : boost::make_iterator_range(edges(g))) {
+            if (auto p = edge_cast<Prop>(&g[e])) {
+                result.push_back({uint32_t(source(e, g)),
+                                  uint32_t(target(e, g)),
+                                  uint32_t(p->interface)});
+            }
+        }
+        return result;
+    }
+}
+
+void virtual_machine::save_image(const std::string& filename) const
+{
+    image_writer w;
+
+    // The class loaders and their DEX files to validate the image against.
+    for (const auto& v : boost::make_iterator_range(vertices(loaders()))) {
+        const auto& loader = loaders()[v].loader;
+        w.append(sec_loaders,
+                 image_loader{unsigned(loader.hdl()),
+                              uint32_t(loader.dex_files().size())});
+        for (const auto& df : loader.dex_files()) {
+            image_dex_file idf = {};
+            std::memcpy(idf.signature, df.header().signature,
+                        sizeof(idf.signature));
+            idf.file_size = df.header().file_size;
+            idf.level = uint32_t(df.level());
+            w.append(sec_dex_files, idf);
+        }
+    }
+    for (const auto& e : boost::make_iterator_range(edges(loaders()))) {
+        if (edge_cast<loader_parent_edge_property>(&loaders()[e])) {
+            w.append(sec_loader_edges,
+                     image_loader_edge{uint32_t(source(e, loaders())),
+                                       uint32_t(target(e, loaders()))});
+        }
+    }
+
+    // The classes.
+    for (const auto& v : boost::make_iterator_range(vertices(classes()))) {
+        const auto& c = classes()[v];
+        image_class ic = {};
+        ic.hdl = static_cast<uint64_t>(c.hdl);
+        ic.loader = unsigned(c.jvm_hdl.loader_hdl);
+        ic.descriptor = w.string_idx(c.jvm_hdl.descriptor);
+        ic.access_flags = c.access_flags;
+        ic.static_size = c.static_size;
+        ic.instance_size = c.instance_size;
+
+        // Store only the entries following the ones of the superclass. A
+        // class without the class data has empty tables instead.
+        ic.super = image_no_vertex;
+        class_vertex_property empty;
+        const auto* s = &empty;
+        if (auto sv = superclass_vertex(v, classes())) {
+            const auto& sc = classes()[*sv];
+            if (c.static_fields.size() >= sc.static_fields.size()
+                && c.instance_fields.size() >= sc.instance_fields.size()
+                && c.dtable.size() >= sc.dtable.size()
+                && c.vtable.size() >= sc.vtable.size()) {
+                ic.super = uint32_t(*sv);
+                s = &sc;
+            }
+        }
+        ic.static_fields = w.hdls(c.static_fields, s->static_fields.size());
+        ic.instance_fields
+                = w.hdls(c.instance_fields, s->instance_fields.size());
+        ic.dtable = w.hdls(c.dtable, s->dtable.size());
+        ic.vtable = w.hdls(c.vtable, s->vtable.size());
+        w.append(sec_classes, ic);
+    }
+    for (const auto& e : super_edges<class_graph, class_super_edge_property>(
+                 classes())) {
+        w.append(sec_class_edges, e);
+    }
+
+    // The methods.
+    uint32_t params_size = 0;
+    for (const auto& v : boost::make_iterator_range(vertices(methods()))) {
+        const auto& m = methods()[v];
+        image_method im = {};
+        im.hdl = static_cast<uint64_t>(m.hdl);
+        im.class_hdl = static_cast<uint64_t>(m.class_hdl);
+        im.loader = unsigned(m.jvm_hdl.type_hdl.loader_hdl);
+        im.descriptor = w.string_idx(m.jvm_hdl.type_hdl.descriptor);
+        im.unique_name = w.string_idx(m.jvm_hdl.unique_name);
+        im.access_flags = m.access_flags;
+        im.code_off = m.insns.code_off();
+        im.params = {params_size, uint32_t(m.params.size())};
+        for (const auto& p : m.params) {
+            w.append(sec_params,
+                     image_param{w.string_idx(boost::string_view(p.descriptor)),
+                                 w.string_idx(boost::string_view(p.name))});
+        }
+        params_size += m.params.size();
+        w.append(sec_methods, im);
+    }
+    for (const auto& e : super_edges<method_graph, method_super_edge_property>(
+                 methods())) {
+        w.append(sec_method_edges, e);
+    }
+
+    // The fields.
+    for (const auto& v : boost::make_iterator_range(vertices(fields()))) {
+        const auto& f = fields()[v];
+        image_field jf = {};
+        jf.hdl = static_cast<uint64_t>(f.hdl);
+        jf.class_hdl = static_cast<uint64_t>(f.class_hdl);
+        jf.loader = unsigned(f.jvm_hdl.type_hdl.loader_hdl);
+        jf.descriptor = w.string_idx(f.jvm_hdl.type_hdl.descriptor);
+        jf.name = w.string_idx(f.jvm_hdl.unique_name);
+        jf.access_flags = f.access_flags;
+        jf.offset = f.offset;
+        jf.kind = f.kind;
+        jf.size = f.size;
+        jf.type_char = f.type_char;
+        w.append(sec_fields, jf);
+    }
+
+    // The lookup tables including the inherited members and the initiating
+    // handles. The ones of a fork are split between the base and the fork.
+    for (const auto* p : {&classes().base_graph_property(),
+                          &classes()[boost::graph_bundle]}) {
+        for (const auto& x : p->jvm_hdl_to_vertex) {
+            w.append(sec_class_jvm_lut,
+                     image_jvm_type_entry{unsigned(x.first.loader_hdl),
+                                          w.string_idx(x.first.descriptor),
+                                          uint32_t(x.second)});
+        }
+        for (const auto& x : p->hdl_to_vertex) {
+            w.append(sec_class_lut,
+                     image_hdl_entry{static_cast<uint64_t>(x.first),
+                                     x.second});
+        }
+    }
+    for (const auto* p : {&methods().base_graph_property(),
+                          &methods()[boost::graph_bundle]}) {
+        for (const auto& x : p->jvm_hdl_to_vertex) {
+            const auto& h = x.first;
+            w.append(sec_method_jvm_lut,
+                     image_jvm_member_entry{unsigned(h.type_hdl.loader_hdl),
+                                            w.string_idx(h.type_hdl.descriptor),
+                                            w.string_idx(h.unique_name),
+                                            uint32_t(x.second)});
+        }
+        for (const auto& x : p->hdl_to_vertex) {
+            w.append(sec_method_lut,
+                     image_hdl_entry{static_cast<uint64_t>(x.first),
+                                     x.second});
+        }
+    }
+    for (const auto* p : {&fields().base_graph_property(),
+                          &fields()[boost::graph_bundle]}) {
+        for (const auto& x : p->jvm_hdl_to_vertex) {
+            const auto& h = x.first;
+            w.append(sec_field_jvm_lut,
+                     image_jvm_member_entry{unsigned(h.type_hdl.loader_hdl),
+                                            w.string_idx(h.type_hdl.descriptor),
+                                            w.string_idx(h.unique_name),
+                                            uint32_t(x.second)});
+        }
+        for (const auto& x : p->hdl_to_vertex) {
+            w.append(sec_field_lut,
+                     image_hdl_entry{static_cast<uint64_t>(x.first),
+                                     x.second});
+        }
+    }
+
+    w.save(filename);
+}
+
+bool virtual_machine::load_image(const std::string& filename)
+{
+    if (sealed_ || num_vertices(classes_) != 0 || num_vertices(methods_) != 0
+        || num_vertices(fields_) != 0) {
+        std::stringstream ss;
+        ss << "cannot load the image into a virtual machine with classes: ";
+        ss << filename;
+        throw std::runtime_error(ss.str());
+    }
+
+    boost::iostreams::mapped_file_source file;
+    try {
+        file.open(filename);
+    }
+    catch (const std::exception&) {
+        // No image file.
+        return false;
+    }
+    if (!file.is_open()) {
+        return false;
+    }
+    image_reader r(file);
+    if (!r.valid()) {
+        return false;
+    }
+
+    // Check if the image is made from the same class loaders and DEX files.
+    {
+        auto loaders = r.section<image_loader>(sec_loaders);
+        auto dex_files = r.section<image_dex_file>(sec_dex_files);
+        if (loaders.size() != num_vertices(*loaders_)) {
+            return false;
+        }
+        auto idf = dex_files.begin();
+        for (const auto& v : boost::make_iterator_range(vertices(*loaders_))) {
+            const auto& loader = (*loaders_)[v].loader;
+            const auto& il = loaders[v];
+            if (il.hdl != unsigned(loader.hdl())
+                || il.dex_files_size != loader.dex_files().size()
+                || il.dex_files_size > size_t(dex_files.end() - idf)) {
+                return false;
+            }
+            for (const auto& df : loader.dex_files()) {
+                if (std::memcmp(idf->signature, df.header().signature,
+                                sizeof(idf->signature))
+                            != 0
+                    || idf->file_size != df.header().file_size
+                    || idf->level != uint32_t(df.level())) {
+                    return false;
+                }
+                ++idf;
+            }
+        }
+
+        std::vector<image_loader_edge> parents;
+        for (const auto& e : boost::make_iterator_range(edges(*loaders_))) {
+            if (edge_cast<loader_parent_edge_property>(&(*loaders_)[e])) {
+                parents.push_back({uint32_t(source(e, *loaders_)),
+                                   uint32_t(target(e, *loaders_))});
+            }
+        }
+        auto image_parents = r.section<image_loader_edge>(sec_loader_edges);
+        if (!std::equal(begin(parents), end(parents), image_parents.begin(),
+                        image_parents.end(),
+                        [](const image_loader_edge& x,
+                           const image_loader_edge& y) {
+                            return x.source == y.source
+                                    && x.target == y.target;
+                        })) {
+            return false;
+        }
+    }
+
+    // Validate the references so that a broken image never makes us read
+    // outside of it.
+    const auto chars = r.section<char>(sec_chars);
+    const auto string_offs = r.section<uint32_t>(sec_string_offs);
+    const auto classes = r.section<image_class>(sec_classes);
+    const auto methods = r.section<image_method>(sec_methods);
+    const auto params = r.section<image_param>(sec_params);
+    const auto fields = r.section<image_field>(sec_fields);
+    auto valid_string = [&](uint32_t idx) { return idx < string_offs.size(); };
+    auto valid_edges = [&](image_section_id id, size_t n) {
+        for (const auto& e : r.section<image_super_edge>(id)) {
+            if (e.source >= n || e.target >= n) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto valid_loader = [&](uint32_t loader) {
+        return !!find_loader_vertex(loader, *loaders_);
+    };
+    auto valid_file = [&](uint64_t hdl) {
+        auto fh = unpack_file_hdl(hdl >> 32);
+        auto lv = find_loader_vertex(fh.loader_hdl, *loaders_);
+        return lv && fh.idx < (*loaders_)[*lv].loader.dex_files().size();
+    };
+    auto valid_hdls = [&](const image_range& range) {
+        const auto hdls = r.hdls(range);
+        return hdls.size() == range.size
+                && std::all_of(hdls.begin(), hdls.end(), valid_file);
+    };
+    for (const auto& c : classes) {
+        // The superclass precedes the class.
+        const auto idx = uint32_t(&c - classes.begin());
+        if (!valid_string(c.descriptor) || !valid_loader(c.loader)
+            || !valid_file(c.hdl)
+            || (c.super != image_no_vertex && c.super >= idx)
+            || !valid_hdls(c.static_fields) || !valid_hdls(c.instance_fields)
+            || !valid_hdls(c.dtable) || !valid_hdls(c.vtable)) {
+            return false;
+        }
+    }
+    for (const auto& m : methods) {
+        if (!valid_string(m.descriptor) || !valid_string(m.unique_name)
+            || !valid_loader(m.loader) || !valid_file(m.hdl)
+            || !valid_file(m.class_hdl)
+            || uint64_t(m.params.begin) + m.params.size > params.size()) {
+            return false;
+        }
+    }
+    for (const auto& p : params) {
+        if (!valid_string(p.descriptor) || !valid_string(p.name)) {
+            return false;
+        }
+    }
+    for (const auto& f : fields) {
+        if (!valid_string(f.descriptor) || !valid_string(f.name)
+            || !valid_loader(f.loader) || !valid_file(f.hdl)
+            || !valid_file(f.class_hdl)) {
+            return false;
+        }
+    }
+    if (!valid_edges(sec_class_edges, classes.size())
+        || !valid_edges(sec_method_edges, methods.size())) {
+        return false;
+    }
+    for (const auto& x : r.section<image_jvm_type_entry>(sec_class_jvm_lut)) {
+        if (!valid_string(x.descriptor) || !valid_loader(x.loader)
+            || x.vertex >= classes.size()) {
+            return false;
+        }
+    }
+    auto valid_member_lut = [&](image_section_id id, size_t n) {
+        for (const auto& x : r.section<image_jvm_member_entry>(id)) {
+            if (!valid_string(x.descriptor) || !valid_string(x.name)
+                || !valid_loader(x.loader) || x.vertex >= n) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto valid_hdl_lut = [&](image_section_id id, size_t n) {
+        for (const auto& x : r.section<image_hdl_entry>(id)) {
+            if (!valid_file(x.hdl) || x.vertex >= n) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (!valid_member_lut(sec_method_jvm_lut, methods.size())
+        || !valid_member_lut(sec_field_jvm_lut, fields.size())
+        || !valid_hdl_lut(sec_class_lut, classes.size())
+        || !valid_hdl_lut(sec_method_lut, methods.size())
+        || !valid_hdl_lut(sec_field_lut, fields.size())) {
+        return false;
+    }
+
+    // Intern the strings.
+    std::vector<symbol> symbols;
+    symbols.reserve(string_offs.size());
+    for (const auto& off : string_offs) {
+        symbols.emplace_back(boost::string_view(chars.begin() + off));
+    }
+
+    // Rebuild the graphs. The sections are not laid out for using them in
+    // place, so every vertex, edge and lookup table entry is added again.
+
+    // The classes.
+    auto& cprop = classes_[boost::graph_bundle];
+    for (const auto& c : classes) {
+        class_vertex_property vp;
+        if (c.super != image_no_vertex) {
+            // Share the entries of the superclass.
+            const auto& sp = classes_[c.super];
+            vp.static_fields = sp.static_fields;
+            vp.instance_fields = sp.instance_fields;
+            vp.dtable = sp.dtable;
+            vp.vtable = sp.vtable;
+        }
+        auto append_hdls = [&](auto& table, const image_range& range) {
+            using hdl_type = typename std::decay_t<decltype(table)>::value_type;
+            for (const auto& x : r.hdls(range)) {
+                table.push_back(unpack_hdl<hdl_type>(x));
+            }
+        };
+        vp.hdl = unpack_hdl<dex_type_hdl>(c.hdl);
+        vp.jvm_hdl = {c.loader, symbols[c.descriptor]};
+        vp.access_flags = dex_access_flags(c.access_flags);
+        append_hdls(vp.static_fields, c.static_fields);
+        append_hdls(vp.instance_fields, c.instance_fields);
+        append_hdls(vp.dtable, c.dtable);
+        append_hdls(vp.vtable, c.vtable);
+        vp.static_size = c.static_size;
+        vp.instance_size = c.instance_size;
+        add_vertex(std::move(vp), classes_);
+    }
+    for (const auto& e : r.section<image_super_edge>(sec_class_edges)) {
+        add_edge(e.source, e.target,
+                 class_super_edge_property{e.interface != 0}, classes_);
+    }
+    cprop.jvm_hdl_to_vertex.reserve(
+            r.section<image_jvm_type_entry>(sec_class_jvm_lut).size());
+    for (const auto& x : r.section<image_jvm_type_entry>(sec_class_jvm_lut)) {
+        cprop.jvm_hdl_to_vertex[{x.loader, symbols[x.descriptor]}] = x.vertex;
+    }
+    cprop.hdl_to_vertex.reserve(
+            r.section<image_hdl_entry>(sec_class_lut).size());
+    for (const auto& x : r.section<image_hdl_entry>(sec_class_lut)) {
+        cprop.hdl_to_vertex[unpack_hdl<dex_type_hdl>(x.hdl)] = x.vertex;
+    }
+
+    // The methods. The instruction graphs are built from the DEX files.
+    auto& mprop = methods_[boost::graph_bundle];
+    for (const auto& m : methods) {
+        method_vertex_property vp;
+        vp.hdl = unpack_hdl<dex_method_hdl>(m.hdl);
+        vp.jvm_hdl = {{m.loader, symbols[m.descriptor]},
+                      symbols[m.unique_name]};
+        vp.class_hdl = unpack_hdl<dex_type_hdl>(m.class_hdl);
+        vp.access_flags = dex_access_flags(m.access_flags);
+        vp.params.reserve(m.params.size);
+        for (unsigned i = 0; i < m.params.size; ++i) {
+            const auto& p = params[m.params.begin + i];
+            vp.params.push_back(
+                    {symbols[p.descriptor].str(), symbols[p.name].str()});
+        }
+        const auto& fh = vp.hdl.file_hdl;
+        auto lv = find_loader_vertex(fh.loader_hdl, *loaders_);
+        const auto& loader = (*loaders_)[*lv].loader;
+        vp.insns = loader.dex_files()[fh.idx].make_lazy_insn_graph(m.code_off,
+                                                                   vp.hdl);
+        auto v = add_vertex(std::move(vp), methods_);
+        methods_[v].insns.set_cache(mprop.insn_cache);
+    }
+    for (const auto& e : r.section<image_super_edge>(sec_method_edges)) {
+        add_edge(e.source, e.target,
+                 method_super_edge_property{e.interface != 0}, methods_);
+    }
+    mprop.jvm_hdl_to_vertex.reserve(
+            r.section<image_jvm_member_entry>(sec_method_jvm_lut).size());
+    for (const auto& x :
+         r.section<image_jvm_member_entry>(sec_method_jvm_lut)) {
+        mprop.jvm_hdl_to_vertex[{{x.loader, symbols[x.descriptor]},
+                                 symbols[x.name]}] = x.vertex;
+    }
+    mprop.hdl_to_vertex.reserve(
+            r.section<image_hdl_entry>(sec_method_lut).size());
+    for (const auto& x : r.section<image_hdl_entry>(sec_method_lut)) {
+        mprop.hdl_to_vertex[unpack_hdl<dex_method_hdl>(x.hdl)] = x.vertex;
+    }
+
+    // Rebuild the vtable indices from the method names.
+    for (const auto& c : classes) {
+        const auto v = class_vertex_descriptor(&c - classes.begin());
+        auto slots = std::make_shared<vtable_index>(
+                c.super != image_no_vertex ? classes_[c.super].vtable_slots
+                                           : nullptr);
+        const auto& vtable = classes_[v].vtable;
+        for (auto i = vtable.size() - c.vtable.size; i < vtable.size(); ++i) {
+            if (auto mv = lookup_method_vertex(vtable[i], methods_)) {
+                slots->insert(methods_[*mv].jvm_hdl.unique_name, i);
+            }
+        }
+        classes_[v].vtable_slots = std::move(slots);
+    }
+
+    // The fields.
+    auto& fprop = fields_[boost::graph_bundle];
+    for (const auto& f : fields) {
+        field_vertex_property vp;
+        vp.kind = f.kind == field_vertex_property::static_field
+                ? field_vertex_property::static_field
+                : field_vertex_property::instance_field;
+        vp.hdl = unpack_hdl<dex_field_hdl>(f.hdl);
+        vp.jvm_hdl = {{f.loader, symbols[f.descriptor]}, symbols[f.name]};
+        vp.class_hdl = unpack_hdl<dex_type_hdl>(f.class_hdl);
+        vp.access_flags = dex_access_flags(f.access_flags);
+        vp.offset = f.offset;
+        vp.size = f.size;
+        vp.type_char = f.type_char;
+        add_vertex(std::move(vp), fields_);
+    }
+    fprop.jvm_hdl_to_vertex.reserve(
+            r.section<image_jvm_member_entry>(sec_field_jvm_lut).size());
+    for (const auto& x : r.section<image_jvm_member_entry>(sec_field_jvm_lut)) {
+        fprop.jvm_hdl_to_vertex[{{x.loader, symbols[x.descriptor]},
+                                 symbols[x.name]}] = x.vertex;
+    }
+    fprop.hdl_to_vertex.reserve(
+            r.section<image_hdl_entry>(sec_field_lut).size());
+    for (const auto& x : r.section<image_hdl_entry>(sec_field_lut)) {
+        fprop.hdl_to_vertex[unpack_hdl<dex_field_hdl>(x.hdl)] = x.vertex;
+    }
+
+    // Forget the classes that failed to load before.
+    ++loaders_generation_;
+
+    return true;
+}
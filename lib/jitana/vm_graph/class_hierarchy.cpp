@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_graph/class_hierarchy.hpp"
+
+#include <algorithm>
+
+using namespace jitana;
+
+constexpr uint32_t class_hierarchy::no_interface;
+
+void class_hierarchy::update(const class_graph& g)
+{
+    const auto first = size();
+    const auto n = num_vertices(g);
+    if (first == n) {
+        return;
+    }
+
+    interface_ids_.resize(n, no_interface);
+    interfaces_.resize(n);
+    superclass_.resize(n, class_graph::null_vertex());
+    added_subclasses_.resize(n);
+
+    // The supertypes precede the added classes, so their bitsets are ready.
+    for (auto v = first; v < n; ++v) {
+        auto& bits = interfaces_[v];
+        for (const auto& e : boost::make_iterator_range(in_edges(v, g))) {
+            auto p = edge_cast<class_super_edge_property>(&g[e]);
+            if (!p) {
+                continue;
+            }
+            const auto sv = source(e, g);
+            const auto& super_bits = interfaces_[sv];
+            if (bits.size() < super_bits.size()) {
+                bits.resize(super_bits.size());
+            }
+            for (auto id = super_bits.find_first(); id != super_bits.npos;
+                 id = super_bits.find_next(id)) {
+                bits.set(id);
+            }
+            if (p->interface) {
+                auto& id = interface_ids_[sv];
+                if (id == no_interface) {
+                    id = implementors_.size();
+                    implementors_.emplace_back();
+                }
+                if (bits.size() <= id) {
+                    bits.resize(id + 1);
+                }
+                bits.set(id);
+            }
+        }
+        for (auto id = bits.find_first(); id != bits.npos;
+             id = bits.find_next(id)) {
+            implementors_[id].push_back(v);
+        }
+
+        if (auto sv = superclass_vertex(v, g)) {
+            superclass_[v] = *sv;
+        }
+    }
+
+    // Renumber once the added classes outnumber the numbered ones. Until
+    // then, only link the added classes to their superclasses.
+    if (n - numbered_ > numbered_) {
+        renumber(g);
+        return;
+    }
+    for (auto v = first; v < n; ++v) {
+        if (superclass_[v] != class_graph::null_vertex()) {
+            added_subclasses_[superclass_[v]].push_back(v);
+        }
+    }
+}
+
+std::vector<class_vertex_descriptor>
+class_hierarchy::subclasses(class_vertex_descriptor v) const
+{
+    std::vector<class_vertex_descriptor> result;
+    if (v < numbered_) {
+        result.assign(begin(order_) + pre_[v], begin(order_) + last_[v] + 1);
+    }
+    else {
+        result.push_back(v);
+    }
+
+    // Append the subclasses added since the last renumbering.
+    if (numbered_ < size()) {
+        for (size_t i = 0; i < result.size(); ++i) {
+            const auto& x = added_subclasses_[result[i]];
+            result.insert(end(result), begin(x), end(x));
+        }
+    }
+    return result;
+}
+
+std::vector<class_vertex_descriptor>
+class_hierarchy::subtypes(class_vertex_descriptor v) const
+{
+    auto result = subclasses(v);
+    const auto id = interface_ids_[v];
+    if (id != no_interface) {
+        // The implementors already include their subclasses.
+        const auto& x = implementors_[id];
+        result.insert(end(result), begin(x), end(x));
+    }
+    return result;
+}
+
+void class_hierarchy::renumber(const class_graph& g)
+{
+    const auto n = num_vertices(g);
+    pre_.assign(n, 0);
+    last_.assign(n, 0);
+    order_.clear();
+    order_.reserve(n);
+    numbered_ = n;
+    for (auto& x : added_subclasses_) {
+        x.clear();
+    }
+
+    // Number the superclass trees in preorder.
+    std::vector<class_vertex_descriptor> stack;
+    for (class_vertex_descriptor root = 0; root < n; ++root) {
+        if (superclass_[root] != class_graph::null_vertex()) {
+            continue;
+        }
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const auto v = stack.back();
+            stack.pop_back();
+            pre_[v] = order_.size();
+            order_.push_back(v);
+            for (const auto& e : boost::make_iterator_range(out_edges(v, g))) {
+                auto p = edge_cast<class_super_edge_property>(&g[e]);
+                if (p && !p->interface) {
+                    stack.push_back(target(e, g));
+                }
+            }
+        }
+    }
+
+    // The interval of a class ends at its last descendant, which is numbered
+    // before any of the ancestors in reverse preorder.
+    for (auto i = order_.size(); i-- > 0;) {
+        const auto v = order_[i];
+        last_[v] = std::max(last_[v], pre_[v]);
+        const auto sv = superclass_[v];
+        if (sv != class_graph::null_vertex()) {
+            last_[sv] = std::max(last_[sv], last_[v]);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_graph/compact_insn_graph.hpp"
+
+#include <boost/range/iterator_range.hpp>
+
+using namespace jitana;
+
+compact_insn_graph jitana::make_compact_insn_graph(const insn_graph& g)
+{
+    compact_insn_graph cg(num_vertices(g));
+
+    const auto& gprop = g[boost::graph_bundle];
+    auto& cgprop = cg[boost::graph_bundle];
+    cgprop.hdl = gprop.hdl;
+    cgprop.jvm_hdl = gprop.jvm_hdl;
+    cgprop.try_catches = gprop.try_catches;
+    cgprop.registers_size = gprop.registers_size;
+    cgprop.ins_size = gprop.ins_size;
+    cgprop.outs_size = gprop.outs_size;
+    cgprop.insns_off = gprop.insns_off;
+    cgprop.def_use_edges = gprop.def_use_edges;
+    cgprop.exception_edges = gprop.exception_edges;
+
+    for (auto v : boost::make_iterator_range(vertices(g))) {
+        cg[v].insn = make_compact_insn(g[v].insn, cgprop.operands);
+        cg[v].off = g[v].off;
+        cg[v].line_num = g[v].line_num;
+    }
+    cgprop.operands.wide_consts.shrink_to_fit();
+    cgprop.operands.strings.shrink_to_fit();
+    cgprop.operands.array_payloads.shrink_to_fit();
+    cgprop.operands.file_hdls.shrink_to_fit();
+
+    for (auto e : boost::make_iterator_range(edges(g))) {
+        add_edge(source(e, g), target(e, g), g[e], cg);
+    }
+
+    return cg;
+}
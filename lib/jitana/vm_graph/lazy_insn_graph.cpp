@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_graph/lazy_insn_graph.hpp"
+#include "jitana/analysis/def_use.hpp"
+
+using namespace jitana;
+using namespace jitana::detail;
+
+namespace {
+    /// Returns the rough estimate of the memory used by the edge array of a
+    /// graph with n vertices in bytes.
+    template <typename EdgeProperty>
+    size_t estimate_memory_size(const insn_edge_array<EdgeProperty>& a,
+                                size_t n)
+    {
+        // The edges, the index by the target, and the offsets of both ends.
+        using edge_type = typename insn_edge_array<EdgeProperty>::edge_type;
+        return a.size() * (sizeof(edge_type) + sizeof(uint32_t))
+                + 2 * (n + 1) * sizeof(uint32_t);
+    }
+
+    /// Returns the rough estimate of the memory used by the graph in bytes.
+    size_t estimate_memory_size(const insn_graph& g)
+    {
+        // Each vertex has the property and the in/out edge lists, and each
+        // edge is stored in the edge list and referenced from both ends.
+        constexpr size_t vertex_size
+                = sizeof(insn_vertex_property) + 2 * sizeof(std::vector<int>);
+        constexpr size_t edge_size
+                = sizeof(insn_edge_property) + 6 * sizeof(void*);
+        constexpr size_t offset_entry_size = 4 * sizeof(void*);
+
+        const auto& gprop = g[boost::graph_bundle];
+        const auto n = num_vertices(g);
+        return sizeof(insn_graph) + n * vertex_size + num_edges(g) * edge_size
+                + gprop.offset_to_vertex.size() * offset_entry_size
+                + gprop.try_catches.size() * sizeof(try_catch_block)
+                + estimate_memory_size(gprop.def_use_edges, n)
+                + estimate_memory_size(gprop.exception_edges, n);
+    }
+
+    /// Returns the rough estimate of the memory used by the compact graph in
+    /// bytes.
+    size_t estimate_memory_size(const compact_insn_graph& g)
+    {
+        constexpr size_t vertex_size = sizeof(compact_insn_vertex_property)
+                + 2 * sizeof(std::vector<int>);
+        constexpr size_t edge_size
+                = sizeof(insn_edge_property) + 6 * sizeof(void*);
+
+        const auto& gprop = g[boost::graph_bundle];
+        const auto& ops = gprop.operands;
+        const auto n = num_vertices(g);
+        return sizeof(compact_insn_graph) + n * vertex_size
+                + num_edges(g) * edge_size
+                + gprop.try_catches.size() * sizeof(try_catch_block)
+                + ops.wide_consts.size() * sizeof(ops.wide_consts[0])
+                + ops.strings.size() * sizeof(ops.strings[0])
+                + ops.array_payloads.size() * sizeof(ops.array_payloads[0])
+                + ops.file_hdls.size() * sizeof(ops.file_hdls[0])
+                + estimate_memory_size(gprop.def_use_edges, n)
+                + estimate_memory_size(gprop.exception_edges, n);
+    }
+
+    /// Returns true if the slot has anything the cache can evict.
+    bool evictable(const lazy_insn_graph_slot& s)
+    {
+        return (std::atomic_load(&s.graph) && !s.pinned)
+                || std::atomic_load(&s.compact);
+    }
+
+    /// Returns the estimated memory used by the evictable parts of the slot.
+    size_t evictable_size(const lazy_insn_graph_slot& s)
+    {
+        return (std::atomic_load(&s.graph) && !s.pinned ? s.graph_size.load()
+                                                        : 0)
+                + (std::atomic_load(&s.compact) ? s.compact_size.load() : 0);
+    }
+
+    /// Drops the evictable parts of the slot.
+    void drop(lazy_insn_graph_slot& s)
+    {
+        if (!s.pinned) {
+            std::atomic_store(&s.graph, std::shared_ptr<insn_graph>());
+        }
+        std::atomic_store(&s.compact,
+                          std::shared_ptr<const compact_insn_graph>());
+    }
+}
+
+void insn_graph_cache::set_budget(size_t budget)
+{
+    budget_ = budget;
+    shrink(nullptr);
+}
+
+void insn_graph_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto* s : lru_) {
+        drop(*s);
+        s->cached = false;
+    }
+    lru_.clear();
+    size_ = 0;
+}
+
+void insn_graph_cache::update(lazy_insn_graph_slot* s)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (s->cached) {
+        unlink(s);
+    }
+    if (evictable(*s)) {
+        s->size = evictable_size(*s);
+        s->lru_it = lru_.insert(lru_.begin(), s);
+        s->cached = true;
+        size_ += s->size;
+    }
+}
+
+void insn_graph_cache::erase(lazy_insn_graph_slot* s)
+{
+    // Another thread may have evicted the slot since the caller saw it.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (s->cached) {
+        unlink(s);
+    }
+}
+
+void insn_graph_cache::touch(lazy_insn_graph_slot* s)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (s->cached) {
+        lru_.splice(lru_.begin(), lru_, s->lru_it);
+    }
+}
+
+void insn_graph_cache::shrink(const lazy_insn_graph_slot* keep)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto budget = budget_.load();
+    while (budget != 0 && size_ > budget && !lru_.empty()) {
+        auto* s = lru_.back();
+        if (s == keep) {
+            // Never evict the graph being accessed.
+            break;
+        }
+        unlink(s);
+        drop(*s);
+    }
+}
+
+void insn_graph_cache::unlink(lazy_insn_graph_slot* s)
+{
+    lru_.erase(s->lru_it);
+    s->cached = false;
+    size_ -= s->size;
+}
+
+lazy_insn_graph_slot::~lazy_insn_graph_slot()
+{
+    if (cache) {
+        cache->erase(this);
+    }
+}
+
+lazy_insn_graph::lazy_insn_graph(insn_graph g)
+{
+    *this = std::move(g);
+}
+
+lazy_insn_graph::lazy_insn_graph(
+        std::shared_ptr<const insn_graph_source> source, uint32_t code_off,
+        const dex_method_hdl& hdl)
+        : slot_(std::make_shared<lazy_insn_graph_slot>())
+{
+    slot_->source = std::move(source);
+    slot_->code_off = code_off;
+    slot_->hdl = hdl;
+}
+
+lazy_insn_graph& lazy_insn_graph::operator=(insn_graph g)
+{
+    auto s = std::make_shared<lazy_insn_graph_slot>();
+    s->graph = std::make_shared<insn_graph>(std::move(g));
+    s->pinned = true;
+    if (slot_) {
+        s->cache = slot_->cache;
+    }
+    slot_ = std::move(s);
+    return *this;
+}
+
+void lazy_insn_graph::evict()
+{
+    if (!slot_ || slot_->pinned || !slot_->source) {
+        return;
+    }
+
+    if (slot_->cache) {
+        slot_->cache->erase(slot_.get());
+    }
+    drop(*slot_);
+}
+
+void lazy_insn_graph::set_cache(std::shared_ptr<insn_graph_cache> cache)
+{
+    if (!slot_) {
+        return;
+    }
+
+    if (slot_->cache) {
+        slot_->cache->erase(slot_.get());
+    }
+    slot_->cache = std::move(cache);
+    if (slot_->cache && evictable(*slot_)) {
+        slot_->cache->update(slot_.get());
+        slot_->cache->shrink(slot_.get());
+    }
+}
+
+std::shared_ptr<insn_graph> lazy_insn_graph::materialize() const
+{
+    if (!slot_) {
+        return empty_graph();
+    }
+
+    auto& s = *slot_;
+    auto g = std::atomic_load(&s.graph);
+    if (g) {
+        if (s.cache && s.cache->budget() != 0) {
+            s.cache->touch(&s);
+        }
+        return g;
+    }
+
+    {
+        // Only one thread builds the graph. The cache is updated after
+        // releasing the lock since evicting other slots never takes it.
+        std::lock_guard<std::mutex> lock(s.mutex);
+        g = std::atomic_load(&s.graph);
+        if (g) {
+            return g;
+        }
+        g = std::make_shared<insn_graph>(
+                s.source->make_insn_graph(s.code_off, s.hdl));
+        s.graph_size = estimate_memory_size(*g);
+        std::atomic_store(&s.graph, g);
+    }
+    if (s.cache) {
+        s.cache->update(&s);
+        s.cache->shrink(&s);
+    }
+
+    return g;
+}
+
+std::shared_ptr<const compact_insn_graph> lazy_insn_graph::share_compact() const
+{
+    if (!slot_) {
+        static const auto g
+                = std::make_shared<const compact_insn_graph>();
+        return g;
+    }
+
+    auto& s = *slot_;
+    std::shared_ptr<const compact_insn_graph> compact
+            = std::atomic_load(&s.compact);
+    if (compact) {
+        if (s.cache && s.cache->budget() != 0) {
+            s.cache->touch(&s);
+        }
+        return compact;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        compact = std::atomic_load(&s.compact);
+        if (compact) {
+            return compact;
+        }
+        const auto graph = std::atomic_load(&s.graph);
+        auto g = std::make_shared<compact_insn_graph>(
+                graph ? make_compact_insn_graph(*graph)
+                      : make_compact_insn_graph(
+                                s.source->make_insn_graph(s.code_off, s.hdl)));
+        add_def_use_edges(*g);
+        s.compact_size = estimate_memory_size(*g);
+        compact = std::move(g);
+        std::atomic_store(&s.compact, compact);
+    }
+    if (s.cache) {
+        s.cache->update(&s);
+        s.cache->shrink(&s);
+    }
+
+    return compact;
+}
+
+insn_graph& lazy_insn_graph::pin()
+{
+    if (!slot_) {
+        *this = insn_graph();
+        return *slot_->graph;
+    }
+
+    if (slot_.use_count() > 1) {
+        // Detach from the other copies.
+        auto s = std::make_shared<lazy_insn_graph_slot>();
+        s->source = slot_->source;
+        s->code_off = slot_->code_off;
+        s->hdl = slot_->hdl;
+        s->cache = slot_->cache;
+        s->graph = std::make_shared<insn_graph>(*materialize());
+        s->graph_size = estimate_memory_size(*s->graph);
+        slot_ = std::move(s);
+    }
+    else {
+        materialize();
+    }
+
+    // Nothing is left to evict once the graph is pinned.
+    std::atomic_store(&slot_->compact,
+                      std::shared_ptr<const compact_insn_graph>());
+    slot_->pinned = true;
+    if (slot_->cache) {
+        slot_->cache->erase(slot_.get());
+    }
+
+    return *slot_->graph;
+}
+
+const std::shared_ptr<insn_graph>& lazy_insn_graph::empty_graph()
+{
+    static const auto g = std::make_shared<insn_graph>();
+    return g;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "jitana/vm_graph/method_dispatch.hpp"
+
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace jitana;
+
+namespace {
+    boost::optional<method_vertex_descriptor>
+    overridden_method(method_vertex_descriptor v, const method_graph& mg)
+    {
+        for (const auto& e : boost::make_iterator_range(in_edges(v, mg))) {
+            if (edge_cast<method_super_edge_property>(&mg[e])) {
+                return source(e, mg);
+            }
+        }
+        return boost::none;
+    }
+}
+
+void method_dispatch::update(const class_graph& cg, const method_graph& mg)
+{
+    // Add the overriding methods. A new method is the last one directly
+    // overriding its super method, and it overrides nothing yet.
+    std::unordered_map<class_vertex_descriptor,
+                       std::vector<method_vertex_descriptor>>
+            overrides;
+    const auto first_mv = direct_overriders_.size();
+    direct_overriders_.resize(num_vertices(mg));
+    for (auto mv = first_mv; mv < num_vertices(mg); ++mv) {
+        if (auto super_mv = overridden_method(mv, mg)) {
+            direct_overriders_[*super_mv].push_back(mv);
+            if (auto cv = lookup_class_vertex(mg[mv].class_hdl, cg)) {
+                overrides[*cv].push_back(mv);
+            }
+        }
+    }
+
+    // Make the dispatch tables of the new classes from the ones of the
+    // superclasses.
+    const auto first_cv = tables_.size();
+    tables_.resize(num_vertices(cg));
+    for (auto cv = first_cv; cv < num_vertices(cg); ++cv) {
+        const auto& vtable = cg[cv].vtable;
+        auto& table = tables_[cv];
+        if (auto super_cv = superclass_vertex(cv, cg)) {
+            if (tables_[*super_cv].size() <= vtable.size()) {
+                table = tables_[*super_cv];
+            }
+        }
+        for (auto i = table.size(); i < vtable.size(); ++i) {
+            auto mv = lookup_method_vertex(vtable[i], mg);
+            if (!mv) {
+                throw std::runtime_error("invalid vtable entry");
+            }
+            table.push_back(*mv);
+        }
+
+        auto it = overrides.find(cv);
+        if (it == end(overrides)) {
+            continue;
+        }
+        const auto& slots = *cg[cv].vtable_slots;
+        for (const auto& mv : it->second) {
+            if (auto slot = slots.find(mg[mv].jvm_hdl.unique_name)) {
+                table.set(*slot, mv);
+            }
+        }
+    }
+}
+
+std::vector<method_vertex_descriptor>
+method_dispatch::overriding_methods(method_vertex_descriptor v) const
+{
+    // Visit the direct overriders in the order of addition.
+    std::vector<method_vertex_descriptor> result;
+    const auto& children = direct_overriders_[v];
+    std::vector<method_vertex_descriptor> stack(children.rbegin(),
+                                                children.rend());
+    while (!stack.empty()) {
+        const auto mv = stack.back();
+        stack.pop_back();
+        result.push_back(mv);
+        const auto& x = direct_overriders_[mv];
+        stack.insert(end(stack), x.rbegin(), x.rend());
+    }
+    return result;
+}
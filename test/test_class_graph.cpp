@@ -19,8 +19,14 @@
 #include <boost/test/unit_test.hpp>
 
 #include <jitana/jitana.hpp>
+#include <jitana/analysis/cha_call_graph.hpp>
+#include <jitana/analysis/def_use.hpp>
 
-void add_loaders(jitana::virtual_machine& vm)
+#include <thread>
+#include <vector>
+
+void add_loaders(jitana::virtual_machine& vm,
+                 jitana::load_level level = jitana::load_level::full)
 {
     {
         const auto& filenames = {"../../dex/framework/core.dex",
@@ -40,7 +46,7 @@ void add_loaders(jitana::virtual_machine& vm)
     {
         const auto& filenames = {"../../dex/small_tests/02/02.dex"};
         jitana::class_loader loader(22, "SmallTest02", begin(filenames),
-                                    end(filenames));
+                                    end(filenames), level);
         vm.add_loader(loader, 11);
     }
 }
@@ -86,3 +92,351 @@ BOOST_AUTO_TEST_CASE(predicates)
     BOOST_CHECK(!is_superclass_of(*a_v, *x_v, cg));
     BOOST_CHECK(!is_superclass_of(*x_v, *a_v, cg));
 }
+
+BOOST_AUTO_TEST_CASE(class_hierarchy)
+{
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+
+    auto o_v = vm.find_class({11, "Ljava/lang/Object;"}, true);
+    auto a_v = vm.find_class({22, "LA;"}, true);
+    BOOST_REQUIRE(!!o_v);
+    BOOST_REQUIRE(!!a_v);
+
+    jitana::class_hierarchy h(vm.classes());
+
+    // Load more classes after building the index.
+    auto b_v = vm.find_class({22, "LB;"}, true);
+    auto x_v = vm.find_class({22, "LX;"}, true);
+    auto s_v = vm.find_class({11, "Ljava/lang/String;"}, true);
+    auto c_v = vm.find_class({11, "Ljava/lang/CharSequence;"}, true);
+    BOOST_REQUIRE(!!b_v);
+    BOOST_REQUIRE(!!x_v);
+    BOOST_REQUIRE(!!s_v);
+    BOOST_REQUIRE(!!c_v);
+    h.update(vm.classes());
+    BOOST_CHECK_EQUAL(h.size(), num_vertices(vm.classes()));
+
+    // The results must agree with is_superclass_of().
+    const auto& cg = vm.classes();
+    for (auto sub : {*o_v, *a_v, *b_v, *x_v, *s_v, *c_v}) {
+        for (auto super : {*o_v, *a_v, *b_v, *x_v, *s_v, *c_v}) {
+            BOOST_CHECK_EQUAL(h.is_subtype_of(sub, super),
+                              is_superclass_of(super, sub, cg));
+        }
+    }
+    BOOST_CHECK(h.is_subtype_of(*s_v, *c_v));
+    BOOST_CHECK(!h.is_subclass_of(*s_v, *c_v));
+
+    const auto subtypes = h.subtypes(*a_v);
+    BOOST_CHECK(std::count(begin(subtypes), end(subtypes), *b_v) == 1);
+    BOOST_CHECK(std::count(begin(subtypes), end(subtypes), *o_v) == 0);
+    BOOST_CHECK_EQUAL(h.subclasses(*o_v).size(), num_vertices(cg));
+}
+
+BOOST_AUTO_TEST_CASE(load_all_classes_parallel)
+{
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    vm.load_all_classes(11);
+    vm.load_all_classes(22);
+
+    jitana::virtual_machine vm_parallel;
+    add_loaders(vm_parallel);
+    vm_parallel.load_all_classes({11, 22}, 4);
+
+    // The vertex numbering must not depend on the number of threads.
+    const auto& cg = vm.classes();
+    const auto& cg_parallel = vm_parallel.classes();
+    BOOST_REQUIRE(num_vertices(cg) == num_vertices(cg_parallel));
+    for (const auto& v : boost::make_iterator_range(vertices(cg))) {
+        BOOST_CHECK(cg[v].hdl == cg_parallel[v].hdl);
+    }
+
+    const auto& mg = vm.methods();
+    const auto& mg_parallel = vm_parallel.methods();
+    BOOST_REQUIRE(num_vertices(mg) == num_vertices(mg_parallel));
+    BOOST_CHECK(num_edges(mg) == num_edges(mg_parallel));
+    for (const auto& v : boost::make_iterator_range(vertices(mg))) {
+        BOOST_CHECK(mg[v].hdl == mg_parallel[v].hdl);
+        BOOST_CHECK(num_vertices(*mg[v].insns.share())
+                    == num_vertices(*mg_parallel[v].insns.share()));
+    }
+
+    BOOST_CHECK(num_vertices(vm.fields())
+                == num_vertices(vm_parallel.fields()));
+}
+
+BOOST_AUTO_TEST_CASE(insn_graph_budget)
+{
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    vm.load_all_classes(22);
+
+    jitana::virtual_machine vm_budget;
+    add_loaders(vm_budget);
+    vm_budget.set_insn_graph_budget(64 * 1024);
+    vm_budget.load_all_classes(22);
+
+    // Evicted graphs must be rebuilt identically.
+    const auto& mg = vm.methods();
+    const auto& mg_budget = vm_budget.methods();
+    BOOST_REQUIRE(num_vertices(mg) == num_vertices(mg_budget));
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const auto& v : boost::make_iterator_range(vertices(mg))) {
+            const auto ig = mg[v].insns.share();
+            const auto ig_budget = mg_budget[v].insns.share();
+            BOOST_CHECK(num_vertices(*ig) == num_vertices(*ig_budget));
+            BOOST_CHECK(num_edges(*ig) == num_edges(*ig_budget));
+        }
+    }
+
+    const auto& cache = *mg_budget[boost::graph_bundle].insn_cache;
+    BOOST_CHECK(cache.size() <= cache.budget() || cache.count() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(load_level)
+{
+    struct load_stats {
+        size_t methods = 0;
+        size_t insns = 0;
+        size_t line_nums = 0;
+        size_t param_names = 0;
+    };
+
+    // Count the instructions, the line numbers and the parameter names of
+    // the methods in the small test loaded at the level.
+    auto load = [](jitana::load_level level) {
+        jitana::virtual_machine vm;
+        add_loaders(vm, level);
+        vm.load_all_classes(22);
+
+        load_stats s;
+        const auto& cvm = vm;
+        const auto& mg = cvm.methods();
+        for (const auto& v : boost::make_iterator_range(vertices(mg))) {
+            if (mg[v].jvm_hdl.type_hdl.loader_hdl != 22) {
+                continue;
+            }
+            ++s.methods;
+            for (const auto& p : mg[v].params) {
+                s.param_names += !p.name.empty();
+            }
+            const auto ig = mg[v].insns.share();
+            s.insns += num_vertices(*ig);
+            for (const auto& iv : boost::make_iterator_range(vertices(*ig))) {
+                s.line_nums += (*ig)[iv].line_num != 0;
+            }
+        }
+        return s;
+    };
+
+    const auto signatures = load(jitana::load_level::signatures);
+    const auto code = load(jitana::load_level::code);
+    const auto full = load(jitana::load_level::full);
+
+    // The same methods are loaded at every level.
+    BOOST_REQUIRE(full.methods > 0);
+    BOOST_CHECK_EQUAL(signatures.methods, full.methods);
+    BOOST_CHECK_EQUAL(code.methods, full.methods);
+
+    // The signatures only: the instruction graphs are empty.
+    BOOST_CHECK_EQUAL(signatures.insns, 0u);
+    BOOST_CHECK_EQUAL(signatures.line_nums, 0u);
+    BOOST_CHECK_EQUAL(signatures.param_names, 0u);
+
+    // The code without the debug information.
+    BOOST_CHECK(code.insns > 0);
+    BOOST_CHECK_EQUAL(code.line_nums, 0u);
+    BOOST_CHECK_EQUAL(code.param_names, 0u);
+
+    // Everything.
+    BOOST_CHECK_EQUAL(full.insns, code.insns);
+    BOOST_CHECK(full.line_nums > 0);
+    BOOST_CHECK(full.param_names > 0);
+}
+
+BOOST_AUTO_TEST_CASE(fork_virtual_machine)
+{
+    jitana::virtual_machine base;
+    add_loaders(base);
+    base.load_all_classes(11);
+    const auto n_classes = num_vertices(base.classes());
+
+    // The fork sees the classes of the base, and the classes loaded into it
+    // stay in the fork.
+    const jitana::jvm_type_hdl object_hdl = {11, "Ljava/lang/Object;"};
+    const auto n_edges = num_edges(base.classes());
+    auto vm = base.fork();
+    BOOST_CHECK(!!vm.find_class(object_hdl, false));
+    vm.load_all_classes(22);
+    BOOST_CHECK(num_vertices(vm.classes()) > n_classes);
+    BOOST_CHECK(!!vm.find_class({22, "LA;"}, false));
+
+    // The base is shared: the fork finds its classes without copying the
+    // lookup tables, and the edges from them to the new classes stay in the
+    // fork.
+    const auto& cvm = vm;
+    const auto& cg = cvm.classes();
+    BOOST_CHECK(cg[boost::graph_bundle].jvm_hdl_to_vertex.count(object_hdl)
+                == 0);
+    auto out_degree_of_base = [&](const jitana::class_graph& g) {
+        size_t n = 0;
+        for (size_t v = 0; v < n_classes; ++v) {
+            n += out_degree(v, g);
+        }
+        return n;
+    };
+    BOOST_CHECK(out_degree_of_base(cg) > out_degree_of_base(base.classes()));
+
+    BOOST_CHECK(num_vertices(base.classes()) == n_classes);
+    BOOST_CHECK(num_edges(base.classes()) == n_edges);
+    BOOST_CHECK(!base.find_class({22, "LA;"}, false));
+}
+
+BOOST_AUTO_TEST_CASE(insn_graph_budget_shared)
+{
+    jitana::virtual_machine base;
+    base.set_insn_graph_budget(64 * 1024);
+
+    // The budget cannot be changed while a fork shares the cache.
+    {
+        auto vm = base.fork();
+        BOOST_CHECK_THROW(vm.set_insn_graph_budget(0), std::runtime_error);
+        BOOST_CHECK_THROW(base.set_insn_graph_budget(0), std::runtime_error);
+    }
+    base.set_insn_graph_budget(0);
+}
+
+BOOST_AUTO_TEST_CASE(load_recursive_parallel)
+{
+    const jitana::jvm_method_hdl mh
+            = {{11, "Ljava/lang/Object;"}, "toString()Ljava/lang/String;"};
+
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    auto mv = vm.find_method(mh, true);
+    BOOST_REQUIRE(!!mv);
+    const auto visited = vm.load_recursive(*mv);
+
+    jitana::virtual_machine vm_parallel;
+    add_loaders(vm_parallel);
+    auto mv_parallel = vm_parallel.find_method(mh, true);
+    BOOST_REQUIRE(!!mv_parallel);
+    const auto visited_parallel = vm_parallel.load_recursive(*mv_parallel, 4);
+
+    // The classes must be loaded in the same order.
+    BOOST_CHECK(visited == visited_parallel);
+    const auto& cg = vm.classes();
+    const auto& cg_parallel = vm_parallel.classes();
+    BOOST_REQUIRE(num_vertices(cg) == num_vertices(cg_parallel));
+    for (const auto& v : boost::make_iterator_range(vertices(cg))) {
+        BOOST_CHECK(cg[v].hdl == cg_parallel[v].hdl);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(method_dispatch)
+{
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    vm.load_all_classes(22);
+
+    auto o_v = vm.find_class({11, "Ljava/lang/Object;"}, true);
+    auto mv = vm.find_method(
+            {{11, "Ljava/lang/Object;"}, "toString()Ljava/lang/String;"},
+            true);
+    BOOST_REQUIRE(!!o_v);
+    BOOST_REQUIRE(!!mv);
+
+    const auto& d = vm.dispatch();
+    const auto& cvm = vm;
+    const auto& cg = cvm.classes();
+    const auto& mg = cvm.methods();
+
+    // Every class dispatches toString() to the nearest declaration.
+    auto slot = cg[*o_v].vtable_slots->find(mg[*mv].jvm_hdl.unique_name);
+    BOOST_REQUIRE(!!slot);
+    const auto overriders = d.overriding_methods(*mv);
+    for (const auto& cv : boost::make_iterator_range(vertices(cg))) {
+        auto target = d.dispatch(cv, *slot);
+        if (!target) {
+            continue;
+        }
+        const auto n = std::count(overriders.begin(), overriders.end(),
+                                  *target);
+        BOOST_CHECK(*target == *mv || n == 1);
+
+        const jitana::jvm_method_hdl mh
+                = {cg[cv].jvm_hdl, mg[*mv].jvm_hdl.unique_name};
+        BOOST_CHECK(target == vm.find_method(mh, false));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(loader_hdl_range)
+{
+    jitana::virtual_machine vm;
+    const std::vector<std::string> filenames;
+
+    // A handle that does not fit in the packed layout is rejected before
+    // the lookup table grows.
+    jitana::class_loader bad(0xffffffff, "Bad", begin(filenames),
+                             end(filenames));
+    BOOST_CHECK_THROW(vm.add_loader(bad), std::runtime_error);
+    const auto& cvm = vm;
+    BOOST_CHECK_EQUAL(num_vertices(cvm.loaders()), 0);
+
+    jitana::class_loader good((1u << jitana::class_loader_hdl_bits) - 1,
+                              "Good", begin(filenames), end(filenames));
+    auto v = vm.add_loader(good);
+    BOOST_CHECK(jitana::find_loader_vertex(good.hdl(), cvm.loaders()) == v);
+}
+
+BOOST_AUTO_TEST_CASE(sealed_parallel_analyses)
+{
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    vm.set_insn_graph_budget(64 * 1024);
+    vm.load_all_classes(22);
+    vm.seal();
+
+    // The graphs of a sealed virtual machine are read-only.
+    BOOST_CHECK_THROW(vm.methods(), std::runtime_error);
+
+    const auto& cvm = vm;
+    const auto& mg = cvm.methods();
+    std::vector<jitana::method_vertex_descriptor> entry_points;
+    for (const auto& v : boost::make_iterator_range(vertices(mg))) {
+        if (mg[v].class_hdl.file_hdl.loader_hdl == 22) {
+            entry_points.push_back(v);
+        }
+    }
+    BOOST_REQUIRE(!entry_points.empty());
+
+    // The instruction graphs are built and evicted concurrently.
+    constexpr unsigned n_threads = 4;
+    std::vector<size_t> n_call_edges(n_threads);
+    std::vector<size_t> n_def_use_edges(n_threads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < n_threads; ++i) {
+        threads.emplace_back([&, i] {
+            auto ccg = jitana::make_cha_call_graph(vm, entry_points);
+            n_call_edges[i] = num_edges(ccg);
+            for (const auto& v : boost::make_iterator_range(vertices(mg))) {
+                auto ig = *mg[v].insns.share();
+                jitana::add_def_use_edges(ig);
+                n_def_use_edges[i]
+                        += ig[boost::graph_bundle].def_use_edges.size();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (unsigned i = 1; i < n_threads; ++i) {
+        BOOST_CHECK(n_call_edges[i] == n_call_edges[0]);
+        BOOST_CHECK(n_def_use_edges[i] == n_def_use_edges[0]);
+    }
+    const auto& cache = *mg[boost::graph_bundle].insn_cache;
+    BOOST_CHECK(cache.size() <= cache.budget() || cache.count() <= n_threads);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_class_hierarchy
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/vm_graph/class_hierarchy.hpp>
+
+#include <algorithm>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(incremental_update)
+{
+    jitana::class_graph g;
+    jitana::class_hierarchy h;
+
+    // Add the classes one by one like the on-the-fly loading does, and
+    // check every pair after each update, before and after renumbering.
+    // The class 0 is the root, the class 1 is an interface implemented by
+    // every third class, and the others extend a random earlier class.
+    add_vertex(g);
+    add_vertex(g);
+    unsigned seed = 1;
+    while (num_vertices(g) < 40) {
+        const auto v = add_vertex(g);
+        seed = seed * 1103515245 + 12345;
+        auto sv = (seed >> 16) % v;
+        add_edge(sv == 1 ? 0 : sv, v, jitana::class_super_edge_property{false},
+                 g);
+        if (v % 3 == 0) {
+            add_edge(1, v, jitana::class_super_edge_property{true}, g);
+        }
+        h.update(g);
+        BOOST_REQUIRE_EQUAL(h.size(), num_vertices(g));
+
+        for (const auto& sub : boost::make_iterator_range(vertices(g))) {
+            for (const auto& super : boost::make_iterator_range(vertices(g))) {
+                BOOST_CHECK_EQUAL(h.is_subtype_of(sub, super),
+                                  jitana::is_superclass_of(super, sub, g));
+            }
+        }
+        for (const auto& super : boost::make_iterator_range(vertices(g))) {
+            auto subclasses = h.subclasses(super);
+            BOOST_CHECK_EQUAL(subclasses.front(), super);
+            std::sort(begin(subclasses), end(subclasses));
+            std::vector<jitana::class_vertex_descriptor> expected;
+            for (const auto& sub : boost::make_iterator_range(vertices(g))) {
+                if (h.is_subclass_of(sub, super)) {
+                    expected.push_back(sub);
+                }
+            }
+            BOOST_CHECK(subclasses == expected);
+        }
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_dex_index
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/vm_core/dex_file.hpp>
+#include <jitana/vm_core/dex_index.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace jitana;
+using namespace jitana::detail;
+
+namespace {
+    /// The offset of the fake code item in the DEX file.
+    constexpr uint32_t code_off = 0x80;
+
+    /// Makes a DEX file with no IDs followed by a fake code item and a string
+    /// that has no NUL terminator.
+    std::vector<uint8_t> make_dex(uint32_t method_ids_size)
+    {
+        std::vector<uint8_t> dex(code_off + 16 + 4 * 2 + 4);
+        dex_header h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, "dex\n035", 8);
+        std::memset(h.signature, 0x5a, sizeof(h.signature));
+        h.file_size = dex.size();
+        h.header_size = sizeof(h);
+        h.method_ids_size = method_ids_size;
+        std::memcpy(dex.data(), &h, sizeof(h));
+        std::memcpy(dex.data() + dex.size() - 4, "abcd", 4);
+        return dex;
+    }
+
+    dex_index make_index(uint32_t method_idx,
+                         std::vector<uint32_t> string_data_offs = {})
+    {
+        return dex_index({dex_index_bucket{0, dex_index_bucket::empty_bucket}},
+                         {dex_code_off_entry{code_off, 4, {method_idx}}},
+                         std::move(string_data_offs));
+    }
+
+    void save(const dex_index& index, const std::vector<uint8_t>& dex,
+              const std::string& filename)
+    {
+        index.save(filename, *reinterpret_cast<const dex_header*>(dex.data()));
+    }
+
+    std::string read_file(const std::string& filename)
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        return {std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>()};
+    }
+
+    void write_file(const std::string& filename, const std::string& contents)
+    {
+        std::ofstream(filename, std::ios::binary | std::ios::trunc)
+                << contents;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reject_broken_sidecar)
+{
+    const std::string filename = "test_dex_index.jidx";
+    auto dex = make_dex(1);
+    const auto* dex_begin = dex.data();
+    const auto* dex_end = dex.data() + dex.size();
+
+    // A valid index.
+    save(make_index(0), dex, filename);
+    auto index = dex_index::open(filename, dex_begin, dex_end);
+    BOOST_REQUIRE(index);
+    BOOST_CHECK_EQUAL(index->code_offs().size(), 1);
+    BOOST_CHECK_EQUAL(index->string_data_offs().size(), 0);
+
+    // Truncated.
+    const auto contents = read_file(filename);
+    write_file(filename, contents.substr(0, contents.size() - 4));
+    BOOST_CHECK(!dex_index::open(filename, dex_begin, dex_end));
+    write_file(filename, contents.substr(0, 32));
+    BOOST_CHECK(!dex_index::open(filename, dex_begin, dex_end));
+
+    // The method index is out of range.
+    save(make_index(1), dex, filename);
+    BOOST_CHECK(!dex_index::open(filename, dex_begin, dex_end));
+
+    // The code item is outside of the mapped DEX file even though the size
+    // in the header covers it.
+    save(make_index(0), dex, filename);
+    BOOST_CHECK(!dex_index::open(filename, dex_begin, dex_end - 8));
+
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(reject_unterminated_string)
+{
+    const std::string filename = "test_dex_index.jidx";
+    auto dex = make_dex(1);
+    auto* h = reinterpret_cast<dex_header*>(dex.data());
+    h->string_ids_size = 1;
+    const auto* dex_begin = dex.data();
+    const auto* dex_end = dex.data() + dex.size();
+
+    // The string in the header is terminated.
+    save(make_index(0, {8}), dex, filename);
+    BOOST_CHECK(dex_index::open(filename, dex_begin, dex_end));
+
+    // The last string has no NUL terminator.
+    save(make_index(0, {uint32_t(dex.size() - 4)}), dex, filename);
+    BOOST_CHECK(!dex_index::open(filename, dex_begin, dex_end));
+
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(rebuild_broken_sidecar)
+{
+    const std::string filename = "test_dex_index.dex";
+    const auto sidecar = dex_index::sidecar_filename(filename);
+    auto dex = make_dex(0);
+    const auto* dex_begin = dex.data();
+    const auto* dex_end = dex.data() + dex.size();
+
+    // The sidecar refers to a method that does not exist. The DEX file
+    // rebuilds the index, which has no code item, instead of using it.
+    save(make_index(0), dex, sidecar);
+    BOOST_CHECK(!dex_index::open(sidecar, dex_begin, dex_end));
+    dex_file df({0, 0}, filename, dex_begin, dex_end);
+    BOOST_CHECK(!df.find_method_hdl(code_off + 16));
+
+    std::remove(sidecar.c_str());
+}
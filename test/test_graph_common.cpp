@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_graph_common
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/vm_graph/graph_common.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    struct small_edge_property {
+        int value;
+    };
+
+    void print_graphviz_attr(std::ostream& os,
+                             const small_edge_property& prop)
+    {
+        os << "small=" << prop.value;
+    }
+
+    struct large_edge_property {
+        std::string value;
+        std::vector<int> extra;
+    };
+
+    void print_graphviz_attr(std::ostream& os,
+                             const large_edge_property& prop)
+    {
+        os << "large=" << prop.value;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(edge_kinds)
+{
+    using jitana::edge_cast;
+
+    jitana::any_edge_property empty;
+    BOOST_CHECK(empty.empty());
+    BOOST_CHECK(edge_cast<small_edge_property>(&empty) == nullptr);
+
+    std::vector<jitana::any_edge_property> props;
+    for (int i = 0; i < 100; ++i) {
+        if (i % 2 == 0) {
+            props.push_back(small_edge_property{i});
+        }
+        else {
+            props.push_back(large_edge_property{std::to_string(i), {i}});
+        }
+    }
+
+    // Copy, then modify the originals through a cast.
+    auto copies = props;
+    for (auto& p : props) {
+        if (auto* q = edge_cast<small_edge_property>(&p)) {
+            q->value = -1;
+        }
+        else if (auto* q = edge_cast<large_edge_property>(&p)) {
+            q->value = "-1";
+        }
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        const auto& p = copies[i];
+        BOOST_CHECK_EQUAL(p.is<small_edge_property>(), i % 2 == 0);
+        BOOST_CHECK_EQUAL(p.is<large_edge_property>(), i % 2 != 0);
+
+        std::stringstream ss;
+        print_graphviz_attr(ss, p);
+        if (i % 2 == 0) {
+            BOOST_CHECK_EQUAL(edge_cast<small_edge_property>(&p)->value, i);
+            BOOST_CHECK_EQUAL(ss.str(), "small=" + std::to_string(i));
+        }
+        else {
+            BOOST_CHECK_EQUAL(edge_cast<large_edge_property>(&p)->value,
+                              std::to_string(i));
+            BOOST_CHECK_EQUAL(ss.str(), "large=" + std::to_string(i));
+        }
+    }
+
+    // Moving leaves the source empty.
+    auto moved = std::move(copies[1]);
+    BOOST_CHECK(copies[1].empty());
+    BOOST_CHECK_EQUAL(edge_cast<large_edge_property>(&moved)->value, "1");
+    moved = props[0];
+    BOOST_CHECK_EQUAL(edge_cast<small_edge_property>(&moved)->value, -1);
+}
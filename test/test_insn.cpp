@@ -20,6 +20,9 @@
 
 #include <jitana/jitana.hpp>
 
+#include <algorithm>
+#include <vector>
+
 BOOST_AUTO_TEST_CASE(check_equality)
 {
     using opcode = jitana::opcode;
@@ -72,3 +75,100 @@ BOOST_AUTO_TEST_CASE(check_equality)
     BOOST_CHECK(i4 != i6);
 #endif
 }
+
+BOOST_AUTO_TEST_CASE(compact_insn_round_trip)
+{
+    using opcode = jitana::opcode;
+    using jitana::register_idx;
+
+    jitana::array_payload payload{4, 2, {1, 2, 3, 4, 5, 6, 7, 8}};
+    std::vector<jitana::insn> insns = {
+            jitana::insn_move(opcode::op_move, {{0, 1}}, {}),
+            jitana::insn_const_wide(opcode::op_const_wide, {{2}},
+                                    0x123456789abcdefll),
+            jitana::insn_const_string(opcode::op_const_string, {{3}},
+                                      {5, "Hello, world!"}),
+            jitana::insn_fill_array_data(opcode::op_fill_array_data, {{4}},
+                                         payload),
+            jitana::insn_iget(opcode::op_iget, {{0, 1}}, {{1, 2}, 3}),
+            jitana::insn_invoke(opcode::op_invoke_virtual_range,
+                                {{10, register_idx::idx_unknown,
+                                  register_idx::idx_unknown,
+                                  register_idx::idx_unknown, 13}},
+                                {{1, 2}, 3}),
+            jitana::insn_const_arith_op(opcode::op_add_int_lit16, {{5, 6}},
+                                        -7),
+            jitana::insn_exit(opcode::op_nop, {{register_idx::idx_result}},
+                              {})};
+
+    jitana::compact_insn_operands operands;
+    for (const auto& x : insns) {
+        auto cx = jitana::make_compact_insn(x, operands);
+        BOOST_CHECK(decode_insn(cx, operands) == x);
+        BOOST_CHECK(op(cx) == op(x));
+        BOOST_CHECK(defs(cx) == defs(x));
+        BOOST_CHECK(uses(cx) == uses(x));
+        BOOST_CHECK(is_pseudo(cx) == is_pseudo(x));
+    }
+    BOOST_CHECK_EQUAL(operands.wide_consts.size(), 1);
+    BOOST_CHECK_EQUAL(operands.strings.size(), 1);
+    BOOST_CHECK_EQUAL(operands.array_payloads.size(), 1);
+    BOOST_CHECK_EQUAL(operands.file_hdls.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(insn_edge_array)
+{
+    using edge_array
+            = jitana::insn_edge_array<jitana::insn_def_use_edge_property>;
+
+    auto reg = [](size_t u, size_t v) {
+        return jitana::register_idx(uint16_t(u + v));
+    };
+
+    edge_array a;
+    BOOST_CHECK(a.empty());
+    BOOST_CHECK(a.in_edges(3).empty());
+    BOOST_CHECK(a.out_edges(3).empty());
+
+    std::vector<edge_array::edge_type> edges;
+    for (size_t u = 0; u < 10; ++u) {
+        for (size_t v = 0; v < 10; ++v) {
+            if ((u * 7 + v * 3) % 4 == 0) {
+                edges.push_back({u, v, {reg(u, v)}});
+            }
+        }
+    }
+    std::reverse(begin(edges), end(edges));
+    const auto expected = edges;
+    a.assign(edges, 10);
+    BOOST_CHECK_EQUAL(a.size(), expected.size());
+
+    for (size_t v = 0; v < 10; ++v) {
+        size_t n_out = 0;
+        for (const auto& e : a.out_edges(v)) {
+            BOOST_CHECK_EQUAL(e.source, v);
+            BOOST_CHECK(e.prop.reg == reg(e.source, e.target));
+            ++n_out;
+        }
+        size_t n_in = 0;
+        for (const auto& e : a.in_edges(v)) {
+            BOOST_CHECK_EQUAL(e.target, v);
+            BOOST_CHECK(e.prop.reg == reg(e.source, e.target));
+            ++n_in;
+        }
+        BOOST_CHECK_EQUAL(n_out, std::count_if(begin(expected), end(expected),
+                                               [&](const auto& e) {
+                                                   return e.source == v;
+                                               }));
+        BOOST_CHECK_EQUAL(n_in, std::count_if(begin(expected), end(expected),
+                                              [&](const auto& e) {
+                                                  return e.target == v;
+                                              }));
+    }
+
+    // Replacing the edges drops the old ones.
+    a.assign({{1, 2, {reg(2, 3)}}}, 10);
+    BOOST_CHECK_EQUAL(a.size(), 1);
+    BOOST_CHECK_EQUAL(a.in_edges(2).size(), 1);
+    BOOST_CHECK(a.in_edges(3).empty());
+}
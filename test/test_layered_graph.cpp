@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_layered_graph
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/vm_graph/layered_graph.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/range/iterator_range.hpp>
+
+namespace {
+    struct graph_property {
+        std::unordered_map<std::string, std::size_t> name_to_vertex;
+    };
+
+    using graph = jitana::layered_graph<std::string, int, graph_property>;
+
+    graph::vertex_descriptor add_named_vertex(const std::string& name,
+                                              graph& g)
+    {
+        auto v = add_vertex(name, g);
+        g[boost::graph_bundle].name_to_vertex[name] = v;
+        return v;
+    }
+
+    std::vector<std::size_t> out_targets(std::size_t v, const graph& g)
+    {
+        std::vector<std::size_t> x;
+        for (const auto& e : boost::make_iterator_range(out_edges(v, g))) {
+            x.push_back(target(e, g));
+        }
+        return x;
+    }
+
+    std::vector<std::size_t> in_sources(std::size_t v, const graph& g)
+    {
+        std::vector<std::size_t> x;
+        for (const auto& e : boost::make_iterator_range(in_edges(v, g))) {
+            x.push_back(source(e, g));
+        }
+        return x;
+    }
+
+    std::size_t lookup(const std::string& name, const graph& g)
+    {
+        auto v = jitana::lookup_layered_vertex(name, g,
+                                               &graph_property::name_to_vertex);
+        return v ? *v : graph::null_vertex();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fork_adds_on_top)
+{
+    graph base;
+    auto a = add_named_vertex("a", base);
+    auto b = add_named_vertex("b", base);
+    add_edge(a, b, 1, base);
+
+    auto fork = base.fork();
+    auto c = add_named_vertex("c", fork);
+    add_edge(b, c, 2, fork);
+    add_edge(a, c, 3, fork);
+    add_edge(c, a, 4, fork);
+
+    // The vertices and edges of the base come first.
+    BOOST_CHECK_EQUAL(c, 2u);
+    BOOST_CHECK_EQUAL(num_vertices(fork), 3u);
+    BOOST_CHECK_EQUAL(num_edges(fork), 4u);
+    std::vector<int> eprops;
+    for (const auto& e : boost::make_iterator_range(edges(fork))) {
+        eprops.push_back(fork[e]);
+    }
+    BOOST_CHECK((eprops == std::vector<int>{1, 2, 3, 4}));
+
+    // The edges of the base are merged with the ones added to its vertices.
+    BOOST_CHECK((out_targets(a, fork) == std::vector<std::size_t>{b, c}));
+    BOOST_CHECK((out_targets(b, fork) == std::vector<std::size_t>{c}));
+    BOOST_CHECK((out_targets(c, fork) == std::vector<std::size_t>{a}));
+    BOOST_CHECK((in_sources(a, fork) == std::vector<std::size_t>{c}));
+    BOOST_CHECK((in_sources(c, fork) == std::vector<std::size_t>{b, a}));
+    BOOST_CHECK_EQUAL(out_degree(a, fork), 2u);
+    BOOST_CHECK_EQUAL(in_degree(b, fork), 1u);
+
+    // The base is unchanged.
+    BOOST_CHECK_EQUAL(num_vertices(base), 2u);
+    BOOST_CHECK_EQUAL(num_edges(base), 1u);
+    BOOST_CHECK((out_targets(a, base) == std::vector<std::size_t>{b}));
+    BOOST_CHECK(out_targets(b, base).empty());
+    BOOST_CHECK(in_sources(a, base).empty());
+}
+
+BOOST_AUTO_TEST_CASE(modify_base_property)
+{
+    graph base;
+    auto a = add_named_vertex("a", base);
+    auto b = add_named_vertex("b", base);
+    auto e = add_edge(a, b, 1, base).first;
+
+    auto fork = base.fork();
+    fork[a] = "x";
+    fork[e] = 10;
+
+    const auto& cfork = fork;
+    BOOST_CHECK_EQUAL(cfork[a], "x");
+    BOOST_CHECK_EQUAL(cfork[b], "b");
+    BOOST_CHECK_EQUAL(cfork[e], 10);
+    BOOST_CHECK_EQUAL(base[a], "a");
+    BOOST_CHECK_EQUAL(base[e], 1);
+
+    // Modifying the base copies its layer instead of changing the fork.
+    base[b] = "y";
+    add_vertex("z", base);
+    BOOST_CHECK_EQUAL(cfork[b], "b");
+    BOOST_CHECK_EQUAL(num_vertices(fork), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(lookup_falls_through)
+{
+    graph base;
+    auto a = add_named_vertex("a", base);
+
+    auto fork = base.fork();
+    auto b = add_named_vertex("b", fork);
+
+    BOOST_CHECK_EQUAL(lookup("a", fork), a);
+    BOOST_CHECK_EQUAL(lookup("b", fork), b);
+    BOOST_CHECK(fork[boost::graph_bundle].name_to_vertex.count("a") == 0);
+    BOOST_CHECK_EQUAL(lookup("b", base), graph::null_vertex());
+
+    // The forks of a fork share the same base and copy the layer.
+    auto fork2 = fork.fork();
+    auto c = add_named_vertex("c", fork2);
+    BOOST_CHECK_EQUAL(lookup("a", fork2), a);
+    BOOST_CHECK_EQUAL(lookup("b", fork2), b);
+    BOOST_CHECK_EQUAL(lookup("c", fork2), c);
+    BOOST_CHECK_EQUAL(lookup("c", fork), graph::null_vertex());
+    BOOST_CHECK_EQUAL(num_vertices(fork), 2u);
+}
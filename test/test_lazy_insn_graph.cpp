@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_lazy_insn_graph
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/jitana.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+    /// Builds a chain of move instructions and counts the builds.
+    class chain_source : public jitana::insn_graph_source {
+    public:
+        jitana::insn_graph
+        make_insn_graph(uint32_t code_off,
+                        const jitana::dex_method_hdl& hdl) const override
+        {
+            ++builds;
+
+            using opcode = jitana::opcode;
+            jitana::insn_graph g;
+            g[boost::graph_bundle].hdl = hdl;
+            g[boost::graph_bundle].insns_off = code_off;
+            for (unsigned i = 0; i < 64; ++i) {
+                jitana::insn_vertex_property prop;
+                prop.insn = jitana::insn_move(opcode::op_move,
+                                              {{uint16_t(i % 4), 0}}, {});
+                prop.off = i;
+                auto v = add_vertex(prop, g);
+                if (v > 0) {
+                    add_edge(v - 1, v,
+                             jitana::insn_control_flow_edge_property(), g);
+                }
+            }
+            return g;
+        }
+
+        mutable std::atomic<unsigned> builds{0};
+    };
+
+    std::vector<jitana::lazy_insn_graph>
+    make_graphs(const std::shared_ptr<chain_source>& source, size_t n,
+                const std::shared_ptr<jitana::insn_graph_cache>& cache)
+    {
+        std::vector<jitana::lazy_insn_graph> graphs;
+        for (size_t i = 0; i < n; ++i) {
+            graphs.emplace_back(source, 16 * (i + 1),
+                                jitana::dex_method_hdl({0, 0}, i));
+            graphs.back().set_cache(cache);
+        }
+        return graphs;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compact_counted_in_budget)
+{
+    auto source = std::make_shared<chain_source>();
+    auto cache = std::make_shared<jitana::insn_graph_cache>();
+    auto graphs = make_graphs(source, 8, cache);
+
+    // The compact graphs are evictable even though the graphs are not built.
+    for (const auto& g : graphs) {
+        BOOST_CHECK(g.share_compact());
+        BOOST_CHECK(!g.materialized());
+    }
+    BOOST_CHECK_EQUAL(source->builds, 8);
+    BOOST_CHECK_EQUAL(cache->count(), 8);
+    BOOST_CHECK_GT(cache->size(), 0);
+    const auto compact_size = cache->size() / 8;
+
+    // Building the graph adds to the size of the same entry.
+    const auto& g0 = graphs[0];
+    BOOST_CHECK_EQUAL(num_vertices(*g0.share()), 64);
+    BOOST_CHECK_EQUAL(cache->count(), 8);
+    BOOST_CHECK_GT(cache->size(), 8 * compact_size);
+
+    // Shrinking evicts the least recently used compact graphs, and they are
+    // rebuilt on the next access.
+    cache->set_budget(3 * compact_size);
+    BOOST_CHECK_LE(cache->size(), 3 * compact_size);
+    BOOST_CHECK_LT(cache->count(), 8);
+    const auto builds = source->builds.load();
+    BOOST_CHECK(graphs[1].share_compact());
+    BOOST_CHECK_EQUAL(source->builds, builds + 1);
+
+    // Pinning drops the compact graph from the cache.
+    cache->set_budget(0);
+    auto& g7 = graphs[7];
+    g7.share_compact();
+    const auto count = cache->count();
+    add_vertex(jitana::insn_vertex_property(), *g7);
+    BOOST_CHECK(g7.pinned());
+    BOOST_CHECK_EQUAL(cache->count(), count - 1);
+
+    cache->clear();
+    BOOST_CHECK_EQUAL(cache->count(), 0);
+    BOOST_CHECK_EQUAL(cache->size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_const_access)
+{
+    auto source = std::make_shared<chain_source>();
+    auto cache = std::make_shared<jitana::insn_graph_cache>();
+    const auto graphs = make_graphs(source, 32, cache);
+
+    // Boost.Test assertions are not thread-safe, so the threads count the
+    // graphs with the wrong number of vertices instead.
+    std::atomic<unsigned> errors{0};
+    auto run = [&](unsigned n_threads, unsigned passes) {
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < n_threads; ++i) {
+            threads.emplace_back([&, i] {
+                for (unsigned pass = 0; pass < passes; ++pass) {
+                    for (size_t j = 0; j < graphs.size(); ++j) {
+                        const auto& g = graphs[(i * 8 + j) % graphs.size()];
+                        auto ig = g.share();
+                        auto cig = g.share_compact();
+                        if (num_vertices(*ig) != 64
+                            || num_vertices(*cig) != 64) {
+                            ++errors;
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    };
+
+    // Each graph is built once while there is no budget, and the compact
+    // graphs are made from them.
+    run(4, 1);
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_EQUAL(source->builds, graphs.size());
+    BOOST_CHECK_EQUAL(cache->count(), graphs.size());
+
+    // The graphs are evicted and rebuilt while the other threads read them.
+    const auto budget = cache->size() / 4;
+    cache->set_budget(budget);
+    run(4, 8);
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_GT(source->builds, graphs.size());
+
+    // The accounting is consistent after the concurrent updates.
+    cache->set_budget(budget);
+    BOOST_CHECK_LE(cache->size(), budget);
+    cache->clear();
+    BOOST_CHECK_EQUAL(cache->count(), 0);
+    BOOST_CHECK_EQUAL(cache->size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_evict)
+{
+    auto source = std::make_shared<chain_source>();
+    auto cache = std::make_shared<jitana::insn_graph_cache>();
+    auto graphs = make_graphs(source, 16, cache);
+    const auto others = make_graphs(source, 16, cache);
+    graphs[0].share();
+    cache->set_budget(cache->size() * 4);
+
+    // One thread evicts and destroys its graphs while the other one makes
+    // the cache evict them by building its own.
+    std::thread t([&] {
+        for (unsigned pass = 0; pass < 64; ++pass) {
+            for (const auto& g : others) {
+                g.share();
+            }
+        }
+    });
+    for (unsigned pass = 0; pass < 64; ++pass) {
+        for (auto& g : graphs) {
+            g.share();
+            g.evict();
+            g.share();
+        }
+    }
+    graphs.clear();
+    t.join();
+
+    // Only the graphs that are still alive are counted.
+    BOOST_CHECK_LE(cache->count(), others.size());
+    cache->clear();
+    BOOST_CHECK_EQUAL(cache->size(), 0);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_method_dispatch
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/vm_graph/method_dispatch.hpp>
+
+#include <vector>
+
+namespace {
+    jitana::method_vertex_descriptor
+    add_method(jitana::method_graph& mg,
+               boost::optional<jitana::method_vertex_descriptor> super_mv)
+    {
+        auto mv = add_vertex(mg);
+        if (super_mv) {
+            add_edge(*super_mv, mv, jitana::method_super_edge_property{false},
+                     mg);
+        }
+        return mv;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(overriding_methods)
+{
+    jitana::class_graph cg;
+    jitana::method_graph mg;
+
+    // 0 <- 1 <- 2, 0 <- 3 <- 4 <- 5.
+    auto m0 = add_method(mg, boost::none);
+    auto m1 = add_method(mg, m0);
+    auto m2 = add_method(mg, m1);
+    auto m3 = add_method(mg, m0);
+
+    jitana::method_dispatch d(cg, mg);
+    BOOST_CHECK(d.is_current(cg, mg));
+    const auto before = d.overriding_methods(m0);
+
+    // The methods added by the update are visited after their siblings.
+    auto m4 = add_method(mg, m3);
+    auto m5 = add_method(mg, m4);
+    auto m6 = add_method(mg, m1);
+    BOOST_CHECK(!d.is_current(cg, mg));
+    d.update(cg, mg);
+    BOOST_CHECK(d.is_current(cg, mg));
+
+    using list = std::vector<jitana::method_vertex_descriptor>;
+    BOOST_CHECK((before == list{m1, m2, m3}));
+    BOOST_CHECK((d.overriding_methods(m0) == list{m1, m2, m6, m3, m4, m5}));
+    BOOST_CHECK((d.overriding_methods(m1) == list{m2, m6}));
+    BOOST_CHECK((d.overriding_methods(m3) == list{m4, m5}));
+    BOOST_CHECK(d.overriding_methods(m5).empty());
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_persistent_vector
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/util/persistent_vector.hpp>
+
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(shared_prefix)
+{
+    // Grow a chain of copies like the vtables of a class hierarchy, and
+    // compare each of them with a plain vector.
+    std::vector<jitana::persistent_vector<int>> vs(1);
+    std::vector<std::vector<int>> expected(1);
+    for (int depth = 1; depth < 40; ++depth) {
+        auto v = vs.back();
+        auto e = expected.back();
+        for (int i = 0; i < depth * 7; ++i) {
+            v.push_back(depth * 10000 + i);
+            e.push_back(depth * 10000 + i);
+        }
+        vs.push_back(std::move(v));
+        expected.push_back(std::move(e));
+    }
+
+    // Appending to a copy must not change the original.
+    auto branch = vs[20];
+    branch.push_back(-1);
+
+    for (size_t d = 0; d < vs.size(); ++d) {
+        BOOST_REQUIRE_EQUAL(vs[d].size(), expected[d].size());
+        for (size_t i = 0; i < expected[d].size(); ++i) {
+            BOOST_REQUIRE_EQUAL(vs[d][i], expected[d][i]);
+        }
+        BOOST_CHECK(std::equal(vs[d].begin(), vs[d].end(),
+                               expected[d].begin(), expected[d].end()));
+    }
+    BOOST_CHECK_EQUAL(branch.size(), vs[20].size() + 1);
+    BOOST_CHECK_EQUAL(branch[vs[20].size()], -1);
+}
+
+BOOST_AUTO_TEST_CASE(set)
+{
+    jitana::persistent_vector<int> v;
+    for (int i = 0; i < 3000; ++i) {
+        v.push_back(i);
+    }
+
+    // Replacing an element of a copy must not change the original.
+    auto w = v;
+    for (int i = 0; i < 3000; i += 7) {
+        w.set(i, -i);
+    }
+    for (int i = 0; i < 3000; ++i) {
+        BOOST_REQUIRE_EQUAL(v[i], i);
+        BOOST_REQUIRE_EQUAL(w[i], i % 7 == 0 ? -i : i);
+    }
+}
@@ -73,7 +73,7 @@ BOOST_AUTO_TEST_CASE(points_to)
         std::for_each(vertices(vm.methods()).first,
                       vertices(vm.methods()).second,
                       [&](const jitana::method_vertex_descriptor& v) {
-                          add_def_use_edges(vm.methods()[v].insns);
+                          add_def_use_edges(*vm.methods()[v].insns);
                       });
 
         std::cout << "Making pointer assignment graph for " << mh << "...";
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_stream_reader
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/util/stream_reader.hpp>
+#include <jitana/vm_core/dex_file.hpp>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+    void append_uleb128(std::vector<uint8_t>& buf, uint32_t x)
+    {
+        while (x >= 0x80) {
+            buf.push_back(static_cast<uint8_t>(x | 0x80));
+            x >>= 7;
+        }
+        buf.push_back(static_cast<uint8_t>(x));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(uleb128_batch)
+{
+    // Mix the runs of the single-byte values with the longer values so that
+    // both the block path and the scalar path are taken.
+    std::mt19937 gen(0);
+    std::vector<uint32_t> expected;
+    for (int i = 0; i < 1000; ++i) {
+        const auto bits = i % 100 < 60 ? 7 : gen() % 33;
+        expected.push_back(
+                bits == 0 ? 0 : gen() & (0xffffffffu >> (32 - bits)));
+    }
+
+    std::vector<uint8_t> buf;
+    for (auto x : expected) {
+        append_uleb128(buf, x);
+    }
+
+    for (size_t n : {size_t(0), size_t(1), size_t(17), expected.size()}) {
+        jitana::stream_reader reader(buf.data(), buf.data() + buf.size());
+        std::vector<uint32_t> actual(n);
+        reader.get_uleb128_batch(actual.data(), n);
+        BOOST_CHECK(std::equal(begin(actual), end(actual), begin(expected)));
+
+        // The head must be on the next value.
+        if (n < expected.size()) {
+            BOOST_CHECK_EQUAL(reader.get_uleb128(), expected[n]);
+        }
+    }
+
+    for (size_t n = 0; n < expected.size(); ++n) {
+        jitana::trusted_stream_reader reader(buf.data(),
+                                             buf.data() + buf.size());
+        reader.skip_uleb128(n);
+        BOOST_CHECK_EQUAL(reader.get_uleb128(), expected[n]);
+    }
+
+    // The truncated value is rejected.
+    jitana::stream_reader reader(buf.data(), buf.data() + buf.size() - 1);
+    std::vector<uint32_t> actual(expected.size());
+    BOOST_CHECK_THROW(reader.get_uleb128_batch(actual.data(), actual.size()),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(trusted_stream_reader)
+{
+    const std::vector<uint8_t> buf = {0x34, 0x12, 0xe5, 0x8e, 0x26, 0x7f,
+                                      0x80, 0x7f, 0x00, 0x05};
+    jitana::trusted_stream_reader reader(buf.data(), buf.data() + buf.size());
+    BOOST_CHECK_EQUAL(reader.get<uint16_t>(), 0x1234);
+    BOOST_CHECK_EQUAL(reader.get_uleb128(), 624485u);
+    BOOST_CHECK_EQUAL(reader.get_sleb128(), -1);
+    BOOST_CHECK_EQUAL(reader.get_sleb128(), -128);
+    BOOST_CHECK_EQUAL(reader.get_uleb128p1(), 0xffffffffu);
+    BOOST_CHECK_EQUAL(reader.get_uleb128p1(), 4u);
+    BOOST_CHECK(reader.head() == buf.data() + buf.size());
+}
+
+BOOST_AUTO_TEST_CASE(truncated_class_data)
+{
+    // Two fields and a method have seven values.
+    const std::vector<uint32_t> expected = {1, 2, 3, 4, 5, 6, 0x4000};
+    std::vector<uint8_t> buf;
+    for (auto x : expected) {
+        append_uleb128(buf, x);
+    }
+
+    std::vector<uint32_t> values;
+    {
+        jitana::stream_reader reader(buf.data(), buf.data() + buf.size());
+        jitana::detail::get_class_data_values(reader, 2, 1, values);
+        BOOST_CHECK(values == expected);
+        BOOST_CHECK_EQUAL(reader.head(), buf.size());
+    }
+
+    // The sizes that need more bytes than left are rejected before the
+    // values are decoded, however large they are.
+    for (uint64_t size : {uint64_t(3), uint64_t(0xffffffff)}) {
+        jitana::stream_reader reader(buf.data(), buf.data() + buf.size());
+        BOOST_CHECK_THROW(jitana::detail::get_class_data_values(reader, size,
+                                                                size, values),
+                          std::runtime_error);
+        BOOST_CHECK_EQUAL(reader.head(), 0u);
+    }
+
+    // The value cut at the end is rejected too.
+    jitana::stream_reader reader(buf.data(), buf.data() + buf.size() - 1);
+    BOOST_CHECK_THROW(
+            jitana::detail::get_class_data_values(reader, 2, 1, values),
+            std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(debug_info_operands)
+{
+    // Each opcode and the number of its operands. The operands have the
+    // value of start_local_extended, so skipping too few or too many of them
+    // runs past the end_sequence at the end of the item.
+    const std::vector<std::pair<uint8_t, size_t>> ops = {
+            {0x01, 1}, // advance_pc
+            {0x02, 1}, // advance_line
+            {0x03, 3}, // start_local
+            {0x04, 4}, // start_local_extended
+            {0x05, 1}, // end_local
+            {0x06, 1}, // restart_local
+            {0x07, 0}, // set_prologue_end
+            {0x08, 0}, // set_epilogue_begin
+            {0x09, 1}, // set_file
+            {0x0a, 0}, // special
+    };
+    for (const auto& op : ops) {
+        // The starting line number and two parameter names (uleb128p1).
+        std::vector<uint8_t> buf = {10, 2, 0x00, 0xac, 0x02, op.first};
+        buf.insert(end(buf), op.second, 0x04);
+        buf.push_back(0x00);
+
+        // The reader starts at the head of the item.
+        jitana::stream_reader reader(buf.data(), buf.data() + buf.size());
+        auto trusted = jitana::detail::validate_debug_info(reader);
+        BOOST_CHECK(trusted.head() == buf.data());
+        BOOST_CHECK_EQUAL(trusted.get_uleb128(), 10u);
+
+        // The truncated item is rejected up front.
+        for (size_t n = 0; n < buf.size(); ++n) {
+            jitana::stream_reader truncated(buf.data(), buf.data() + n);
+            BOOST_CHECK_THROW(jitana::detail::validate_debug_info(truncated),
+                              std::runtime_error);
+        }
+    }
+}
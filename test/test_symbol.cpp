@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_symbol
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/vm_core/symbol.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using jitana::symbol;
+
+BOOST_AUTO_TEST_CASE(intern)
+{
+    const symbol empty;
+    BOOST_CHECK(empty.empty());
+    BOOST_CHECK(symbol("") == empty);
+
+    BOOST_CHECK(!symbol::find("Ltest_symbol/NotInterned;"));
+    const symbol a("Ltest_symbol/A;");
+    const symbol b(std::string("Ltest_symbol/B;"));
+    BOOST_CHECK(a != b);
+    BOOST_CHECK(a == symbol("Ltest_symbol/A;"));
+    BOOST_CHECK(a == "Ltest_symbol/A;");
+    BOOST_CHECK(a < b);
+    BOOST_CHECK_EQUAL(a.hash(), symbol("Ltest_symbol/A;").hash());
+
+    auto found = symbol::find("Ltest_symbol/A;");
+    BOOST_REQUIRE(found);
+    BOOST_CHECK_EQUAL(found->id(), a.id());
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_intern)
+{
+    // Enough strings to span several blocks of the entry table.
+    constexpr unsigned n_strings = 20000;
+    constexpr unsigned n_threads = 8;
+
+    // Every thread interns all the strings in a different order.
+    std::vector<std::vector<symbol>> results(n_threads);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto& r = results[t];
+            r.resize(n_strings);
+            for (unsigned i = 0; i < n_strings; ++i) {
+                auto j = (t % 2 == 0) ? i : n_strings - 1 - i;
+                r[j] = symbol("Ltest_symbol/C" + std::to_string(j) + ";");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (unsigned i = 0; i < n_strings; ++i) {
+        const auto& s = results[0][i];
+        BOOST_REQUIRE_EQUAL(s.str(),
+                            "Ltest_symbol/C" + std::to_string(i) + ";");
+        for (unsigned t = 1; t < n_threads; ++t) {
+            BOOST_REQUIRE_EQUAL(results[t][i].id(), s.id());
+        }
+        if (i > 0) {
+            BOOST_REQUIRE_NE(results[0][i - 1].id(), s.id());
+        }
+    }
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_vm_image
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/jitana.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+    void add_loaders(jitana::virtual_machine& vm)
+    {
+        {
+            const auto& filenames
+                    = {"../../dex/framework/core.dex",
+                       "../../dex/framework/framework.dex",
+                       "../../dex/framework/framework2.dex",
+                       "../../dex/framework/ext.dex",
+                       "../../dex/framework/conscrypt.dex",
+                       "../../dex/framework/okhttp.dex",
+                       "../../dex/framework/core-junit.dex",
+                       "../../dex/framework/android.test.runner.dex",
+                       "../../dex/framework/android.policy.dex"};
+            jitana::class_loader loader(11, "SystemLoader", begin(filenames),
+                                        end(filenames));
+            vm.add_loader(loader);
+        }
+
+        {
+            const auto& filenames = {"../../dex/small_tests/02/02.dex"};
+            jitana::class_loader loader(22, "SmallTest02", begin(filenames),
+                                        end(filenames));
+            vm.add_loader(loader, 11);
+        }
+    }
+
+    /// Adds the class loaders without DEX files.
+    void add_empty_loaders(jitana::virtual_machine& vm)
+    {
+        const std::vector<std::string> filenames;
+        vm.add_loader(jitana::class_loader(11, "SystemLoader",
+                                           begin(filenames), end(filenames)));
+        vm.add_loader(jitana::class_loader(22, "Empty", begin(filenames),
+                                           end(filenames)),
+                      11);
+    }
+
+    std::string read_file(const std::string& filename)
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        return {std::istreambuf_iterator<char>(ifs),
+                std::istreambuf_iterator<char>()};
+    }
+
+    void write_file(const std::string& filename, const std::string& contents)
+    {
+        std::ofstream(filename, std::ios::binary | std::ios::trunc)
+                << contents;
+    }
+
+    template <typename Graph>
+    void check_same_graph(const Graph& x, const Graph& y)
+    {
+        BOOST_REQUIRE_EQUAL(num_vertices(x), num_vertices(y));
+        BOOST_CHECK_EQUAL(num_edges(x), num_edges(y));
+        for (const auto& v : boost::make_iterator_range(vertices(x))) {
+            BOOST_CHECK(x[v].hdl == y[v].hdl);
+            BOOST_CHECK(x[v].jvm_hdl == y[v].jvm_hdl);
+            BOOST_CHECK(x[v].access_flags == y[v].access_flags);
+        }
+
+        // The lookup tables include the initiating handles.
+        const auto& xprop = x[boost::graph_bundle];
+        const auto& yprop = y[boost::graph_bundle];
+        BOOST_CHECK(xprop.hdl_to_vertex == yprop.hdl_to_vertex);
+        BOOST_CHECK(xprop.jvm_hdl_to_vertex == yprop.jvm_hdl_to_vertex);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    const std::string filename = "test_vm_image.jvmi";
+
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    vm.load_all_classes(22);
+    vm.save_image(filename);
+
+    jitana::virtual_machine vm_image;
+    add_loaders(vm_image);
+    BOOST_REQUIRE(vm_image.load_image(filename));
+
+    const auto& cvm = vm;
+    const auto& cvm_image = vm_image;
+    check_same_graph(cvm.classes(), cvm_image.classes());
+    check_same_graph(cvm.methods(), cvm_image.methods());
+    check_same_graph(cvm.fields(), cvm_image.fields());
+
+    // The tables and the instruction graphs are the same.
+    const auto& cg = cvm.classes();
+    const auto& cg_image = cvm_image.classes();
+    for (const auto& v : boost::make_iterator_range(vertices(cg))) {
+        BOOST_CHECK(cg[v].vtable.size() == cg_image[v].vtable.size());
+        BOOST_CHECK(cg[v].dtable.size() == cg_image[v].dtable.size());
+        BOOST_CHECK(cg[v].static_size == cg_image[v].static_size);
+        BOOST_CHECK(cg[v].instance_size == cg_image[v].instance_size);
+    }
+    const auto& mg = cvm.methods();
+    const auto& mg_image = cvm_image.methods();
+    for (const auto& v : boost::make_iterator_range(vertices(mg))) {
+        BOOST_CHECK(mg[v].class_hdl == mg_image[v].class_hdl);
+        BOOST_CHECK(num_vertices(*mg[v].insns.share())
+                    == num_vertices(*mg_image[v].insns.share()));
+    }
+
+    // The lookups work without loading anything.
+    auto cv = vm.find_class({22, "LA;"}, false);
+    auto cv_image = vm_image.find_class({22, "LA;"}, false);
+    BOOST_REQUIRE(!!cv);
+    BOOST_REQUIRE(!!cv_image);
+    BOOST_CHECK(cg[*cv].hdl == cg_image[*cv_image].hdl);
+
+    // The image is only loaded into an empty virtual machine.
+    BOOST_CHECK_THROW(vm_image.load_image(filename), std::runtime_error);
+
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(reject_corrupted_image)
+{
+    const std::string filename = "test_vm_image.jvmi";
+
+    jitana::virtual_machine vm;
+    add_loaders(vm);
+    vm.load_all_classes(22);
+    vm.save_image(filename);
+    const auto contents = read_file(filename);
+
+    // The class loaders differ.
+    {
+        jitana::virtual_machine vm_image;
+        add_empty_loaders(vm_image);
+        BOOST_CHECK(!vm_image.load_image(filename));
+    }
+
+    // Overwrite the words throughout the image. Either the image is rejected
+    // or the references in it are still valid, so looking up every loaded
+    // class never reads outside of the graphs.
+    const auto step = std::max<size_t>(8, contents.size() / 4096 / 8 * 8);
+    for (size_t off = 0; off + 8 <= contents.size(); off += step) {
+        auto corrupted = contents;
+        corrupted.replace(off, 8, 8, '\xff');
+        write_file(filename, corrupted);
+
+        jitana::virtual_machine vm_image;
+        add_loaders(vm_image);
+        if (!vm_image.load_image(filename)) {
+            continue;
+        }
+        const auto& cvm_image = vm_image;
+        const auto& cg = cvm_image.classes();
+        for (const auto& v : boost::make_iterator_range(vertices(cg))) {
+            vm_image.find_class(cg[v].jvm_hdl, false);
+        }
+    }
+
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(reject_broken_file)
+{
+    const std::string filename = "test_vm_image.jvmi";
+
+    jitana::virtual_machine vm;
+    add_empty_loaders(vm);
+    vm.save_image(filename);
+    const auto contents = read_file(filename);
+
+    auto load = [&](const std::string& image) {
+        write_file(filename, image);
+        jitana::virtual_machine vm_image;
+        add_empty_loaders(vm_image);
+        return vm_image.load_image(filename);
+    };
+
+    BOOST_CHECK(load(contents));
+
+    // Truncated.
+    BOOST_CHECK(!load(contents.substr(0, contents.size() - 1)));
+    BOOST_CHECK(!load(contents.substr(0, 16)));
+    BOOST_CHECK(!load(""));
+
+    // The magic is different.
+    auto bad_magic = contents;
+    bad_magic[0] = 'x';
+    BOOST_CHECK(!load(bad_magic));
+
+    // A section is outside of the file.
+    auto bad_section = contents;
+    bad_section.replace(16, 4, 4, '\xff');
+    BOOST_CHECK(!load(bad_section));
+
+    // No image file.
+    std::remove(filename.c_str());
+    jitana::virtual_machine vm_image;
+    add_empty_loaders(vm_image);
+    BOOST_CHECK(!vm_image.load_image(filename));
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define BOOST_TEST_MODULE test_zip_archive
+#define BOOST_TEST_INCLUDED
+#include <boost/test/unit_test.hpp>
+
+#include <jitana/util/zip_archive.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/crc.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace {
+    class zip_writer {
+    public:
+        void add(const std::string& name, const std::string& contents,
+                 bool deflate)
+        {
+            std::string data = contents;
+            if (deflate) {
+                namespace io = boost::iostreams;
+                io::zlib_params params;
+                params.noheader = true;
+                data.clear();
+                io::filtering_ostream os;
+                os.push(io::zlib_compressor(params));
+                os.push(io::back_inserter(data));
+                os << contents;
+                os.reset();
+            }
+
+            boost::crc_32_type crc;
+            crc.process_bytes(contents.data(), contents.size());
+
+            // The local file header.
+            const auto local_header_off = buf_.size();
+            put32(0x04034b50);
+            put16(20);
+            put16(0);
+            put16(deflate ? 8 : 0);
+            put32(0);
+            put32(crc.checksum());
+            put32(data.size());
+            put32(contents.size());
+            put16(name.size());
+            put16(0);
+            buf_ += name;
+            buf_ += data;
+
+            // The central directory header.
+            put32(0x02014b50, cd_);
+            put16(20, cd_);
+            put16(20, cd_);
+            put16(0, cd_);
+            put16(deflate ? 8 : 0, cd_);
+            put32(0, cd_);
+            put32(crc.checksum(), cd_);
+            put32(data.size(), cd_);
+            put32(contents.size(), cd_);
+            put16(name.size(), cd_);
+            put32(0, cd_);
+            put32(0, cd_);
+            put32(0, cd_);
+            put32(local_header_off, cd_);
+            cd_ += name;
+            ++n_entries_;
+        }
+
+        void save(const std::string& filename)
+        {
+            const auto cd_off = buf_.size();
+            buf_ += cd_;
+            put32(0x06054b50);
+            put32(0);
+            put16(n_entries_);
+            put16(n_entries_);
+            put32(cd_.size());
+            put32(cd_off);
+            put16(0);
+            std::ofstream(filename, std::ios::binary) << buf_;
+        }
+
+    private:
+        void put16(uint16_t x, std::string& s)
+        {
+            s += char(x);
+            s += char(x >> 8);
+        }
+
+        void put32(uint32_t x, std::string& s)
+        {
+            put16(x, s);
+            put16(x >> 16, s);
+        }
+
+        void put16(uint16_t x)
+        {
+            put16(x, buf_);
+        }
+
+        void put32(uint32_t x)
+        {
+            put32(x, buf_);
+        }
+
+        std::string buf_;
+        std::string cd_;
+        uint16_t n_entries_ = 0;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(read_entries)
+{
+    const std::string stored(1000, 's');
+    std::string deflated;
+    for (int i = 0; i < 1000; ++i) {
+        deflated += std::to_string(i);
+    }
+
+    const std::string filename = "test_zip_archive.zip";
+    zip_writer w;
+    w.add("classes.dex", stored, false);
+    w.add("classes2.dex", deflated, true);
+    w.save(filename);
+
+    BOOST_CHECK(jitana::zip_archive::is_zip_file(filename));
+
+    jitana::zip_archive zip(filename);
+    BOOST_CHECK_EQUAL(zip.entries().size(), 2);
+    BOOST_CHECK(zip.find("classes3.dex") == nullptr);
+
+    const auto* e1 = zip.find("classes.dex");
+    BOOST_REQUIRE(e1 != nullptr);
+    const auto d1 = zip.read(*e1);
+    BOOST_CHECK(std::string(d1.begin, d1.end) == stored);
+
+    const auto* e2 = zip.find("classes2.dex");
+    BOOST_REQUIRE(e2 != nullptr);
+    BOOST_CHECK_EQUAL(e2->method, jitana::zip_entry::deflated);
+    const auto d2 = zip.read(*e2);
+    BOOST_CHECK(std::string(d2.begin, d2.end) == deflated);
+
+    std::remove(filename.c_str());
+}
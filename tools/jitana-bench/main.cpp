@@ -21,9 +21,6 @@
 #include <algorithm>
 
 #include <boost/graph/graphviz.hpp>
-#include <boost/type_erasure/any.hpp>
-#include <boost/type_erasure/any_cast.hpp>
-#include <boost/type_erasure/operators.hpp>
 #include <boost/range/iterator_range.hpp>
 
 #include <jitana/jitana.hpp>
@@ -98,16 +95,19 @@ int setup_class_loaders(jitana::virtual_machine& vm)
     return loader_idx;
 }
 
-void run_benchmarks(benchmark_data& bd, jitana::virtual_machine vm,
+void run_benchmarks(benchmark_data& bd, const jitana::virtual_machine& base,
                     jitana::class_loader_hdl lh)
 {
-    const auto& lg = vm.loaders();
+    const auto& lg = base.loaders();
     bd.loader_name = lg[*find_loader_vertex(lh, lg)].loader.name();
 
-    // Load all classes.
+    // Load all classes on a fork so that every run starts from the same
+    // state without reloading the base. Forking is timed with the loading.
+    jitana::virtual_machine vm;
     {
         auto start = std::chrono::system_clock::now();
 
+        vm = base.fork();
         vm.load_all_classes(lh);
 
         auto end = std::chrono::system_clock::now();
@@ -135,7 +135,7 @@ void run_benchmarks(benchmark_data& bd, jitana::virtual_machine vm,
         std::for_each(vertices(vm.methods()).first,
                       vertices(vm.methods()).second,
                       [&](const jitana::method_vertex_descriptor& v) {
-                          add_def_use_edges(vm.methods()[v].insns);
+                          add_def_use_edges(*vm.methods()[v].insns);
                       });
 
         auto end = std::chrono::system_clock::now();
@@ -147,7 +147,7 @@ void run_benchmarks(benchmark_data& bd, jitana::virtual_machine vm,
     bd.n_dex_insns = 0;
     std::for_each(vertices(vm.methods()).first, vertices(vm.methods()).second,
                   [&](const jitana::method_vertex_descriptor& v) {
-                      int n = num_vertices(vm.methods()[v].insns);
+                      int n = num_vertices(*vm.methods()[v].insns);
                       // We should have 2 pseudo instructions if the insn graph
                       // is non-empty.
                       if (n >= 2) {
@@ -176,8 +176,9 @@ void run_benchmark()
     std::cout << std::endl;
 
     {
+        const auto& cvm = vm;
         std::ofstream ofs("output/loader_graph.dot");
-        write_graphviz_loader_graph(ofs, vm.loaders());
+        write_graphviz_loader_graph(ofs, cvm.loaders());
     }
 
     for (int i = 1; i < n_loaders; ++i) {
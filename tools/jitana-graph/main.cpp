@@ -20,9 +20,6 @@
 #include <chrono>
 
 #include <boost/graph/graphviz.hpp>
-#include <boost/type_erasure/any.hpp>
-#include <boost/type_erasure/any_cast.hpp>
-#include <boost/type_erasure/operators.hpp>
 #include <boost/range/iterator_range.hpp>
 
 #include <jitana/jitana.hpp>
@@ -107,8 +104,15 @@ void test_virtual_machine()
 // "onPause()V"};
 // "onRestart()V"};
 #endif
+    // Reuse the classes loaded by the previous run if they are saved.
+    const std::string image_filename = "output/vm.jvmi";
+    const bool from_image = vm.load_image(image_filename);
+
     if (auto mv = vm.find_method(mh, true)) {
-        vm.load_recursive(*mv);
+        if (!from_image) {
+            vm.load_recursive(*mv);
+            vm.save_image(image_filename);
+        }
 
         // Compute the call graph.
         jitana::add_call_graph_edges(vm);
@@ -117,7 +121,7 @@ void test_virtual_machine()
         std::for_each(vertices(vm.methods()).first,
                       vertices(vm.methods()).second,
                       [&](const jitana::method_vertex_descriptor& v) {
-                          add_def_use_edges(vm.methods()[v].insns);
+                          add_def_use_edges(*vm.methods()[v].insns);
                       });
 
         std::cout << "Making pointer assignment graph for " << mh << "...";
@@ -170,13 +174,13 @@ void test_virtual_machine()
     // Compute the exception flow edges.
     std::for_each(vertices(vm.methods()).first, vertices(vm.methods()).second,
                   [&](const jitana::method_vertex_descriptor& v) {
-                      add_exception_flow_edges(vm, vm.methods()[v].insns);
+                      add_exception_flow_edges(vm, *vm.methods()[v].insns);
                   });
 
     // Compute the def-use edges.
     std::for_each(vertices(vm.methods()).first, vertices(vm.methods()).second,
                   [&](const jitana::method_vertex_descriptor& v) {
-                      add_def_use_edges(vm.methods()[v].insns);
+                      add_def_use_edges(*vm.methods()[v].insns);
                   });
 
     std::cout << "# of classes: " << num_vertices(vm.classes()) << "\n";
@@ -190,8 +194,9 @@ void test_virtual_machine()
 void write_graphs(jitana::virtual_machine& vm)
 {
     {
+        const auto& cvm = vm;
         std::ofstream ofs("output/loader_graph.dot");
-        write_graphviz_loader_graph(ofs, vm.loaders());
+        write_graphviz_loader_graph(ofs, cvm.loaders());
     }
 
     {
@@ -209,11 +214,13 @@ void write_graphs(jitana::virtual_machine& vm)
         write_graphviz_field_graph(ofs, vm.fields());
     }
 
-    for (const auto& v : boost::make_iterator_range(vertices(vm.methods()))) {
-        const auto& ig = vm.methods()[v].insns;
+    const auto& cvm = vm;
+    for (const auto& v : boost::make_iterator_range(vertices(cvm.methods()))) {
+        const auto ig_ptr = cvm.methods()[v].insns.share();
+        const auto& ig = *ig_ptr;
         if (num_vertices(ig) > 0) {
             std::stringstream ss;
-            ss << "output/insn/" << vm.methods()[v].hdl << ".dot";
+            ss << "output/insn/" << cvm.methods()[v].hdl << ".dot";
             std::ofstream ofs(ss.str());
             write_graphviz_insn_graph(ofs, ig, &vm);
         }
@@ -70,7 +70,7 @@ void run_iac_analysis()
     std::cout << "Computing the def-use edges..." << std::endl;
     std::for_each(vertices(vm.methods()).first, vertices(vm.methods()).second,
                   [&](const jitana::method_vertex_descriptor& v) {
-                      add_def_use_edges(vm.methods()[v].insns);
+                      add_def_use_edges(*vm.methods()[v].insns);
                   });
 
     // Compute the intent-flow edges.
@@ -88,10 +88,11 @@ void run_iac_analysis()
     std::cout << "Writing graphs..." << std::endl;
     write_graphs(vm);
 
-    std::cout << "# of Loaders: " << num_vertices(vm.loaders()) << "\n";
-    std::cout << "# of classes: " << num_vertices(vm.classes()) << "\n";
-    std::cout << "# of methods: " << num_vertices(vm.methods()) << "\n";
-    std::cout << "# of fields:  " << num_vertices(vm.fields()) << "\n";
+    const auto& cvm = vm;
+    std::cout << "# of Loaders: " << num_vertices(cvm.loaders()) << "\n";
+    std::cout << "# of classes: " << num_vertices(cvm.classes()) << "\n";
+    std::cout << "# of methods: " << num_vertices(cvm.methods()) << "\n";
+    std::cout << "# of fields:  " << num_vertices(cvm.fields()) << "\n";
 }
 
 void write_graphs(const jitana::virtual_machine& vm)
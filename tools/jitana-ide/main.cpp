@@ -20,9 +20,6 @@
 #include <chrono>
 
 #include <boost/graph/graphviz.hpp>
-#include <boost/type_erasure/any.hpp>
-#include <boost/type_erasure/any_cast.hpp>
-#include <boost/type_erasure/operators.hpp>
 #include <boost/range/iterator_range.hpp>
 
 #include <jitana/jitana.hpp>
@@ -74,7 +71,7 @@ void run_analysis()
     // Compute the def-use edges.
     std::for_each(vertices(vm.methods()).first, vertices(vm.methods()).second,
                   [&](const jitana::method_vertex_descriptor& v) {
-                      add_def_use_edges(vm.methods()[v].insns);
+                      add_def_use_edges(*vm.methods()[v].insns);
                   });
 
     std::cout << "Entry point: " << mh << std::endl;
@@ -198,8 +195,9 @@ void setup_class_loaders(jitana::virtual_machine& vm)
 void write_vm_graphs(jitana::virtual_machine& vm)
 {
     {
+        const auto& cvm = vm;
         std::ofstream ofs("output/loader_graph.dot");
-        write_graphviz_loader_graph(ofs, vm.loaders());
+        write_graphviz_loader_graph(ofs, cvm.loaders());
     }
 
     {
@@ -217,11 +215,13 @@ void write_vm_graphs(jitana::virtual_machine& vm)
         write_graphviz_field_graph(ofs, vm.fields());
     }
 
-    for (const auto& v : boost::make_iterator_range(vertices(vm.methods()))) {
-        const auto& ig = vm.methods()[v].insns;
+    const auto& cvm = vm;
+    for (const auto& v : boost::make_iterator_range(vertices(cvm.methods()))) {
+        const auto ig_ptr = cvm.methods()[v].insns.share();
+        const auto& ig = *ig_ptr;
         if (num_vertices(ig) > 0) {
             std::stringstream ss;
-            ss << "output/insn/" << vm.methods()[v].hdl << ".dot";
+            ss << "output/insn/" << cvm.methods()[v].hdl << ".dot";
             std::ofstream ofs(ss.str());
             write_graphviz_insn_graph(ofs, ig, &vm);
         }
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2016, Yutaka Tsutano
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <iterator>
+
+#include <jitana/jitana.hpp>
+#include <jitana/util/stream_reader.hpp>
+
+constexpr int n_runs = 5;
+
+struct benchmark_data {
+    std::string name;
+    long n_items = 0;
+    /// The checksum of the decoded values, which keeps the decoding from
+    /// being optimized away.
+    uint64_t checksum = 0;
+    double t_min = std::numeric_limits<double>::max();
+};
+
+template <typename F>
+void measure(benchmark_data& bd, F f)
+{
+    for (int i = 0; i < n_runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+
+        bd.n_items = f();
+
+        auto end = std::chrono::steady_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                end - start);
+        bd.t_min = std::min(bd.t_min, duration.count() / 1000.0);
+    }
+}
+
+std::vector<benchmark_data> run_dex_benchmarks(const std::string& filename)
+{
+    std::vector<benchmark_data> results;
+
+    // Open the DEX file.
+    {
+        benchmark_data bd;
+        bd.name = "Open";
+        measure(bd, [&] {
+            jitana::dex_file df({0, 0}, filename);
+            return 1L;
+        });
+        results.push_back(bd);
+    }
+
+    // Open the DEX file using the sidecar index.
+    {
+        const auto index_filename
+                = jitana::dex_index::sidecar_filename(filename);
+        const bool had_index = std::ifstream(index_filename).good();
+        if (!had_index) {
+            jitana::dex_file({0, 0}, filename).save_index();
+        }
+
+        benchmark_data bd;
+        bd.name = "Open with Index";
+        measure(bd, [&] {
+            jitana::dex_file df({0, 0}, filename);
+            return 1L;
+        });
+        results.push_back(bd);
+
+        if (!had_index) {
+            std::remove(index_filename.c_str());
+        }
+    }
+
+    // Map every 16-bit code unit in the file to an instruction.
+    {
+        jitana::dex_file df({0, 0}, filename);
+        std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+        const auto file_size = static_cast<uint32_t>(ifs.tellg());
+
+        benchmark_data bd;
+        bd.name = "Find Method Handle";
+        measure(bd, [&] {
+            long n_found = 0;
+            for (uint32_t off = 0; off < file_size; off += 2) {
+                if (df.find_method_hdl(off)) {
+                    ++n_found;
+                }
+            }
+            return n_found;
+        });
+        results.push_back(bd);
+    }
+
+    // Decode the members of every class_data_item.
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        const std::vector<uint8_t> buf(std::istreambuf_iterator<char>(ifs),
+                                       {});
+        jitana::stream_reader reader(buf.data(), buf.data() + buf.size());
+
+        // Find the class_data_items from the header and the class_defs.
+        std::vector<std::pair<uint32_t, size_t>> class_data;
+        reader.move_head(0x60);
+        const auto class_defs_size = reader.get<uint32_t>();
+        const auto class_defs_off = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < class_defs_size; ++i) {
+            reader.move_head(class_defs_off + 32 * i + 24);
+            const auto off = reader.get<uint32_t>();
+            if (off != 0) {
+                reader.move_head(off);
+                const uint64_t fields_size
+                        = reader.get_uleb128() + uint64_t(reader.get_uleb128());
+                const uint64_t methods_size
+                        = reader.get_uleb128() + uint64_t(reader.get_uleb128());
+                class_data.emplace_back(reader.head(),
+                                        2 * fields_size + 3 * methods_size);
+            }
+        }
+
+        std::vector<uint32_t> values;
+
+        benchmark_data bd_loop;
+        bd_loop.name = "ULEB128 Loop";
+        measure(bd_loop, [&] {
+            long n_values = 0;
+            uint64_t sum = 0;
+            for (const auto& cd : class_data) {
+                reader.move_head(cd.first);
+                for (size_t i = 0; i < cd.second; ++i) {
+                    sum += reader.get_uleb128();
+                }
+                n_values += cd.second;
+            }
+            bd_loop.checksum = sum;
+            return n_values;
+        });
+        results.push_back(bd_loop);
+
+        benchmark_data bd_batch;
+        bd_batch.name = "ULEB128 Batch";
+        measure(bd_batch, [&] {
+            long n_values = 0;
+            uint64_t sum = 0;
+            for (const auto& cd : class_data) {
+                reader.move_head(cd.first);
+                values.resize(cd.second);
+                reader.get_uleb128_batch(values.data(), values.size());
+                for (auto x : values) {
+                    sum += x;
+                }
+                n_values += cd.second;
+            }
+            bd_batch.checksum = sum;
+            return n_values;
+        });
+        results.push_back(bd_batch);
+    }
+
+    return results;
+}
+
+struct memory_data {
+    std::string name;
+    long n_insns = 0;
+    size_t n_bytes = 0;
+};
+
+struct insn_heap_size : boost::static_visitor<size_t> {
+    size_t operator()(const jitana::insn_fill_array_data& x) const
+    {
+        return x.const_val.data.capacity();
+    }
+
+    template <typename T>
+    size_t operator()(const T&) const
+    {
+        return 0;
+    }
+};
+
+std::vector<memory_data>
+run_memory_benchmarks(const std::vector<std::string>& filenames)
+{
+    // Load the files together since the classes may depend on the classes
+    // in the other files.
+    jitana::virtual_machine vm;
+    vm.add_loader(jitana::class_loader(0, "Loader", begin(filenames),
+                                       end(filenames)));
+    vm.load_all_classes(jitana::class_loader_hdl(0));
+
+    memory_data rich;
+    rich.name = "Rich";
+    memory_data compact;
+    compact.name = "Compact";
+
+    const auto& mg = vm.methods();
+    for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
+        auto ig = mg[mv].insns.share();
+        auto cig = jitana::make_compact_insn_graph(*ig);
+
+        for (const auto& iv : boost::make_iterator_range(vertices(*ig))) {
+            const auto& x = (*ig)[iv].insn;
+            rich.n_bytes += sizeof(jitana::insn_vertex_property);
+            rich.n_bytes += boost::apply_visitor(insn_heap_size(), x);
+        }
+        rich.n_insns += num_vertices(*ig);
+
+        const auto& operands = cig[boost::graph_bundle].operands;
+        compact.n_bytes += num_vertices(cig)
+                * sizeof(jitana::compact_insn_vertex_property);
+        compact.n_bytes += operands.wide_consts.capacity() * sizeof(int64_t);
+        compact.n_bytes += operands.strings.capacity()
+                * sizeof(jitana::dex_string_ref);
+        for (const auto& x : operands.array_payloads) {
+            compact.n_bytes += sizeof(x) + x.data.capacity();
+        }
+        compact.n_insns += num_vertices(cig);
+    }
+
+    return {rich, compact};
+}
+
+std::vector<benchmark_data>
+run_load_level_benchmarks(const std::vector<std::string>& filenames)
+{
+    const std::pair<jitana::load_level, const char*> levels[] = {
+            {jitana::load_level::signatures, "Signatures"},
+            {jitana::load_level::code, "Code"},
+            {jitana::load_level::full, "Full"}};
+
+    std::vector<benchmark_data> results;
+    for (const auto& level : levels) {
+        // Load all the classes and build all the instruction graphs.
+        benchmark_data bd;
+        bd.name = level.second;
+        measure(bd, [&] {
+            jitana::virtual_machine vm;
+            vm.add_loader(jitana::class_loader(0, "Loader", begin(filenames),
+                                               end(filenames), level.first));
+            vm.load_all_classes(jitana::class_loader_hdl(0));
+
+            long n_insns = 0;
+            const auto& mg = vm.methods();
+            for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
+                n_insns += num_vertices(*mg[mv].insns.share());
+            }
+            return n_insns;
+        });
+        results.push_back(bd);
+    }
+
+    return results;
+}
+
+void run_benchmark(const std::vector<std::string>& filenames)
+{
+    std::cout << "File";
+    std::cout << ",Benchmark";
+    std::cout << ",# of Items";
+    std::cout << ",Time (ms)";
+    std::cout << ",Checksum";
+    std::cout << std::endl;
+
+    for (const auto& filename : filenames) {
+        for (const auto& bd : run_dex_benchmarks(filename)) {
+            std::cout << filename << ",";
+            std::cout << bd.name << ",";
+            std::cout << bd.n_items << ",";
+            std::cout << bd.t_min << ",";
+            std::cout << bd.checksum << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << "Representation";
+    std::cout << ",# of Insns";
+    std::cout << ",Bytes per Insn";
+    std::cout << std::endl;
+
+    for (const auto& md : run_memory_benchmarks(filenames)) {
+        std::cout << md.name << ",";
+        std::cout << md.n_insns << ",";
+        std::cout << (md.n_insns != 0 ? double(md.n_bytes) / md.n_insns : 0.0)
+                  << std::endl;
+    }
+
+    std::cout << std::endl;
+    std::cout << "Load Level";
+    std::cout << ",# of Insns";
+    std::cout << ",Time (ms)";
+    std::cout << std::endl;
+
+    for (const auto& bd : run_load_level_benchmarks(filenames)) {
+        std::cout << bd.name << ",";
+        std::cout << bd.n_items << ",";
+        std::cout << bd.t_min << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> filenames(argv + 1, argv + argc);
+    if (filenames.empty()) {
+        filenames = {"../../../dex/framework/core.dex",
+                     "../../../dex/framework/framework.dex",
+                     "../../../dex/framework/framework2.dex",
+                     "../../../dex/framework/ext.dex"};
+    }
+
+    try {
+        run_benchmark(filenames);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n\n";
+        std::cerr << "Please make sure that the DEX files exist.\n";
+        return 1;
+    }
+}
@@ -245,7 +245,8 @@ void display()
             }
 
             auto draw_method = [&](jitana::method_vertex_descriptor mv) {
-                const auto& ig = mg[mv].insns;
+                const auto ig_ptr = mg[mv].insns.share();
+                const auto& ig = *ig_ptr;
                 auto insns_off = ig[boost::graph_bundle].insns_off;
                 if (insns_off == 0) {
                     return;
@@ -396,8 +397,8 @@ static void update_graphs()
                 vertices = vm.find_insn(*dex.hdl, offset, true);
             }
             if (vertices) {
-                vm.methods()[vertices->first].insns[vertices->second].counter
-                        = ictr.counter;
+                auto& ig = *vm.methods()[vertices->first].insns;
+                ig[vertices->second].counter = ictr.counter;
             }
             else {
                 std::cerr << "failed to find the vertex: ";
@@ -416,8 +417,9 @@ static void write_graphviz()
     std::cout << "writing the graphs... " << std::flush;
 
     {
+        const auto& cvm = vm;
         std::ofstream ofs("output/loader_graph.dot");
-        write_graphviz_loader_graph(ofs, vm.loaders());
+        write_graphviz_loader_graph(ofs, cvm.loaders());
     }
 
     {
@@ -433,7 +435,8 @@ static void write_graphviz()
     auto mg = vm.methods();
     for (const auto& v : boost::make_iterator_range(vertices(mg))) {
         const auto& mprop = mg[v];
-        const auto& ig = mprop.insns;
+        const auto ig_ptr = mprop.insns.share();
+        const auto& ig = *ig_ptr;
 
         if (mprop.class_hdl.file_hdl.loader_hdl == 0) {
             continue;
@@ -463,7 +466,8 @@ static void write_traces()
     const auto& cg = vm.classes();
     const auto& mg = vm.methods();
     for (const auto& mv : boost::make_iterator_range(vertices(mg))) {
-        const auto& ig = mg[mv].insns;
+        const auto ig_ptr = mg[mv].insns.share();
+        const auto& ig = *ig_ptr;
         for (const auto& iv : boost::make_iterator_range(vertices(ig))) {
             if (!is_basic_block_head(iv, ig)) {
                 continue;
@@ -611,7 +615,7 @@ static void handle_keyboard_event(unsigned char c, int /*x*/, int /*y*/)
         std::for_each(vertices(vm.methods()).first,
                       vertices(vm.methods()).second,
                       [&](const jitana::method_vertex_descriptor& v) {
-                          add_def_use_edges(vm.methods()[v].insns);
+                          add_def_use_edges(*vm.methods()[v].insns);
                       });
         break;
     }
@@ -726,12 +730,7 @@ void update_insn_counters()
 
             std::string local_filename = make_local_filename(dex.apk_filename);
 
-            auto lv = find_loader_vertex(app_loader_hdl, vm.loaders());
-            if (!lv) {
-                throw std::runtime_error("application loader not found");
-            }
-
-            dex.hdl = vm.loaders()[*lv].loader.add_file(local_filename);
+            dex.hdl = vm.add_dex_file(app_loader_hdl, local_filename);
 
             std::cout << "New DEX file (" << *dex.hdl << ") is added:\n";
             std::cout << "    Original: " << dex.apk_filename << "\n";